@@ -1,297 +1,715 @@
-#include "473_mm.h"
+#define _GNU_SOURCE
+#include "473_mm_internal.h"
 #include "errno.h"
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
 
-// Data Structures
-typedef struct virtual_page virtual_page;
-struct virtual_page {
-    int number;
-    void* start;
-    int size;
-    int modified;
-    int referenced;
-    virtual_page *next;
-    virtual_page *prev;
-};
-
-typedef struct virtual_page_queue virtual_page_queue;
-struct virtual_page_queue {
-    virtual_page *head;
-    virtual_page *tail;
-    virtual_page *hand;
-    int size;
-};
-
-// Function prototypes
-void handle_segv_fifo(siginfo_t *si);
-void handle_segv_clock(siginfo_t *si);
-
-int translate_to_page_number(void*);
-virtual_page *get_page(virtual_page_queue*, void*);
-void enqueue(virtual_page_queue*, virtual_page*);
-virtual_page* dequeue(virtual_page_queue*);
-virtual_page* init_page(int, void*, int, int);
-
-// Functions for clock algorithm
-void clock_init(virtual_page_queue*, int);
-virtual_page *circular_get_page(virtual_page_queue*, void*);
-void circular_enqueue(virtual_page_queue*, virtual_page*);
-void circular_replace(virtual_page_queue*, virtual_page*, virtual_page*);
+#if defined(__aarch64__)
+#include <asm/sigcontext.h>
+#endif
 
 // Global variables
-void *VM_START;
-int VM_SIZE;
-int NUMBER_OF_FRAMES;
-int PAGE_SIZE;
-int POLICY;
-int FAULT_COUNT = 0;
-int WRITE_BACK_COUNT = 0;
-virtual_page_queue *PAGE_QUEUE;
-
-static void segv_handler(int sig, siginfo_t *si, void *unused) {
-    if (POLICY == 1) {
-        handle_segv_fifo(si);
-    } else if (POLICY == 2) {
-        handle_segv_clock(si);
-    } else {
-        printf("Invalid policy.\n");
-        exit(EXIT_FAILURE);
+mm_context *DEFAULT_CONTEXT;
+
+// Serializes mm_create and mm_destroy_context. SEGV_REGIONS counts the
+// regions using the SIGSEGV backend; the handler is installed while it is
+// non-zero, and OLD_SEGV_ACTION is put back when it drops to zero.
+pthread_mutex_t CONTEXT_LOCK = PTHREAD_MUTEX_INITIALIZER;
+int SEGV_REGIONS;
+struct sigaction OLD_SEGV_ACTION;
+
+// Tells a read fault from a write fault using the context the kernel saved for the signal.
+// Build with -DMM_NO_FAULT_ACCESS to always take the portable path (FAULT_UNKNOWN).
+static int fault_access(void* context) {
+#if !defined(MM_NO_FAULT_ACCESS) && defined(__x86_64__) && defined(REG_ERR)
+    // Page fault error code, bit 1 is set for writes
+    ucontext_t *uc = context;
+    return (uc->uc_mcontext.gregs[REG_ERR] & 2) ? FAULT_WRITE : FAULT_READ;
+#elif !defined(MM_NO_FAULT_ACCESS) && defined(__aarch64__) && defined(ESR_MAGIC)
+    // The syndrome register is saved in one of the records following the registers
+    ucontext_t *uc = context;
+    struct _aarch64_ctx *head = (struct _aarch64_ctx*)uc->uc_mcontext.__reserved;
+    while (head->magic != 0 && head->size != 0) {
+        if (head->magic == ESR_MAGIC) {
+            unsigned long esr = ((struct esr_context*)head)->esr;
+            unsigned long ec = esr >> 26;
+            // Data aborts from lower or current exception level, WnR is bit 6
+            if (ec == 0x24 || ec == 0x25) {
+                return (esr & (1ul << 6)) ? FAULT_WRITE : FAULT_READ;
+            }
+            break;
+        }
+        head = (struct _aarch64_ctx*)((char*)head + head->size);
     }
+    return FAULT_UNKNOWN;
+#else
+    return FAULT_UNKNOWN;
+#endif
 }
 
-void mm_init(void* vm, int vm_size, int n_frames, int page_size, int policy) {
+static void segv_handler(int sig, siginfo_t *si, void *context) {
+    mm_context *ctx = region_find(si->si_addr);
+    if (ctx == NULL || ctx->backend != MM_BACKEND_SIGSEGV) {
+        // Not our region: let the access fault again and crash as it would have
+        sigaction(SIGSEGV, &OLD_SEGV_ACTION, NULL);
+        return;
+    }
+    // If the fault could not be handled right away, returning retries the access
+    handle_fault(ctx, si->si_addr, fault_access(context));
+}
 
-    // Initialize global variables
-    VM_START = vm;
-    VM_SIZE = vm_size;
-    NUMBER_OF_FRAMES = n_frames;
-    PAGE_SIZE = page_size;
-    POLICY = policy;
+// Entry point for every fault, whichever backend delivered it.
+// 'access' is one of the FAULT_* values. Returns what handle_segv (or shared_fault) returned.
+int handle_fault(mm_context* ctx, void* address, int access) {
+    uint64_t start = stats_ticks();
+    int result = ctx->shared != NULL ? shared_fault(ctx, address, access) : handle_segv(ctx, address, access);
+    if (result != FAULT_RETRY) {
+        stats_latency(ctx, result, stats_ticks() - start);
+    }
+    return result;
+}
 
-    // Initialize SIGSEGV handler
-    struct sigaction segv_action;
-    segv_action.sa_flags = SA_SIGINFO;
-    sigemptyset(&segv_action.sa_mask);
-    segv_action.sa_sigaction = segv_handler;
-    if (sigaction(SIGSEGV, &segv_action, NULL) == -1) {
-        printf("sigaction failed\n");
+// Changes the access rights of a page through the active backend
+void page_protect(mm_context* ctx, virtual_page* page, int prot) {
+    protect_range(ctx, page->start, page->size, prot);
+}
+
+// Gives a resident page back the rights it had: readable, and writable if it was written.
+// With dirty subpages only the parts that were written are writable.
+void page_reprotect(mm_context* ctx, virtual_page* page) {
+    if (!page->modified || !ctx->dirty_subpages) {
+        page_protect(ctx, page, page->modified ? PROT_READ|PROT_WRITE : PROT_READ);
+        return;
+    }
+    page_protect(ctx, page, PROT_READ);
+    uint64_t dirty = page->dirty;
+    while (dirty != 0) {
+        // Each run of set bits is one mprotect
+        int first = __builtin_ctzll(dirty);
+        uint64_t rest = ~dirty >> first;
+        int n = rest == 0 ? 64 - first : __builtin_ctzll(rest);
+        char *start = (char*)page->start + ((size_t)first << ctx->dirty_shift);
+        protect_range(ctx, start, (size_t)n << ctx->dirty_shift, PROT_READ|PROT_WRITE);
+        dirty = first + n < 64 ? dirty & (~0ull << (first + n)) : 0;
     }
+}
 
-    // Initialize the queue
-    PAGE_QUEUE = malloc(sizeof(virtual_page_queue));
-    PAGE_QUEUE->head = NULL;
-    PAGE_QUEUE->tail = NULL;
-    PAGE_QUEUE->hand = NULL;
-    PAGE_QUEUE->size = 0;
+// Marks the part of 'page' holding 'address' dirty and makes it writable
+void subpage_write(mm_context* ctx, virtual_page* page, void* address) {
+    int i = (int)(((char*)address - (char*)page->start) >> ctx->dirty_shift);
+    page->dirty |= 1ull << i;
+    char *start = (char*)page->start + ((size_t)i << ctx->dirty_shift);
+    protect_range(ctx, start, (size_t)1 << ctx->dirty_shift, PROT_READ|PROT_WRITE);
+}
 
-    if (POLICY == 2) {
-        // Initially create n blank virtual pages and add them to the circular list
-        clock_init(PAGE_QUEUE, n_frames);
+void protect_range(mm_context* ctx, void* start, size_t size, int prot) {
+    if (ctx->backend == MM_BACKEND_USERFAULTFD) {
+        uffd_protect(ctx, start, prot);
+    } else {
+        mprotect(start, size, prot);
     }
+}
 
-    // Protect entire memory space to fire initial segv
-    mprotect(vm, vm_size, PROT_NONE);
+void mm_init(void* vm, size_t vm_size, int n_frames, int page_size, int policy) {
+    mm_init_with_options(vm, vm_size, n_frames, page_size, policy, NULL);
+}
 
-    return;
+void mm_init_with_options(void* vm, size_t vm_size, int n_frames, int page_size, int policy, const mm_options* options) {
+    if (DEFAULT_CONTEXT != NULL) {
+        mm_destroy();
+    }
+    DEFAULT_CONTEXT = mm_create(vm, vm_size, n_frames, page_size, policy, options);
 }
 
-unsigned long mm_report_npage_faults() {
-    return FAULT_COUNT;
+// Size of a transparent huge page, 0 if the kernel has none
+static size_t huge_page_size() {
+    size_t size = 0;
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    if (fscanf(f, "%zu", &size) != 1) {
+        size = 0;
+    }
+    fclose(f);
+    return size;
 }
 
-unsigned long mm_report_nwrite_backs() {
-    return WRITE_BACK_COUNT;
+// Backs the region with transparent huge pages if every extent covers whole ones
+static void huge_pages_advise(mm_context* ctx) {
+    size_t huge = huge_page_size();
+    if (huge == 0 || ctx->page_size % huge != 0 || (uintptr_t)ctx->vm_start % huge != 0) {
+        return;
+    }
+    if (madvise(ctx->vm_start, ctx->vm_size, MADV_HUGEPAGE) == 0) {
+        ctx->huge_pages = 1;
+    }
 }
 
-void handle_segv_fifo(siginfo_t *si) {
+mm_context *mm_create(void* vm, size_t vm_size, int n_frames, int page_size, int policy, const mm_options* options) {
 
-    int page_number = translate_to_page_number(si->si_addr);
-    void* page_start_addr = VM_START + page_number * PAGE_SIZE;
-    virtual_page *page = get_page(PAGE_QUEUE, si->si_addr);
+    // Unset options default to zero
+    mm_options opts;
+    memset(&opts, 0, sizeof(opts));
+    if (options != NULL) {
+        opts = *options;
+    }
 
-    if (page != NULL) {
-        // We know we're doing a write here because:
-        //      - page is already in the queue
-        //      - page was initially given PROT_READ when it was added to the queue
-        // so, set the page as modified and allow reads and writes to the page
-        page->modified = 1;
-        mprotect(page->start, page->size, PROT_READ|PROT_WRITE);
-    } else {
-        virtual_page *new_page = init_page(page_number, page_start_addr, 0, 0);
-        enqueue(PAGE_QUEUE, new_page);
-        FAULT_COUNT++;
+    mm_context *ctx = calloc(1, sizeof(mm_context));
+    if (ctx == NULL) {
+        printf("context allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    ctx->vm_start = vm;
+    ctx->vm_size = vm_size;
+    ctx->n_frames = n_frames;
+    ctx->page_size = page_size;
+    ctx->page_shift = page_size > 0 && (page_size & (page_size - 1)) == 0 ? __builtin_ctz(page_size) : -1;
+    ctx->policy = policy;
+    ctx->backend = opts.backend;
+
+    // From here on a page is an extent of 'extent_pages' pages
+    ctx->subpages = 1;
+    if (opts.extent_pages > 1) {
+        size_t extent_size = (size_t)page_size * opts.extent_pages;
+        if ((opts.extent_pages & (opts.extent_pages - 1)) != 0 || ctx->page_shift < 0
+                || page_size % sysconf(_SC_PAGE_SIZE) != 0 || extent_size > INT_MAX / 2 + 1 || vm_size % extent_size != 0) {
+            printf("Invalid extent size.\n");
+            exit(EXIT_FAILURE);
+        }
+        ctx->subpages = opts.extent_pages;
+        ctx->page_size = extent_size;
+        ctx->page_shift += __builtin_ctz(opts.extent_pages);
+        // One bit of the dirty mask per page, or per 1/64 of the extent for larger ones
+        ctx->dirty_subpages = opts.dirty_subpages && ctx->backend == MM_BACKEND_SIGSEGV;
+        ctx->dirty_shift = ctx->page_shift - (opts.extent_pages > 64 ? 6 : __builtin_ctz(opts.extent_pages));
+    }
+    if (vm_size / ctx->page_size > INT_MAX) {
+        printf("Region has too many pages.\n");
+        exit(EXIT_FAILURE);
+    }
+    ctx->n_pages = vm_size / ctx->page_size;
+    stats_init(ctx);
 
-        // Since the page is now in the queue, allow reads to this page.
-        mprotect(new_page->start, new_page->size, PROT_READ);
+    ctx->policy_ops = find_policy(policy);
+    if (ctx->policy_ops == NULL) {
+        printf("Invalid policy.\n");
+        exit(EXIT_FAILURE);
     }
 
-}
+    // Initialize the page table, every page starts out non-resident
+    if (radix_init(&ctx->page_index, ctx->n_pages, sizeof(page_entry)) == -1) {
+        printf("page table allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
 
-void handle_segv_clock(siginfo_t *si) {
-    
-    int page_number = translate_to_page_number(si->si_addr);
-    void* page_start_addr = VM_START + page_number * PAGE_SIZE;
-    virtual_page *page = circular_get_page(PAGE_QUEUE, si->si_addr);
+    // One descriptor per frame. A victim is always released before the
+    // incoming page takes its descriptor.
+    pool_init(ctx, n_frames);
 
-    if (page != NULL) {
-        page->modified = 1;
-        page->referenced = 1;
-        mprotect(page->start, page->size, PROT_READ|PROT_WRITE);
+    if (opts.admission) {
+        ctx->policy_state = admission_init(ctx, ctx->policy_ops, n_frames);
+        ctx->policy_ops = &ADMISSION_POLICY;
     } else {
-        virtual_page *new_page = init_page(page_number, page_start_addr, 0, 1);
-        circular_enqueue(PAGE_QUEUE, new_page);
-        FAULT_COUNT++;
-        mprotect(new_page->start, new_page->size, PROT_READ);
+        ctx->policy_state = ctx->policy_ops->init(ctx, n_frames);
+    }
+
+    readahead_init(ctx, opts.readahead);
+
+    if (opts.file_path != NULL) {
+        if (ctx->backend != MM_BACKEND_SIGSEGV) {
+            printf("File backed regions need the SIGSEGV backend.\n");
+            exit(EXIT_FAILURE);
+        }
+        opts.reclaim = 1;
+        if (swap_open(ctx, opts.file_path, 1) == -1) {
+            printf("could not open backing file %s\n", opts.file_path);
+            exit(EXIT_FAILURE);
+        }
+    } else if (opts.reclaim && swap_open(ctx, opts.swap_path, 0) == -1) {
+        printf("could not create swap file\n");
+        exit(EXIT_FAILURE);
     }
-}
 
-// Initializes blank referenced pages for clock algorithm
-void clock_init(virtual_page_queue* queue, int n) {
+    if (opts.reclaim && opts.dedup_budget > 0 && opts.file_path == NULL && ctx->backend == MM_BACKEND_SIGSEGV
+            && dedup_init(ctx, opts.dedup_budget, opts.dedup_scan) == -1) {
+        printf("could not set up deduplication\n");
+        exit(EXIT_FAILURE);
+    }
 
-    // Create initial head page, then attach the rest of the pages
-    // Need to create n empty pages
-    virtual_page *head_page = init_page(-1, VM_START + PAGE_SIZE, 0, 1);
-    queue->head = head_page;
-    queue->tail = head_page;
+    if (opts.reclaim && opts.compress_budget > 0 && ctx->backend == MM_BACKEND_SIGSEGV
+            && zpool_init(ctx, opts.compress_budget) == -1) {
+        printf("could not set up the compressed pool\n");
+        exit(EXIT_FAILURE);
+    }
 
-    // Attach empty pages to head page
-    int i = 0;
-    for (i = 0; i < n-1; i++) {
-        void* page_start_addr = VM_START + i * PAGE_SIZE;
-        virtual_page *new_page = init_page(-1, page_start_addr, 0, 1);
-        new_page->prev = queue->tail;
-        new_page->next = queue->head;
-        queue->tail->next = new_page;
-        queue->tail = new_page;
+    if (opts.mrc_samples > 0 && mrc_init(ctx, opts.mrc_samples) == -1) {
+        printf("could not set up the miss ratio curve\n");
+        exit(EXIT_FAILURE);
     }
 
-    // Set the hand of the clock to the head. and Ensure the queue is circular.
-    queue->hand = queue->head;
-    queue->head->prev = queue->tail;
-    queue->tail->next = queue->head;
-}
+    if (opts.reclaimer && reclaimer_init(ctx, opts.free_low, opts.free_high) == -1) {
+        printf("could not start the reclaimer\n");
+        exit(EXIT_FAILURE);
+    }
 
-// Returns the page that contains the request address
-// If the page is not in the queue, return null
-virtual_page *get_page(virtual_page_queue* queue, void* address) {
-    int page_num = translate_to_page_number(address);
-
-    virtual_page *current = queue->head;
-    while (current != NULL) {
-        if (current->number == page_num) {
-            return current;
-        }
-        current = current->next;
+    if (opts.trace_path != NULL && trace_open(ctx, opts.trace_path) == -1) {
+        printf("could not open trace file %s\n", opts.trace_path);
+        exit(EXIT_FAILURE);
     }
-    return NULL;
-}
 
-void enqueue(virtual_page_queue* queue, virtual_page* page) {
-    // Check if we need to evict any pages first.
-    if (queue->size >= NUMBER_OF_FRAMES) {
-        virtual_page *evicted_page = dequeue(PAGE_QUEUE);
-        // If the page was modified, increment the write back count.
-        if (evicted_page->modified == 1) {
-            WRITE_BACK_COUNT++;
+    pthread_mutex_lock(&CONTEXT_LOCK);
+    if (region_add(ctx) == -1) {
+        printf("Region overlaps a managed region.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Initialize SIGSEGV handler
+    if (ctx->backend == MM_BACKEND_SIGSEGV && SEGV_REGIONS++ == 0) {
+        struct sigaction segv_action;
+        segv_action.sa_flags = SA_SIGINFO;
+        sigemptyset(&segv_action.sa_mask);
+        segv_action.sa_sigaction = segv_handler;
+        if (sigaction(SIGSEGV, &segv_action, &OLD_SEGV_ACTION) == -1) {
+            printf("sigaction failed\n");
         }
     }
+    pthread_mutex_unlock(&CONTEXT_LOCK);
 
-    if (queue->head == NULL) {
-        queue->head = page;
-        queue->tail = page;
-        page->next = NULL;
+    if (ctx->backend == MM_BACKEND_USERFAULTFD) {
+        // Drop the whole region so the first access to each page is a missing fault
+        if (uffd_init(ctx) == -1) {
+            printf("userfaultfd initialization failed\n");
+            exit(EXIT_FAILURE);
+        }
     } else {
-        page->prev = queue->tail;
-        queue->tail->next = page;
-        queue->tail = page;
+        // Protect entire memory space to fire initial segv
+        mprotect(vm, vm_size, PROT_NONE);
     }
-    queue->size++;
+
+    if (opts.huge_pages) {
+        huge_pages_advise(ctx);
+    }
+
+    return ctx;
+}
+
+void mm_destroy() {
+    if (DEFAULT_CONTEXT == NULL) {
+        return;
+    }
+    mm_destroy_context(DEFAULT_CONTEXT);
+    DEFAULT_CONTEXT = NULL;
 }
 
-virtual_page* dequeue(virtual_page_queue* queue) {
-    virtual_page *temp = queue->head;
-    if (queue->head->next != NULL) {
-        queue->head = queue->head->next;
-        queue->head->prev = NULL;
+void mm_destroy_context(mm_context* ctx) {
+    reclaimer_destroy(ctx);
+
+    // Stop handling faults before the region becomes accessible
+    if (ctx->backend == MM_BACKEND_USERFAULTFD) {
+        uffd_destroy(ctx);
     } else {
-        queue->head = NULL;
+        mprotect(ctx->vm_start, ctx->vm_size, PROT_READ|PROT_WRITE);
+    }
+    swap_close(ctx);
+    zpool_destroy(ctx);
+
+    pthread_mutex_lock(&CONTEXT_LOCK);
+    region_remove(ctx);
+    if (ctx->backend == MM_BACKEND_SIGSEGV && --SEGV_REGIONS == 0) {
+        sigaction(SIGSEGV, &OLD_SEGV_ACTION, NULL);
     }
-    queue->size--;
+    pthread_mutex_unlock(&CONTEXT_LOCK);
+
+    trace_close(ctx);
+    shared_close(ctx);
+    mrc_destroy(ctx);
+    ctx->policy_ops->destroy(ctx->policy_state);
+    pool_destroy(ctx);
+    radix_destroy(&ctx->page_index);
+    free(ctx);
+}
+
+unsigned long mm_report_npage_faults() {
+    return DEFAULT_CONTEXT == NULL ? 0 : mm_context_npage_faults(DEFAULT_CONTEXT);
+}
+
+unsigned long mm_report_nwrite_backs() {
+    return DEFAULT_CONTEXT == NULL ? 0 : mm_context_nwrite_backs(DEFAULT_CONTEXT);
+}
+
+unsigned long mm_report_nbytes_released() {
+    return DEFAULT_CONTEXT == NULL ? 0 : mm_context_nbytes_released(DEFAULT_CONTEXT);
+}
+
+unsigned long mm_report_nbytes_restored() {
+    return DEFAULT_CONTEXT == NULL ? 0 : mm_context_nbytes_restored(DEFAULT_CONTEXT);
+}
+
+unsigned long mm_report_nprotection_faults() {
+    return DEFAULT_CONTEXT == NULL ? 0 : mm_context_nprotection_faults(DEFAULT_CONTEXT);
+}
+
+unsigned long mm_report_nprefetches() {
+    return DEFAULT_CONTEXT == NULL ? 0 : mm_context_nprefetches(DEFAULT_CONTEXT);
+}
+
+unsigned long mm_report_nfaults_avoided() {
+    return DEFAULT_CONTEXT == NULL ? 0 : mm_context_nfaults_avoided(DEFAULT_CONTEXT);
+}
+
+unsigned long mm_context_npage_faults(mm_context* ctx) {
+    return atomic_load_explicit(&ctx->fault_count, memory_order_relaxed);
+}
+
+unsigned long mm_context_nwrite_backs(mm_context* ctx) {
+    return atomic_load_explicit(&ctx->write_back_count, memory_order_relaxed);
+}
+
+unsigned long mm_context_nbytes_released(mm_context* ctx) {
+    return atomic_load_explicit(&ctx->bytes_released, memory_order_relaxed);
+}
 
-    mprotect(temp->start, temp->size, PROT_NONE);
+unsigned long mm_context_nbytes_restored(mm_context* ctx) {
+    return atomic_load_explicit(&ctx->bytes_restored, memory_order_relaxed);
+}
+
+unsigned long mm_context_nprotection_faults(mm_context* ctx) {
+    return atomic_load_explicit(&ctx->protection_faults, memory_order_relaxed);
+}
 
-    return temp;
+unsigned long mm_context_nprefetches(mm_context* ctx) {
+    return atomic_load_explicit(&ctx->prefetches, memory_order_relaxed);
 }
 
-int translate_to_page_number(void* address) {
-    return (int)((address - VM_START) / PAGE_SIZE);
+unsigned long mm_context_nfaults_avoided(mm_context* ctx) {
+    return atomic_load_explicit(&ctx->faults_avoided, memory_order_relaxed);
 }
 
-virtual_page *circular_get_page(virtual_page_queue* queue, void* address) {
-    int page_num = translate_to_page_number(address);
+// Handles a fault on 'address' for every replacement policy. The policy is
+// only told what happened to its pages through ctx->policy_ops.
+// Returns FAULT_RETRY if the fault has to be retried because the victim page was busy,
+// otherwise FAULT_MAPPED or FAULT_UPGRADED.
+int handle_segv(mm_context* ctx, void* address, int access) {
 
-    if (queue->head != NULL) {
-        // Keep traversing the list until we hit the head again.
-        virtual_page *current = queue->head;
-        do {
-            if (current->number == page_num) {
-                return current;
+    int page_number = translate_to_page_number(ctx, address);
+    void* page_start_addr = (char*)ctx->vm_start + (size_t)page_number * ctx->page_size;
+    int result = FAULT_MAPPED;
+
+    page_entry *entry = page_entry_get(ctx, page_number);
+    spin_lock(&entry->lock);
+    virtual_page *page = entry->page;
+
+    if (page != NULL) {
+        result = FAULT_UPGRADED;
+        atomic_fetch_add_explicit(&ctx->protection_faults, 1, memory_order_relaxed);
+        int write = access != FAULT_READ;
+
+        // Without the fault access we know we're doing a write here because:
+        //      - page is already resident
+        //      - page was initially given PROT_READ when it became resident
+        // so, set the page as modified and allow reads and writes to the page.
+        // A read that raced with another thread mapping this page also ends up
+        // here; treating it as a write only costs an extra write back.
+        // A known read means the page was made readable after this access faulted,
+        // or lost its rights to the eviction of a blank clock page sharing its
+        // address. It still counts as a use of the page.
+        if (write) {
+            page->modified = 1;
+            atomic_fetch_add_explicit(&ctx->write_upgrades, 1, memory_order_relaxed);
+            // A page sharing a copy's memory gets its own at the first write
+            dedup_write(ctx, entry, page_number);
+        }
+        spin_lock(&ctx->policy_lock);
+        if (page->prefetched) {
+            prefetch_used(ctx, page);
+        }
+        if (!page->pinned) {
+            ctx->policy_ops->on_write(ctx->policy_state, page);
+        }
+        if (ctx->trace != NULL && write) {
+            trace_event(ctx, page_number, 1);
+        }
+        if (ctx->mrc != NULL) {
+            mrc_access(ctx, page_number);
+        }
+        spin_unlock(&ctx->policy_lock);
+        if (write && ctx->dirty_subpages) {
+            subpage_write(ctx, page, address);
+        } else {
+            page_reprotect(ctx, page);
+        }
+    } else {
+        evicted_page victim;
+        victim.start = NULL;
+        virtual_page *prefetch[READAHEAD_MAX_WINDOW];
+        evicted_page prefetch_victims[READAHEAD_MAX_WINDOW];
+        int n_prefetch = 0;
+
+        spin_lock(&ctx->policy_lock);
+
+        // Check if we need to evict any pages first.
+        if (ctx->resident_pages >= ctx->n_frames) {
+            virtual_page *victim_page = ctx->policy_ops->pick_victim(ctx->policy_state, page_number);
+            // The victim is in the middle of its own fault, let this access fault again
+            if (victim_page->number >= 0 && !spin_trylock(&page_entry_get(ctx, victim_page->number)->lock)) {
+                spin_unlock(&ctx->policy_lock);
+                spin_unlock(&entry->lock);
+                return FAULT_RETRY;
             }
-            current = current->next;
-        } while (current != queue->head);
+            detach_page(ctx, victim_page, &victim);
+        }
+
+        // A write fault maps the page writable right away. The policy and the
+        // trace still see a fault followed by a write, as if the write had
+        // faulted a second time.
+        int write = access == FAULT_WRITE;
+        virtual_page *new_page = init_page(ctx, page_number, page_start_addr, write, 0);
+        entry->page = new_page;
+        ctx->resident_pages++;
+
+        // The readahead window takes its frames before this page joins the policy
+        if ((ctx->readahead.max_window > 0 || (entry->advice & ADVICE_SEQUENTIAL)) && !(entry->advice & ADVICE_RANDOM)) {
+            n_prefetch = readahead_collect(ctx, page_number, entry->advice, prefetch, prefetch_victims);
+        }
+
+        ctx->policy_ops->on_fault(ctx->policy_state, new_page);
+        if (write) {
+            ctx->policy_ops->on_write(ctx->policy_state, new_page);
+        }
+        atomic_fetch_add_explicit(&ctx->fault_count, 1, memory_order_relaxed);
+        if (!write) {
+            atomic_fetch_add_explicit(&ctx->read_faults, 1, memory_order_relaxed);
+        }
+        if (ctx->trace != NULL) {
+            trace_event(ctx, page_number, 0);
+            if (write) {
+                trace_event(ctx, page_number, 1);
+            }
+        }
+        if (ctx->mrc != NULL) {
+            mrc_access(ctx, page_number);
+        }
+        if (entry->advice & ADVICE_PIN) {
+            page_pin(ctx, new_page);
+        }
+        readahead_admit(ctx, prefetch, n_prefetch);
+        int wake = ctx->reclaimer != NULL && ctx->n_frames - ctx->resident_pages < ctx->free_low;
+
+        spin_unlock(&ctx->policy_lock);
+
+        if (wake) {
+            reclaimer_wake(ctx);
+        }
+
+        if (victim.start != NULL) {
+            release_evicted(ctx, &victim);
+        }
+
+        if (ctx->swap != NULL && ctx->backend == MM_BACKEND_SIGSEGV) {
+            swap_in(ctx, new_page);
+        }
+
+        // Since the page is now resident, allow reads to this page, and writes
+        // if that is what faulted. With dirty subpages only the written one is opened for writes.
+        int prot = write && !ctx->dirty_subpages ? PROT_READ|PROT_WRITE : PROT_READ;
+        if (n_prefetch > 0) {
+            readahead_map(ctx, new_page, prot, prefetch, prefetch_victims, n_prefetch);
+        } else {
+            page_protect(ctx, new_page, prot);
+        }
+        if (write && ctx->dirty_subpages) {
+            subpage_write(ctx, new_page, address);
+        }
     }
 
-    return NULL;
+    spin_unlock(&entry->lock);
+    return result;
+}
+
+// Takes a page chosen by the policy out of its frame and returns its
+// descriptor to the pool. Called with ctx->policy_lock and the page's lock held,
+// the rest of the eviction happens in release_evicted once ctx->policy_lock is dropped.
+void detach_page(mm_context* ctx, virtual_page* page, evicted_page* out) {
+    ctx->policy_ops->on_evict(ctx->policy_state, page);
+    free_frame(ctx, page, out);
 }
 
-void circular_enqueue(virtual_page_queue* queue, virtual_page* page) {
-    virtual_page *current = queue->hand;
-    while (current->referenced == 1) {
-        current->referenced = 0;
-        current = current->next;
+// Takes a page that is no longer on any list out of its frame. Called like detach_page.
+void free_frame(mm_context* ctx, virtual_page* page, evicted_page* out) {
+    out->number = page->number;
+    out->start = page->start;
+    out->size = page->size;
+    out->modified = page->modified;
+    out->dirty = page->dirty;
+
+    // Blank pages from clock_init are not in the page table
+    if (page->number >= 0) {
+        page_entry_get(ctx, page->number)->page = NULL;
     }
 
-    circular_replace(PAGE_QUEUE, current, page);
-    queue->hand = current->next;
+    ctx->resident_pages--;
+    pool_free(ctx, page);
 }
 
-// Replaces old_page with new_page
-void circular_replace(virtual_page_queue* queue, virtual_page* old_page, virtual_page* new_page) {
-
-    if (old_page->modified == 1) {
-        WRITE_BACK_COUNT++;
+// Finishes the eviction of a detached page and unlocks it
+void release_evicted(mm_context* ctx, evicted_page* page) {
+    if (ctx->swap != NULL && ctx->backend == MM_BACKEND_SIGSEGV && page->number >= 0) {
+        // Contents found in a shared copy were not written anywhere
+        if (swap_out(ctx, page)) {
+            page->modified = 0;
+        }
+    } else {
+        protect_range(ctx, page->start, page->size, PROT_NONE);
     }
+    account_evicted(ctx, page);
 
-    new_page->next = old_page->next;
-    new_page->prev = old_page->prev;
+    if (page->number >= 0) {
+        spin_unlock(&page_entry_get(ctx, page->number)->lock);
+    }
+}
 
-    old_page->prev->next = new_page;
-    old_page->next->prev = new_page;
-    if (old_page == queue->head) {
-        queue->head = new_page;
+// Counts an eviction and its write back
+void account_evicted(mm_context* ctx, evicted_page* page) {
+    // If the page was modified, increment the write back count.
+    if (page->modified == 1) {
+        atomic_fetch_add_explicit(&ctx->write_back_count, 1, memory_order_relaxed);
+    }
+    // Blank clock pages never held a page
+    if (page->number >= 0) {
+        atomic_fetch_add_explicit(&ctx->evictions, 1, memory_order_relaxed);
     }
+}
+
+// Returns the page that contains the request address
+// If the page is not resident, return null
+virtual_page *get_page(mm_context* ctx, void* address) {
+    int page_num = translate_to_page_number(ctx, address);
 
-    if (old_page == queue->tail) {
-        queue->tail = new_page;
+    if (page_num < 0 || page_num >= ctx->n_pages) {
+        return NULL;
     }
-    // Ensure queue remains circular
-    queue->head->prev = queue->tail;
-    queue->tail->next = queue->head;
+    page_entry *entry = page_entry_find(ctx, page_num);
+    return entry == NULL ? NULL : entry->page;
+}
 
-    // protect old page
-    mprotect(old_page->start, old_page->size, PROT_NONE);
+// Calls 'fn' for every page of the region that is in memory, even in part. mincore is asked about
+// SCAN_CHUNK system pages at a time, so scanning a huge region needs no large buffer.
+#define SCAN_CHUNK 65536
+
+void scan_resident(mm_context* ctx, void (*fn)(mm_context*, int)) {
+    long system_page = sysconf(_SC_PAGE_SIZE);
+    int per_page = ctx->page_size > system_page ? ctx->page_size / system_page : 1;
+    int chunk = SCAN_CHUNK / per_page > 0 ? SCAN_CHUNK / per_page : 1;
+    unsigned char *resident = malloc((size_t)chunk * per_page);
+    if (resident == NULL) {
+        return;
+    }
+    int first = 0;
+    for (first = 0; first < ctx->n_pages; first += chunk) {
+        int n = ctx->n_pages - first < chunk ? ctx->n_pages - first : chunk;
+        char *start = (char*)ctx->vm_start + (size_t)first * ctx->page_size;
+        if (mincore(start, (size_t)n * ctx->page_size, resident) != 0) {
+            break;
+        }
+        int i = 0;
+        for (i = 0; i < n; i++) {
+            int k = 0;
+            while (k < per_page && !(resident[i * per_page + k] & 1)) {
+                k++;
+            }
+            if (k < per_page) {
+                fn(ctx, first + i);
+            }
+        }
+    }
+    free(resident);
+}
 
-    free(old_page);
+// Page sizes are powers of two in practice, which saves the division on every fault
+int translate_to_page_number(mm_context* ctx, void* address) {
+    size_t offset = (char*)address - (char*)ctx->vm_start;
+    if (ctx->page_shift >= 0) {
+        return (int)(offset >> ctx->page_shift);
+    }
+    return (int)(offset / ctx->page_size);
 }
 
 // Initializes a new virtual page
-virtual_page* init_page(int number, void* start_addr, int modified, int referenced) {
-    virtual_page *new_page = malloc(sizeof(virtual_page));
+virtual_page* init_page(mm_context* ctx, int number, void* start_addr, int modified, int referenced) {
+    virtual_page *new_page = ctx->free_pages;
+    if (new_page == NULL) {
+        printf("Out of frame descriptors.\n");
+        exit(EXIT_FAILURE);
+    }
+    ctx->free_pages = new_page->next;
 
     new_page->start = start_addr;
-    new_page->size = PAGE_SIZE;
+    new_page->size = ctx->page_size;
     new_page->number = number;
     new_page->referenced = referenced;
     new_page->modified = modified;   
+    new_page->state = 0;
+    new_page->prefetched = 0;
+    new_page->pinned = 0;
+    new_page->windowed = 0;
+    new_page->dirty = 0;
+    new_page->next = NULL;
+    new_page->prev = NULL;
 
     return new_page;
-}
\ No newline at end of file
+}
+
+// Allocates the descriptor arena and chains every descriptor onto the free list
+void pool_init(mm_context* ctx, int n) {
+    ctx->page_pool = NULL;
+    ctx->pool_size = 0;
+    ctx->free_pages = NULL;
+
+    pool_chunk *chunk = pool_chunk_new(n);
+    if (chunk == NULL) {
+        printf("frame pool allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pool_add(ctx, chunk);
+}
+
+// Allocates 'n' more descriptors for pool_add, outside of any lock
+pool_chunk *pool_chunk_new(int n) {
+    pool_chunk *chunk = malloc(sizeof(pool_chunk) + (size_t)n * sizeof(virtual_page));
+    if (chunk != NULL) {
+        chunk->size = n;
+    }
+    return chunk;
+}
+
+// Chains the descriptors of a chunk onto the free list. After mm_init it is
+// called with ctx->policy_lock held.
+void pool_add(mm_context* ctx, pool_chunk* chunk) {
+    chunk->next = ctx->page_pool;
+    ctx->page_pool = chunk;
+    ctx->pool_size += chunk->size;
+
+    int i = 0;
+    for (i = chunk->size - 1; i >= 0; i--) {
+        pool_free(ctx, &chunk->pages[i]);
+    }
+}
+
+void pool_destroy(mm_context* ctx) {
+    while (ctx->page_pool != NULL) {
+        pool_chunk *chunk = ctx->page_pool;
+        ctx->page_pool = chunk->next;
+        free(chunk);
+    }
+}
+
+// Returns a descriptor to the free list
+void pool_free(mm_context* ctx, virtual_page* page) {
+    page->next = ctx->free_pages;
+    ctx->free_pages = page;
+}
+
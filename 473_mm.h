@@ -1,23 +1,147 @@
 #ifndef _473_MM_H
 #define _473_MM_H
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
 #include <sys/mman.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
 'mm_init()' initializes the memory management system.
 'vm' denotes the pointer to the start of virtual address space,
-'vm_size' denotes the size of the virtual address space,
+'vm_size' denotes the size of the virtual address space. It can be up to 2^31 - 1 pages (8 TiB with 4 KiB pages);
+the page table only takes memory for the parts of the region that are used, so a huge mapping made with
+MAP_NORESERVE costs little more than the pages that are touched,
 'n_frames' denotes the number of physical pages available in the system,
 'page_size' denotes the size of both virtual and physical pages,
-'policy' can take values 1 or 2 -- 1 indicates fifo replacement policy and 2 indicates clock replacement policy.
+'policy' can take values 1 to 7 -- 1 indicates fifo replacement policy and 2 indicates clock replacement policy,
+3 to 7 select lru, 2q, arc, clock-pro and a bitmap clock (see the MM_POLICY_* constants below).
+*/
+void mm_init(void* vm, size_t vm_size, int n_frames, int page_size, int policy);
+
+/*
+Replacement policies.
+Reads of resident pages do not fault, so lru, 2q, arc and clock-pro only see a page being used again
+when it is written for the first time or when it faults again after being evicted.
+MM_POLICY_CLOCK_BITMAP picks the same victims as MM_POLICY_CLOCK, but keeps the referenced bits in a bitmap
+indexed by frame and scans it a word at a time, which is faster with many frames.
+*/
+#define MM_POLICY_FIFO 1
+#define MM_POLICY_CLOCK 2
+#define MM_POLICY_LRU 3
+#define MM_POLICY_2Q 4
+#define MM_POLICY_ARC 5
+#define MM_POLICY_CLOCK_PRO 6
+#define MM_POLICY_CLOCK_BITMAP 7
+
+/*
+Fault backends that can be selected through 'mm_options'.
+MM_BACKEND_SIGSEGV protects non-resident pages with mprotect and handles faults in a SIGSEGV handler.
+MM_BACKEND_USERFAULTFD registers the region with userfaultfd and handles missing-page and write-protect faults
+on a dedicated thread. With this backend 'vm' must be a private anonymous mapping (e.g. from mmap);
+pages that are resident at 'mm_init()' time keep their contents.
+*/
+#define MM_BACKEND_SIGSEGV 0
+#define MM_BACKEND_USERFAULTFD 1
+
+/*
+Extra settings for 'mm_init_with_options()'. Zero-initialize the struct, every field defaults to 0.
+'backend' selects one of the MM_BACKEND_* fault backends,
+'trace_path', if not NULL, names a file that receives a binary record of every fault
+(page number, read or write, timestamp), see 473_mm_trace.h and the mm_replay tool.
+'reclaim', if non-zero, makes 'n_frames' a real limit on the memory the region uses: evicted pages are released
+with MADV_DONTNEED, modified ones after being saved to a swap file, and are read back when they fault in again.
+'swap_path' names the swap file. If it is NULL an unnamed temporary file in $TMPDIR (or /tmp) is used.
+'readahead', if non-zero, is the largest number of pages (at most 64, and at most half of 'n_frames') made resident
+ahead of a sequential or strided run of faults. Prefetched pages take frames and go through the policy like faulted
+pages, but are not counted as page faults.
+'reclaimer', if non-zero, starts a background thread that evicts pages in batches to keep between 'free_low' and
+'free_high' frames free, so faults rarely have to evict a page themselves. The thread also does the write backs.
+A watermark of 0 picks the default, 1/64 of 'n_frames' for 'free_low' and 1/16 for 'free_high'. At most half of the
+frames are kept free.
+'compress_budget', if non-zero and 'reclaim' is set, keeps evicted pages compressed in memory, in a pool of at most
+that many bytes (in slabs of 64 KiB or 3/4 of a page, whichever is larger), before they go to the swap file.
+Zero-filled and same-filled pages only take a marker. A page that faults back in is decompressed from the pool.
+Only the SIGSEGV backend uses the pool.
+'mrc_samples', if non-zero, estimates the miss ratio curve of the region while it runs, tracking at most that many
+sampled pages (about 50 bytes each), see 'mm_predict_fault_ratio()'.
+'file_path', if not NULL, backs the region with that file instead of a swap file, and implies 'reclaim'. The file is
+created if it does not exist and is never truncated. Page i of the region is bytes i * 'page_size' onward of the file:
+a page faulting in for the first time is read from the file (past its end it reads as zeros) and a modified page is
+written back when it is evicted. 'mm_destroy()' writes the remaining modified pages and syncs the file, and only
+the resident pages keep their contents in the region afterwards. MM_ADVICE_DONTNEED drops unsaved changes, the range
+reads back from the file. Only the SIGSEGV backend supports file backed regions.
+With the SIGSEGV backend write backs to the file (or the swap file) are asynchronous: an evicted page is copied into
+one of 64 write buffers and written in batches by background threads, through io_uring where the kernel allows it.
+A page that faults in again while it is being written is copied from its buffer.
+'admission', if non-zero, puts a scan resistant admission filter in front of the replacement policy. New pages wait
+in a small window (1% of the frames) and only join the policy's pages when a frequency sketch estimates them hotter
+than the page the policy would evict for them, otherwise they are evicted from the window. The sketch counts write
+faults on resident pages and faults on recently evicted pages, and is halved periodically so it forgets old history.
+A large scan then passes through the window without evicting the hot pages.
+'dedup_budget', if non-zero and 'reclaim' is set, lets pages with the same contents share one copy in memory, in
+at most that many bytes of copies. An evicted page that has to be saved is hashed and compared with the copies and
+with the last page saved with the same hash. If one matches it is not written anywhere and is not counted as a
+write back. A page faulting in from a copy maps the copy read only, so every resident page with those contents
+uses the same memory, and its first write gives it its own. The region must be a private anonymous mapping.
+Only the SIGSEGV backend deduplicates, file backed regions do not.
+'dedup_scan', if non-zero with 'dedup_budget' and 'reclaimer', also has the background thread share the memory
+of resident pages with the same contents while it has nothing to evict, 64 pages every 10 milliseconds.
+'extent_pages', if greater than 1, manages the region in extents of that many pages (a power of two) instead of
+single pages: an extent faults in, is protected, takes a frame and is evicted and written back as a whole, with one
+descriptor and one page table entry. 'n_frames' then counts extents, and so do the counters of 'mm_stats' and the
+page numbers of traces, hints and the miss ratio curve. 'page_size' must be a power of two multiple of the system
+page size and 'vm_size' a multiple of the extent size.
+'huge_pages', if non-zero, asks for the region to be backed by transparent huge pages (MADV_HUGEPAGE). It only has
+an effect if the extents are a multiple of the huge page size (2 MiB on x86-64) and the region starts at a multiple
+of it, since a smaller extent would split the huge pages with its mprotect calls ('dirty_subpages' does too).
+'dirty_subpages', if non-zero with 'extent_pages', tracks which pages of an extent were written. A write maps only
+its page writable, so every page written costs a protection fault, and an extent whose clean pages are already
+in the swap file (or the backing file) writes back only its dirty pages, synchronously. Extents of more than 64
+pages are tracked in 64 equal parts instead of pages. Only the SIGSEGV backend tracks dirty pages.
+*/
+typedef struct mm_options mm_options;
+struct mm_options {
+    int backend;
+    const char *trace_path;
+    int reclaim;
+    const char *swap_path;
+    int readahead;
+    int reclaimer;
+    int free_low;
+    int free_high;
+    size_t compress_budget;
+    int mrc_samples;
+    const char *file_path;
+    int admission;
+    size_t dedup_budget;
+    int dedup_scan;
+    int extent_pages;
+    int huge_pages;
+    int dirty_subpages;
+};
+
+/*
+'mm_init_with_options()' is 'mm_init()' with extra settings.
+'options' may be NULL, in which case it behaves exactly like 'mm_init()'.
+*/
+void mm_init_with_options(void* vm, size_t vm_size, int n_frames, int page_size, int policy, const mm_options* options);
+
+/*
+'mm_destroy()' tears down the memory management system set up by 'mm_init()'.
+It releases the page table and all frame descriptors in one call, makes the whole virtual address space
+readable and writable again and, once no other region needs it, restores the previous SIGSEGV handler.
 */
-void mm_init(void* vm, int vm_size, int n_frames, int page_size, int policy);
+void mm_destroy();
 
 /*
 'mm_report_npage_faults' should return the total number of page faults of the entire system (across all virtual pages).
+Like 'mm_report_nwrite_backs', it only counts the region given to 'mm_init()'.
 */
 unsigned long mm_report_npage_faults();
 
@@ -26,4 +150,240 @@ unsigned long mm_report_npage_faults();
 */
 unsigned long mm_report_nwrite_backs();
 
+/*
+'mm_report_nbytes_released' returns the number of bytes of memory released by evicting pages, and
+'mm_report_nbytes_restored' the number of bytes read back from the swap file (or the backing file). Both stay 0
+unless 'reclaim' is set.
+*/
+unsigned long mm_report_nbytes_released();
+unsigned long mm_report_nbytes_restored();
+
+/*
+'mm_report_nprotection_faults' returns the number of faults on resident pages, which only change the access rights
+of the page (e.g. the first write to a page that was read). Page faults plus protection faults is the number of
+faults the system handled. Where the fault handler can tell writes from reads (x86-64 and aarch64 Linux), a write to
+a non-resident page maps it writable directly and causes no protection fault.
+*/
+unsigned long mm_report_nprotection_faults();
+
+/*
+'mm_report_nprefetches' returns the number of pages made resident by readahead, and 'mm_report_nfaults_avoided'
+how many of them were used, i.e. page faults that readahead saved. The prefetch accuracy is their ratio.
+A read of a prefetched page does not fault, so a page is only known to be used once a run of faults moves past it
+or it is written.
+*/
+unsigned long mm_report_nprefetches();
+unsigned long mm_report_nfaults_avoided();
+
+/*
+Independent managed regions.
+'mm_init()' manages a single default region. 'mm_create()' manages another region with its own frame budget,
+policy and counters, and returns a handle for it. Regions must not overlap each other; the SIGSEGV handler
+finds the region of a faulting address with a binary search over all of them.
+The arguments are the same as for 'mm_init_with_options()', 'options' may be NULL.
+*/
+typedef struct mm_context mm_context;
+
+mm_context *mm_create(void* vm, size_t vm_size, int n_frames, int page_size, int policy, const mm_options* options);
+
+/*
+'mm_destroy_context()' is 'mm_destroy()' for a region set up by 'mm_create()'.
+No thread may be accessing the region while it is destroyed.
+*/
+void mm_destroy_context(mm_context* ctx);
+
+/*
+The 'mm_context_*' report functions return the counters of one region.
+*/
+unsigned long mm_context_npage_faults(mm_context* ctx);
+unsigned long mm_context_nwrite_backs(mm_context* ctx);
+unsigned long mm_context_nbytes_released(mm_context* ctx);
+unsigned long mm_context_nbytes_restored(mm_context* ctx);
+unsigned long mm_context_nprotection_faults(mm_context* ctx);
+unsigned long mm_context_nprefetches(mm_context* ctx);
+unsigned long mm_context_nfaults_avoided(mm_context* ctx);
+
+/*
+Statistics snapshot filled in by 'mm_get_stats()'. All counters are 64-bit and count from 'mm_init()'.
+'read_faults' and 'write_faults' split the page faults by what the faulting access was known to be (a write fault
+maps the page writable right away), 'write_upgrades' are the protection faults that made a resident page writable.
+'evictions_clean' and 'evictions_dirty' count pages leaving their frame, the dirty ones are the write backs.
+'hand_steps' counts pages passed by a clock hand (clock, clock-pro and the bitmap clock), 'lookup_steps' the entries
+visited while searching ghost lists (2q, arc and clock-pro).
+'fault_latency' and 'protection_latency' are histograms of the time spent handling page faults and protection faults.
+Bucket i counts the faults that took between 2^i and 2^(i+1) - 1 ticks of a cheap cycle counter (the TSC on x86-64,
+the virtual counter on aarch64, nanoseconds elsewhere), the last bucket also holds everything slower.
+'ticks_per_ns' converts ticks to time.
+'reclaimed' counts the evictions done by the background reclaimer, they are included in the evictions.
+The 'compressed_*' counters describe the compressed tier: the pages it holds, how many of them are same-filled,
+their compressed size, the memory the pool uses for them and the page faults it served.
+The compression ratio is compressed_pages * page size / compressed_bytes (same-filled pages take no bytes).
+'page_index_bytes' is the memory taken by the page table, which grows with the parts of the region that are used.
+'advised_prefetches' counts the pages made resident because of MM_ADVICE_WILLNEED and MM_ADVICE_SEQUENTIAL, and
+'advised_faults_avoided' how many of them were used, in the same sense as 'faults_avoided'. 'pinned_pages' is the
+number of resident pages pinned right now, and 'discarded_pages' counts the resident pages MM_ADVICE_DONTNEED dropped,
+which are clean evictions.
+'async_writes' counts the pages written back by the write back threads and 'write_batches' the batches they took,
+'inflight_hits' the page faults served from a write buffer because the page was still being written.
+With 'admission' set, 'admitted_pages' counts the window pages that were estimated hotter than the policy's victim
+and took its place, and 'rejected_pages' the window pages evicted instead.
+For a region from 'mm_shared_open()' the usual counters are those of the calling process: its page faults are the
+pages it made resident, and its protection faults include the 'shared_hits', faults on pages another process had
+made resident. 'revoked_pages' counts the pages it lost its rights to because another process evicted them.
+'shared_page_faults' and 'shared_write_backs' are the page faults and write backs of all processes together.
+With 'dedup_budget' set, 'dedup_pages' is the number of pages whose saved contents are in a shared copy and
+'dedup_copies' the number of copies, 'dedup_bytes_saved' the memory the copies save over a copy per page.
+'dedup_frames_saved' is the number of frames the resident pages sharing copies do without, and
+'dedup_write_backs_saved' counts the evictions that would have written the page and found its contents in a copy.
+With 'dirty_subpages' set, 'subpages_written' counts the pages that write backs of part of an extent wrote, and
+'subpages_skipped' the clean pages they left out. 'huge_page_bytes' is the memory of the region backed by
+transparent huge pages right now, with 'huge_pages' set.
+*/
+#define MM_LATENCY_BUCKETS 40
+
+typedef struct mm_stats mm_stats;
+struct mm_stats {
+    uint64_t page_faults;
+    uint64_t read_faults;
+    uint64_t write_faults;
+    uint64_t protection_faults;
+    uint64_t write_upgrades;
+    uint64_t write_backs;
+    uint64_t evictions_clean;
+    uint64_t evictions_dirty;
+    uint64_t prefetches;
+    uint64_t faults_avoided;
+    uint64_t bytes_released;
+    uint64_t bytes_restored;
+    uint64_t hand_steps;
+    uint64_t lookup_steps;
+    uint64_t reclaimed;
+    uint64_t compressed_pages;
+    uint64_t compressed_same_filled;
+    uint64_t compressed_bytes;
+    uint64_t compressed_pool_bytes;
+    uint64_t compressed_faults;
+    uint64_t page_index_bytes;
+    uint64_t advised_prefetches;
+    uint64_t advised_faults_avoided;
+    uint64_t pinned_pages;
+    uint64_t discarded_pages;
+    uint64_t async_writes;
+    uint64_t write_batches;
+    uint64_t inflight_hits;
+    uint64_t admitted_pages;
+    uint64_t rejected_pages;
+    uint64_t shared_hits;
+    uint64_t revoked_pages;
+    uint64_t shared_page_faults;
+    uint64_t shared_write_backs;
+    uint64_t dedup_pages;
+    uint64_t dedup_copies;
+    uint64_t dedup_bytes_saved;
+    uint64_t dedup_frames_saved;
+    uint64_t dedup_write_backs_saved;
+    uint64_t subpages_written;
+    uint64_t subpages_skipped;
+    uint64_t huge_page_bytes;
+    uint64_t fault_latency[MM_LATENCY_BUCKETS];
+    uint64_t protection_latency[MM_LATENCY_BUCKETS];
+    double ticks_per_ns;
+};
+
+/*
+'mm_get_stats()' fills 'stats' with the statistics of the region given to 'mm_init()', and
+'mm_context_get_stats()' with those of one region. The counters are read one by one while faults
+may still be handled, so a snapshot taken under load can be off by the faults in flight.
+*/
+void mm_get_stats(mm_stats* stats);
+void mm_context_get_stats(mm_context* ctx, mm_stats* stats);
+
+/*
+'mm_set_frames()' changes the number of frames of the region given to 'mm_init()' while it is in use, and
+'mm_context_set_frames()' those of one region. Growing adds free frames that faults fill as they come.
+Shrinking evicts pages chosen by the replacement policy, in batches, until the region fits, and only returns
+then. Modified pages are written back like on any other eviction, and with 'reclaim' the memory of the
+evicted pages is released. Faults may be handled on other threads meanwhile, but calls for the same region
+must not overlap. Returns 0, or -1 if 'n_frames' is less than 1 or the frame descriptors could not be allocated.
+Combined with 'mm_frames_for_fault_ratio()' this sizes a region for a target fault ratio.
+*/
+int mm_set_frames(int n_frames);
+int mm_context_set_frames(mm_context* ctx, int n_frames);
+
+/*
+Application hints for 'mm_advise()'.
+MM_ADVICE_SEQUENTIAL: the range is used in ascending order. A fault in it prefetches the following pages of the
+range at once, up to 64 and at most half of the frames, even if 'readahead' is off.
+MM_ADVICE_RANDOM: the range is used in no particular order, faults in it never prefetch.
+MM_ADVICE_NORMAL undoes both.
+MM_ADVICE_WILLNEED: makes the pages of the range resident now, in batches, as many as there are unpinned frames.
+MM_ADVICE_DONTNEED: the contents of the range are not needed any more. Its resident pages leave their frames
+right away without a write back, and the range reads back as zeros. Pages never accessed since 'mm_init()' are
+left alone.
+MM_ADVICE_PIN: the range is hot. Its pages stay resident once they fault in (or right away if they are resident),
+the replacement policy never picks them as victims. At most half of the frames can hold pinned pages, pages over
+that limit are managed normally, and the oldest pins are undone if 'mm_set_frames()' lowers the limit.
+MM_ADVICE_UNPIN hands the pages of the range back to the policy.
+*/
+#define MM_ADVICE_NORMAL 0
+#define MM_ADVICE_SEQUENTIAL 1
+#define MM_ADVICE_RANDOM 2
+#define MM_ADVICE_WILLNEED 3
+#define MM_ADVICE_DONTNEED 4
+#define MM_ADVICE_PIN 5
+#define MM_ADVICE_UNPIN 6
+
+/*
+'mm_advise()' gives the hint 'advice' for the pages that overlap [addr, addr + len) in the region given to 'mm_init()',
+and 'mm_context_advise()' for one region. Returns 0, or -1 if the range is empty or not inside the region or the
+hint is unknown. How well the hints worked shows in the 'advised_*' counters of 'mm_stats'.
+Shared regions take no hints, 'mm_context_advise()' returns -1 for them.
+*/
+int mm_advise(void* addr, size_t len, int advice);
+int mm_context_advise(mm_context* ctx, void* addr, size_t len, int advice);
+
+/*
+Shared regions.
+'mm_shared_open()' creates a region that several processes map at once, with one frame budget for all of them.
+The region lives in a POSIX shared memory object called 'name' (see shm_open), which is created with room for
+'vm_size' bytes of zeros if it does not exist. If it exists it is opened instead: 'vm_size' and 'page_size' must
+be those it was created with, and its 'n_frames' stays. With 'name' NULL the region is an unnamed memfd, which
+only processes forked afterwards share. The pages are mapped at an address the system picks, returned in '*vm'.
+The frame table and the clock that replaces pages are in the object as well, so a page one process faults in is
+resident for all of them: the others still fault the first time they touch it, but only to get their rights on
+it, which takes no frame. A page evicted by one process stays accessible to the others until their next fault,
+they see the eviction then. The data is never copied, so evicting a page does not release its memory.
+The calling process gets a handle for the region, which 'mm_destroy_context()' closes and unmaps. A forked child
+can go on using its parent's handle, its counters start from those of the parent. 'mm_context_set_frames()'
+changes the budget of all processes. A process must not be killed while it handles a fault in the region, the
+other processes would wait for it forever.
+Returns NULL if the region could not be created or opened, or the sizes do not fit.
+'mm_shared_unlink()' removes the name, the object goes away once every process closed it. Returns 0 or -1.
+*/
+mm_context *mm_shared_open(const char* name, size_t vm_size, int n_frames, int page_size, void** vm);
+int mm_shared_unlink(const char* name);
+
+/*
+Miss ratio curve, estimated online when 'mrc_samples' is set.
+Every page fault and protection fault counts as a reference to its page. A hash of the page number picks the pages
+that are sampled, and the reuse distance of their references (the number of distinct pages used in between) predicts
+how many of the references would fault with any number of frames under lru. The sampling rate starts at 1 and halves
+whenever more than 'mrc_samples' pages would be tracked, so a few thousand samples are enough for large regions.
+Reads of resident pages do not fault, so the curve only sees the references that fault with the current frames. It
+predicts how many of the current faults more frames would remove; values below the current 'n_frames' are unreliable,
+since the references that hit with the current frames were never counted.
+'mm_predict_fault_ratio()' returns the predicted fraction of references that fault with 'n_frames' frames,
+or -1 if the curve is not estimated.
+'mm_frames_for_fault_ratio()' returns the smallest number of frames (at most the number of pages of the region)
+predicted to keep the fault ratio at or below 'target', or -1 if there is none or the curve is not estimated.
+*/
+double mm_predict_fault_ratio(int n_frames);
+int mm_frames_for_fault_ratio(double target);
+double mm_context_predict_fault_ratio(mm_context* ctx, int n_frames);
+int mm_context_frames_for_fault_ratio(mm_context* ctx, double target);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
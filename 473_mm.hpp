@@ -0,0 +1,188 @@
+#ifndef _473_MM_HPP
+#define _473_MM_HPP
+
+#include "473_mm.h"
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+/*
+Header only C++ front end.
+'mm::ManagedRegion<Policy, PageShift>' owns a region of 'n_pages' pages of 2^PageShift bytes: the constructor maps
+it (anonymous, MAP_NORESERVE) and calls 'mm_create()', the destructor calls 'mm_destroy_context()' and unmaps it.
+'Policy' is one of the tags below, so the policy and the page size are fixed when the program is compiled and
+page numbers and addresses are computed with shifts. The fault handler is the one the C API uses; it picks the
+policy's operations once when the region is created and does not divide by the page size when it is a power of
+two, which it always is here.
+The constructor throws std::invalid_argument if the sizes do not fit (fewer than 1 frame, more than 2^31 - 1 pages,
+or pages smaller than the system's) and std::system_error if the region cannot be mapped. Other failures end the
+program like they do in 'mm_create()'. Regions can be moved but not copied.
+'stats()' takes a snapshot with 'mm_context_get_stats()' and returns it as an 'mm::Stats'.
+The C entry points work alongside, 'context()' is the handle to pass to them.
+*/
+namespace mm {
+
+struct Fifo { static constexpr int id = MM_POLICY_FIFO; };
+struct Clock { static constexpr int id = MM_POLICY_CLOCK; };
+struct Lru { static constexpr int id = MM_POLICY_LRU; };
+struct TwoQ { static constexpr int id = MM_POLICY_2Q; };
+struct Arc { static constexpr int id = MM_POLICY_ARC; };
+struct ClockPro { static constexpr int id = MM_POLICY_CLOCK_PRO; };
+struct ClockBitmap { static constexpr int id = MM_POLICY_CLOCK_BITMAP; };
+
+/*
+Statistics snapshot, the fields of 'mm_stats' (see 473_mm.h) with their units.
+'faults()' is page faults plus protection faults, 'evictions()' clean plus dirty ones.
+'fault_latency(q)' and 'protection_latency(q)' are the q-quantile of the latency histograms, the upper bound of
+the bucket it falls in, like mm_bench reports them.
+*/
+class Stats {
+public:
+    explicit Stats(const mm_stats& raw) : raw_(raw) {}
+
+    const mm_stats& raw() const { return raw_; }
+
+    uint64_t page_faults() const { return raw_.page_faults; }
+    uint64_t read_faults() const { return raw_.read_faults; }
+    uint64_t write_faults() const { return raw_.write_faults; }
+    uint64_t protection_faults() const { return raw_.protection_faults; }
+    uint64_t faults() const { return raw_.page_faults + raw_.protection_faults; }
+    uint64_t write_upgrades() const { return raw_.write_upgrades; }
+    uint64_t write_backs() const { return raw_.write_backs; }
+    uint64_t evictions() const { return raw_.evictions_clean + raw_.evictions_dirty; }
+    uint64_t prefetches() const { return raw_.prefetches; }
+    uint64_t faults_avoided() const { return raw_.faults_avoided; }
+    uint64_t bytes_released() const { return raw_.bytes_released; }
+    uint64_t bytes_restored() const { return raw_.bytes_restored; }
+    uint64_t hand_steps() const { return raw_.hand_steps; }
+    uint64_t lookup_steps() const { return raw_.lookup_steps; }
+    uint64_t page_index_bytes() const { return raw_.page_index_bytes; }
+    uint64_t pinned_pages() const { return raw_.pinned_pages; }
+
+    std::chrono::nanoseconds fault_latency(double q) const { return quantile(raw_.fault_latency, q); }
+    std::chrono::nanoseconds protection_latency(double q) const { return quantile(raw_.protection_latency, q); }
+
+private:
+    std::chrono::nanoseconds quantile(const uint64_t* histogram, double q) const {
+        uint64_t total = 0;
+        int i;
+        for (i = 0; i < MM_LATENCY_BUCKETS; i++) {
+            total += histogram[i];
+        }
+        if (total == 0 || raw_.ticks_per_ns <= 0) {
+            return std::chrono::nanoseconds(0);
+        }
+        uint64_t seen = 0;
+        for (i = 0; i < MM_LATENCY_BUCKETS - 1; i++) {
+            seen += histogram[i];
+            if (seen >= q * total) {
+                break;
+            }
+        }
+        return std::chrono::nanoseconds((long long)((2ull << i) / raw_.ticks_per_ns));
+    }
+
+    mm_stats raw_;
+};
+
+template <class Policy, int PageShift = 12>
+class ManagedRegion {
+    static_assert(PageShift >= 12 && PageShift <= 30, "pages must be 4 KiB to 1 GiB");
+
+public:
+    static constexpr int policy = Policy::id;
+    static constexpr int page_shift = PageShift;
+    static constexpr size_t page_size = (size_t)1 << PageShift;
+
+    ManagedRegion(size_t n_pages, int n_frames, const mm_options& options = mm_options()) : n_pages_(n_pages) {
+        if (n_frames < 1 || n_pages < 1 || n_pages > INT_MAX) {
+            throw std::invalid_argument("ManagedRegion: bad page or frame count");
+        }
+        if ((size_t)sysconf(_SC_PAGE_SIZE) > page_size) {
+            throw std::invalid_argument("ManagedRegion: pages smaller than the system's");
+        }
+        void* vm = mmap(NULL, size(), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (vm == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "ManagedRegion: mmap");
+        }
+        start_ = static_cast<char*>(vm);
+        ctx_ = mm_create(vm, size(), n_frames, (int)page_size, policy, &options);
+    }
+
+    ~ManagedRegion() { release(); }
+
+    ManagedRegion(const ManagedRegion&) = delete;
+    ManagedRegion& operator=(const ManagedRegion&) = delete;
+
+    ManagedRegion(ManagedRegion&& other) noexcept
+        : ctx_(std::exchange(other.ctx_, nullptr)), start_(std::exchange(other.start_, nullptr)),
+          n_pages_(std::exchange(other.n_pages_, 0)) {}
+
+    ManagedRegion& operator=(ManagedRegion&& other) noexcept {
+        if (this != &other) {
+            release();
+            ctx_ = std::exchange(other.ctx_, nullptr);
+            start_ = std::exchange(other.start_, nullptr);
+            n_pages_ = std::exchange(other.n_pages_, 0);
+        }
+        return *this;
+    }
+
+    mm_context* context() const { return ctx_; }
+    void* data() const { return start_; }
+    size_t pages() const { return n_pages_; }
+    size_t size() const { return n_pages_ << PageShift; }
+
+    // Start of page 'number', as a T*
+    template <class T = char>
+    T* page(size_t number) const {
+        return reinterpret_cast<T*>(start_ + (number << PageShift));
+    }
+
+    // Page number of an address inside the region
+    size_t page_number(const void* address) const {
+        return (size_t)(static_cast<const char*>(address) - start_) >> PageShift;
+    }
+
+    bool contains(const void* address) const {
+        const char* a = static_cast<const char*>(address);
+        return a >= start_ && a < start_ + size();
+    }
+
+    Stats stats() const {
+        mm_stats raw;
+        mm_context_get_stats(ctx_, &raw);
+        return Stats(raw);
+    }
+
+    // 'mm_context_set_frames()' and 'mm_context_advise()', false where they return -1
+    bool set_frames(int n_frames) { return mm_context_set_frames(ctx_, n_frames) == 0; }
+    bool advise(void* address, size_t len, int advice) { return mm_context_advise(ctx_, address, len, advice) == 0; }
+    bool advise_pages(size_t first, size_t count, int advice) {
+        return advise(page(first), count << PageShift, advice);
+    }
+
+private:
+    void release() {
+        if (ctx_ != nullptr) {
+            mm_destroy_context(ctx_);
+            munmap(start_, size());
+            ctx_ = nullptr;
+            start_ = nullptr;
+        }
+    }
+
+    mm_context* ctx_ = nullptr;
+    char* start_ = nullptr;
+    size_t n_pages_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include "473_mm_internal.h"
+
+// Admission filter
+//
+// Wraps the replacement policy of a context, whatever it is, to make it scan resistant. Every new page
+// first goes to a small FIFO window in front of the policy. When a page has to be evicted with the window
+// full, the oldest window page and the victim the policy picks compete: the window page only moves on to
+// the policy's lists if a count-min sketch estimates it hotter than the victim, otherwise it is evicted
+// instead and the policy's pages stay. A scan faults every page once, so its pages pass through the window
+// and leave again without pushing the hot pages out (TinyLFU, after Einziger, Friedman and Manes).
+//
+// The sketch has SKETCH_ROWS rows of 4 bit counters, 16 to a word, with at least as many counters per row
+// as there are frames. The counters of a page in all rows share one 64 byte block, two words per row, so
+// counting or estimating a page costs at most one cache miss. Reads of resident pages never fault, so the
+// sketch counts what the policies see: write hits, and faults on pages that were evicted a short while
+// ago. The first fault of a page does not count, so a scan leaves nothing in the sketch. Once there have
+// been SKETCH_SAMPLE increments per counter all counters are halved, which ages out pages that used to be
+// hot.
+//
+// Recently evicted pages are remembered the way a ghost list of the last 'n_frames' evictions would, but
+// without a list: every eviction is numbered, the page index entry of the victim keeps the number, and a
+// page is remembered while fewer than 'n_frames' evictions happened since. The fault path has the entry
+// at hand anyway, so this costs no lookups, and page_entry had the room. Unlike a ghost list, the eviction
+// pick_victim causes cannot push the incoming page out of the history, on_fault can look it up.
+//
+// The policy is told about a page only while it is on its lists. A window page that wins its comparison
+// joins them in on_evict, after the victim has left, so the policy never holds more pages than it has
+// frames. pick_victim may run without its victim being evicted (the page was busy), then nothing moves.
+
+#define SKETCH_ROWS 4
+#define SKETCH_MIN_WIDTH 64
+#define SKETCH_SAMPLE 10
+#define WINDOW_PERCENT 1
+
+typedef struct admission_state admission_state;
+struct admission_state {
+    mm_context *ctx;
+    mm_policy *inner;
+    void *inner_state;
+
+    virtual_page_queue window;  // probationary pages, oldest at the head
+    int window_target;
+    int main_size;              // pages on the policy's lists
+    int main_capacity;
+
+    uint64_t *sketch;
+    int width;                  // counters per row, a power of two
+    long increments;            // since the counters were last halved
+
+    uint32_t evictions;         // numbers the evictions for 'page_entry.evicted'
+    int ghost_capacity;
+    virtual_page *victim;       // last pick_victim result, and the window page that takes its place
+    virtual_page *admit;
+    virtual_page *faulted;      // page of the last on_fault, its write fault is not a hit
+
+    unsigned long admitted;
+    unsigned long rejected;
+};
+
+// 1% of the frames, at least one, and at least one frame is left to the policy (no window with 1 frame)
+static int window_target(int n_frames) {
+    int target = n_frames * WINDOW_PERCENT / 100;
+    if (target < 1) {
+        target = 1;
+    }
+    return target < n_frames ? target : 0;
+}
+
+static void sketch_alloc(admission_state* s, int n_frames) {
+    int width = SKETCH_MIN_WIDTH;
+    while (width < n_frames) {
+        width *= 2;
+    }
+    if (s->sketch != NULL && width == s->width) {
+        return;
+    }
+    uint64_t *sketch = calloc((size_t)SKETCH_ROWS * width / 16, sizeof(uint64_t));
+    if (sketch == NULL) {
+        printf("admission sketch allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    free(s->sketch);
+    s->sketch = sketch;
+    s->width = width;
+    s->increments = 0;
+}
+
+static uint64_t sketch_hash(int number) {
+    uint64_t h = (uint64_t)(unsigned int)number * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    return h ^ (h >> 32);
+}
+
+// Counter of the page with hash 'h' in row 'row': the low bits of the hash pick the block, the high bits
+// one of the row's two words and the counter in it
+static inline uint64_t *sketch_counter(admission_state* s, uint64_t h, int row, int *shift) {
+    uint64_t *block = &s->sketch[(h & (s->width / 32 - 1)) * 8];
+    *shift = ((h >> (40 + 4 * row)) & 15) * 4;
+    return &block[row * 2 + ((h >> (32 + row)) & 1)];
+}
+
+// The smallest counter of 'number', which most pages have at 0 and can stop at
+static int sketch_estimate(admission_state* s, int number) {
+    uint64_t h = sketch_hash(number);
+    int estimate = 15;
+    int row, shift;
+    for (row = 0; row < SKETCH_ROWS && estimate > 0; row++) {
+        int count = (*sketch_counter(s, h, row, &shift) >> shift) & 15;
+        if (count < estimate) {
+            estimate = count;
+        }
+    }
+    return estimate;
+}
+
+static void sketch_increment(admission_state* s, int number) {
+    uint64_t h = sketch_hash(number);
+    int row, shift;
+    for (row = 0; row < SKETCH_ROWS; row++) {
+        uint64_t *word = sketch_counter(s, h, row, &shift);
+        if (((*word >> shift) & 15) != 15) {
+            *word += 1ull << shift;
+        }
+    }
+
+    if (++s->increments >= (long)SKETCH_SAMPLE * s->width) {
+        size_t i;
+        for (i = 0; i < (size_t)SKETCH_ROWS * s->width / 16; i++) {
+            s->sketch[i] = (s->sketch[i] >> 1) & 0x7777777777777777ull;
+        }
+        s->increments /= 2;
+    }
+}
+
+// Forgets an evicted page, returns 1 if it was remembered
+static int ghost_take(admission_state* s, int number) {
+    page_entry *entry = number >= 0 ? page_entry_find(s->ctx, number) : NULL;
+    if (entry == NULL || entry->evicted == 0) {
+        return 0;
+    }
+    int remembered = s->evictions - entry->evicted < (uint32_t)s->ghost_capacity;
+    entry->evicted = 0;
+    return remembered;
+}
+
+// Moves a window page onto the policy's lists
+static void window_promote(admission_state* s, virtual_page* page) {
+    queue_remove(&s->window, page);
+    page->windowed = 0;
+    s->inner->on_fault(s->inner_state, page);
+    s->main_size++;
+}
+
+// Wraps 'inner', which has not been initialized yet, for a context with 'n_frames' frames
+void *admission_init(mm_context* ctx, mm_policy* inner, int n_frames) {
+    admission_state *s = calloc(1, sizeof(admission_state));
+    if (s == NULL) {
+        printf("admission allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    s->ctx = ctx;
+    s->inner = inner;
+    s->window_target = window_target(n_frames);
+    s->main_capacity = n_frames - s->window_target;
+
+    // Policies like clock fill their frames with blank pages right away
+    int resident = ctx->resident_pages;
+    s->inner_state = inner->init(ctx, s->main_capacity);
+    s->main_size = ctx->resident_pages - resident;
+
+    sketch_alloc(s, n_frames);
+    s->ghost_capacity = n_frames;
+    return s;
+}
+
+static void admission_destroy(void* state) {
+    admission_state *s = state;
+    s->inner->destroy(s->inner_state);
+    free(s->sketch);
+    free(s);
+}
+
+static void admission_resize(void* state, int n_frames) {
+    admission_state *s = state;
+    s->window_target = window_target(n_frames);
+    s->main_capacity = n_frames - s->window_target;
+    s->inner->resize(s->inner_state, s->main_capacity);
+    sketch_alloc(s, n_frames);
+    s->ghost_capacity = n_frames;
+}
+
+static void admission_on_fault(void* state, virtual_page* page) {
+    admission_state *s = state;
+    if (ghost_take(s, page->number)) {
+        sketch_increment(s, page->number);
+    }
+
+    page->windowed = 1;
+    enqueue(&s->window, page);
+    s->faulted = page;
+
+    // While the frames are not full there is nothing to compete with
+    while (s->window.size > s->window_target && s->main_size < s->main_capacity) {
+        window_promote(s, s->window.head);
+    }
+}
+
+static void admission_on_write(void* state, virtual_page* page) {
+    admission_state *s = state;
+    if (page != s->faulted) {
+        sketch_increment(s, page->number);
+    }
+    s->faulted = NULL;
+    if (!page->windowed) {
+        s->inner->on_write(s->inner_state, page);
+    }
+}
+
+static virtual_page* admission_pick_victim(void* state, int incoming) {
+    admission_state *s = state;
+    s->admit = NULL;
+
+    virtual_page *candidate = s->window.head;
+    if (s->main_size == 0) {
+        s->victim = candidate;
+    } else if (candidate == NULL || s->window.size < s->window_target) {
+        // The window is short of its target, the incoming page makes up for the policy's victim
+        s->victim = s->inner->pick_victim(s->inner_state, -1);
+    } else {
+        // Blank pages always lose, a window page that was never counted loses to every other page
+        s->victim = s->inner->pick_victim(s->inner_state, -1);
+        int estimate = sketch_estimate(s, candidate->number);
+        if (s->victim->number < 0 || (estimate > 0 && estimate > sketch_estimate(s, s->victim->number))) {
+            s->admit = candidate;
+        } else {
+            s->victim = candidate;
+        }
+    }
+    return s->victim;
+}
+
+static void admission_on_evict(void* state, virtual_page* page) {
+    admission_state *s = state;
+    if (page->windowed) {
+        queue_remove(&s->window, page);
+        page->windowed = 0;
+        s->rejected++;
+    } else {
+        s->inner->on_evict(s->inner_state, page);
+        s->main_size--;
+    }
+    page_entry *entry = page->number >= 0 ? page_entry_find(s->ctx, page->number) : NULL;
+    if (entry != NULL) {
+        // 0 means never evicted
+        if (++s->evictions == 0) {
+            s->evictions = 1;
+        }
+        entry->evicted = s->evictions;
+    }
+
+    if (page == s->victim && s->admit != NULL) {
+        window_promote(s, s->admit);
+        s->admitted++;
+    }
+    s->victim = NULL;
+    s->admit = NULL;
+}
+
+static void admission_on_remove(void* state, virtual_page* page) {
+    admission_state *s = state;
+    if (page->windowed) {
+        queue_remove(&s->window, page);
+        page->windowed = 0;
+    } else {
+        s->inner->on_remove(s->inner_state, page);
+        s->main_size--;
+    }
+    if (page == s->admit || page == s->victim) {
+        s->victim = NULL;
+        s->admit = NULL;
+    }
+    s->faulted = NULL;
+}
+
+static void admission_report(void* state, mm_stats* stats) {
+    admission_state *s = state;
+    s->inner->report(s->inner_state, stats);
+    stats->admitted_pages += s->admitted;
+    stats->rejected_pages += s->rejected;
+}
+
+// Never initialized through 'init', mm_create calls admission_init with the policy to wrap
+mm_policy ADMISSION_POLICY = {"admission", NULL, admission_destroy, admission_on_fault, admission_on_write, admission_pick_victim, admission_on_evict, admission_report, admission_resize, admission_on_remove};
@@ -0,0 +1,269 @@
+#include "473_mm_internal.h"
+
+// Application hints
+//
+// mm_advise records MM_ADVICE_SEQUENTIAL, MM_ADVICE_RANDOM and MM_ADVICE_PIN as flags in the index entries of
+// the pages of the range, under each page's lock, and the fault path and readahead act on them when the pages
+// fault. MM_ADVICE_WILLNEED and MM_ADVICE_DONTNEED act on the range right away.
+//
+// A pinned page is taken off the policy's lists with on_remove and kept on ctx->pinned, so pick_victim never
+// sees it and no policy needs to know about pins. At most half of the frames can be pinned, the rest are
+// left for the policy to choose victims from. Unpinning hands the page back to the policy as if it had just
+// become resident.
+//
+// WILLNEED locks up to ADVISE_BATCH pages that are not resident, makes them resident under one hold of
+// ctx->policy_lock and maps them together, so a range costs one batch of work per ADVISE_BATCH pages instead
+// of a fault per page. It prefetches at most as many pages as there are unpinned frames.
+//
+// DONTNEED takes resident pages out of their frames without a write back and throws away every saved copy,
+// so the range reads back as zeros like after madvise(MADV_DONTNEED) on private memory. Only pages that were
+// accessed since mm_init have anything to throw away.
+
+#define ADVISE_BATCH READAHEAD_MAX_WINDOW
+
+int mm_advise(void* addr, size_t len, int advice) {
+    return DEFAULT_CONTEXT == NULL ? -1 : mm_context_advise(DEFAULT_CONTEXT, addr, len, advice);
+}
+
+// Takes a resident page away from the policy. Returns 0 if too many pages are pinned already.
+// Called with ctx->policy_lock held.
+int page_pin(mm_context* ctx, virtual_page* page) {
+    if (page->pinned) {
+        return 1;
+    }
+    if (ctx->pinned.size >= ctx->n_frames / 2) {
+        return 0;
+    }
+    ctx->policy_ops->on_remove(ctx->policy_state, page);
+    enqueue(&ctx->pinned, page);
+    page->pinned = 1;
+    return 1;
+}
+
+static void page_unpin(mm_context* ctx, virtual_page* page) {
+    queue_remove(&ctx->pinned, page);
+    page->pinned = 0;
+    ctx->policy_ops->on_fault(ctx->policy_state, page);
+}
+
+// Unpins the oldest pins until at most half of the frames are pinned, after the budget shrank.
+// Called with ctx->policy_lock held.
+void pin_limit(mm_context* ctx) {
+    while (ctx->pinned.size > ctx->n_frames / 2) {
+        page_unpin(ctx, ctx->pinned.head);
+    }
+}
+
+// Sets or clears advice flags on the pages [first, end). Setting a flag creates the index entries
+// of the range, clearing one only visits the entries there are.
+static void advise_flags(mm_context* ctx, int first, int end, int set, int clear) {
+    int i = 0;
+    for (i = set ? first : radix_next(&ctx->page_index, first, end); i >= 0 && i < end;
+            i = set ? i + 1 : radix_next(&ctx->page_index, i + 1, end)) {
+        page_entry *entry = page_entry_get(ctx, i);
+        spin_lock(&entry->lock);
+        entry->advice = (entry->advice & ~clear) | set;
+
+        virtual_page *page = entry->page;
+        if (page != NULL && (set & ADVICE_PIN)) {
+            spin_lock(&ctx->policy_lock);
+            page_pin(ctx, page);
+            spin_unlock(&ctx->policy_lock);
+        } else if (page != NULL && (clear & ADVICE_PIN) && page->pinned) {
+            spin_lock(&ctx->policy_lock);
+            page_unpin(ctx, page);
+            spin_unlock(&ctx->policy_lock);
+        }
+        spin_unlock(&entry->lock);
+    }
+}
+
+// Makes the locked pages of 'entries' resident, up to 'limit' of them. Pages that could not be made
+// resident are unlocked. Returns how many were.
+static int willneed_batch(mm_context* ctx, page_entry** entries, int* numbers, int n, int* limit) {
+    virtual_page *pages[ADVISE_BATCH];
+    evicted_page victims[ADVISE_BATCH];
+    int n_victims = 0;
+    int mapped = 0;
+    int i = 0;
+
+    // The batch takes all of its frames before its pages join the policy, so none of them is a victim
+    spin_lock(&ctx->policy_lock);
+    while (mapped < n && *limit > 0) {
+        int number = numbers[mapped];
+        if (ctx->resident_pages >= ctx->n_frames) {
+            // Nothing on the policy's lists to evict, the other resident pages are pinned
+            if (ctx->resident_pages - ctx->pinned.size - mapped <= 0) {
+                break;
+            }
+            virtual_page *victim_page = ctx->policy_ops->pick_victim(ctx->policy_state, number);
+            // Stop at a busy victim, another thread is faulting on it
+            if (victim_page->number >= 0 && !spin_trylock(&page_entry_get(ctx, victim_page->number)->lock)) {
+                break;
+            }
+            detach_page(ctx, victim_page, &victims[n_victims++]);
+        }
+
+        void* page_start_addr = (char*)ctx->vm_start + (size_t)number * ctx->page_size;
+        virtual_page *page = init_page(ctx, number, page_start_addr, 0, 0);
+        page->prefetched = PREFETCH_ADVISED;
+        entries[mapped]->page = page;
+        ctx->resident_pages++;
+        pages[mapped++] = page;
+        (*limit)--;
+    }
+    for (i = 0; i < mapped; i++) {
+        ctx->policy_ops->on_fault(ctx->policy_state, pages[i]);
+        if (entries[i]->advice & ADVICE_PIN) {
+            page_pin(ctx, pages[i]);
+        }
+    }
+    spin_unlock(&ctx->policy_lock);
+
+    for (i = mapped; i < n; i++) {
+        spin_unlock(&entries[i]->lock);
+    }
+    release_batch(ctx, victims, n_victims);
+
+    for (i = 0; i < mapped; i++) {
+        if (ctx->swap != NULL && ctx->backend == MM_BACKEND_SIGSEGV) {
+            swap_in(ctx, pages[i]);
+        }
+    }
+
+    // Runs of adjacent pages are made readable together
+    i = 0;
+    while (i < mapped) {
+        int j = i + 1;
+        if (ctx->backend == MM_BACKEND_SIGSEGV) {
+            while (j < mapped && pages[j]->number == pages[j - 1]->number + 1) {
+                j++;
+            }
+            protect_range(ctx, pages[i]->start, (size_t)(j - i) * ctx->page_size, PROT_READ);
+        } else {
+            page_protect(ctx, pages[i], PROT_READ);
+        }
+        for (; i < j; i++) {
+            spin_unlock(&entries[i]->lock);
+        }
+    }
+
+    atomic_fetch_add_explicit(&ctx->advised_prefetches, mapped, memory_order_relaxed);
+    return mapped;
+}
+
+static void advise_willneed(mm_context* ctx, int first, int end) {
+    page_entry *entries[ADVISE_BATCH];
+    int numbers[ADVISE_BATCH];
+
+    spin_lock(&ctx->policy_lock);
+    int limit = ctx->n_frames - ctx->pinned.size;
+    spin_unlock(&ctx->policy_lock);
+
+    int number = first;
+    while (number < end && limit > 0) {
+        int n = 0;
+        while (n < ADVISE_BATCH && n < limit && number < end) {
+            page_entry *entry = page_entry_get(ctx, number);
+            spin_lock(&entry->lock);
+            if (entry->page != NULL) {
+                spin_unlock(&entry->lock);
+            } else {
+                entries[n] = entry;
+                numbers[n++] = number;
+            }
+            number++;
+        }
+        if (n > 0 && willneed_batch(ctx, entries, numbers, n, &limit) < n) {
+            break;
+        }
+    }
+}
+
+// Drops page 'number' and what is saved of it. Called with the page's lock held.
+static void discard_page(mm_context* ctx, page_entry* entry, int number) {
+    void* start = (char*)ctx->vm_start + (size_t)number * ctx->page_size;
+    virtual_page *page = entry->page;
+
+    if (page != NULL) {
+        evicted_page out;
+        spin_lock(&ctx->policy_lock);
+        if (page->pinned) {
+            queue_remove(&ctx->pinned, page);
+        } else {
+            ctx->policy_ops->on_remove(ctx->policy_state, page);
+        }
+        free_frame(ctx, page, &out);
+        spin_unlock(&ctx->policy_lock);
+
+        // The contents are thrown away, so there is nothing to write back
+        out.modified = 0;
+        account_evicted(ctx, &out);
+        atomic_fetch_add_explicit(&ctx->discarded, 1, memory_order_relaxed);
+        if (ctx->swap != NULL) {
+            atomic_fetch_add_explicit(&ctx->bytes_released, ctx->page_size, memory_order_relaxed);
+        }
+    }
+
+    if (ctx->backend == MM_BACKEND_USERFAULTFD) {
+        uffd_discard(ctx, start);
+        return;
+    }
+    if (page != NULL) {
+        protect_range(ctx, start, ctx->page_size, PROT_NONE);
+    }
+    madvise(start, ctx->page_size, MADV_DONTNEED);
+    if (ctx->swap != NULL) {
+        swap_discard(ctx, number);
+    }
+}
+
+static void advise_dontneed(mm_context* ctx, int first, int end) {
+    int i = 0;
+    for (i = radix_next(&ctx->page_index, first, end); i >= 0; i = radix_next(&ctx->page_index, i + 1, end)) {
+        page_entry *entry = page_entry_get(ctx, i);
+        spin_lock(&entry->lock);
+        discard_page(ctx, entry, i);
+        spin_unlock(&entry->lock);
+    }
+}
+
+int mm_context_advise(mm_context* ctx, void* addr, size_t len, int advice) {
+    char *start = ctx->vm_start;
+    if (ctx->shared != NULL || len == 0 || (char*)addr < start) {
+        return -1;
+    }
+    size_t offset = (size_t)((char*)addr - start);
+    if (offset >= ctx->vm_size || len > ctx->vm_size - offset) {
+        return -1;
+    }
+    int first = translate_to_page_number(ctx, addr);
+    int end = translate_to_page_number(ctx, (char*)addr + len - 1) + 1;
+
+    switch (advice) {
+        case MM_ADVICE_NORMAL:
+            advise_flags(ctx, first, end, 0, ADVICE_SEQUENTIAL | ADVICE_RANDOM);
+            break;
+        case MM_ADVICE_SEQUENTIAL:
+            advise_flags(ctx, first, end, ADVICE_SEQUENTIAL, ADVICE_RANDOM);
+            break;
+        case MM_ADVICE_RANDOM:
+            advise_flags(ctx, first, end, ADVICE_RANDOM, ADVICE_SEQUENTIAL);
+            break;
+        case MM_ADVICE_WILLNEED:
+            advise_willneed(ctx, first, end);
+            break;
+        case MM_ADVICE_DONTNEED:
+            advise_dontneed(ctx, first, end);
+            break;
+        case MM_ADVICE_PIN:
+            advise_flags(ctx, first, end, ADVICE_PIN, 0);
+            break;
+        case MM_ADVICE_UNPIN:
+            advise_flags(ctx, first, end, 0, ADVICE_PIN);
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,433 @@
+#define _GNU_SOURCE
+#include "473_mm_internal.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// Content deduplication for regions with 'reclaim' and 'dedup_budget' set
+//
+// Pages with the same contents share one copy, kept in a memfd of at most 'dedup_budget' bytes. When an
+// evicted page has to be saved, its contents are hashed and looked up in 'table': if a copy with the same
+// contents exists the page only takes a reference to it, nothing is written. Otherwise the page is
+// remembered as the candidate of its hash, and the next page with that hash is compared with what the
+// candidate saved (or with the candidate's memory if it is resident). If they match, the contents become a
+// copy that both pages reference. A page's reference is kept in 'refs', and SWAP_DEDUP in its swap state
+// says that the copy holds its saved contents.
+//
+// A page that faults in from a copy is not copied: the copy is mapped over it MAP_PRIVATE, so all the
+// resident pages with those contents use the same frame of memory (SWAP_MAPPED, SWAP_SHARING). Writing
+// breaks the sharing through the normal write fault: the page is made writable and the kernel gives it
+// its own frame at the first write. An evicted or discarded page gets anonymous memory back. The idle scan
+// of the background reclaimer shares resident pages the same way, through the same table.
+//
+// A copy goes away with its last reference, so no mapping ever sees a copy change. 'lock' covers the
+// table, the slots and the counters, and is never held while a page is locked or a page is read back.
+
+#define DEDUP_TABLE_MIN 4096
+#define DEDUP_SCAN_BATCH 64
+
+typedef struct dedup_slot dedup_slot;
+struct dedup_slot {
+    uint64_t hash;
+    int refs;               // 0 if free
+    int sharing;            // resident pages mapping the copy that were not written since
+    int next_free;
+};
+
+typedef struct dedup_bucket dedup_bucket;
+struct dedup_bucket {
+    uint64_t hash;
+    int slot;               // copy with these contents, or -1
+    int page;               // candidate page if there is no copy, or -1
+};
+
+struct dedup_store {
+    int fd;
+    char *map;
+    int n_slots;
+    dedup_slot *slots;
+    int free_slot;
+    dedup_bucket *table;
+    int table_mask;
+    radix refs;             // slot + 1 of every page that references a copy, 0 if none
+    mm_lock lock;
+    int scan;               // the reclaimer shares idle resident pages
+    int cursor;             // next page of the idle scan
+
+    long used;              // slots holding a copy
+    long pages;             // references to copies
+    long sharing;           // resident pages sharing a copy's frame
+    long shared_copies;     // copies with at least one of them
+    atomic_ulong saves;     // evictions that found their contents in a copy
+};
+
+static uint64_t page_hash(const void* data, int size) {
+    const uint64_t *words = data;
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    int i = 0;
+    for (i = 0; i < size / 8; i++) {
+        h = (h ^ words[i]) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static char *slot_data(dedup_store* d, int slot, int page_size) {
+    return d->map + (size_t)slot * page_size;
+}
+
+int dedup_init(mm_context* ctx, size_t budget, int scan) {
+    dedup_store *d = calloc(1, sizeof(dedup_store));
+    if (d == NULL) {
+        return -1;
+    }
+    d->n_slots = budget / ctx->page_size > 0 ? budget / ctx->page_size : 1;
+    int table_size = DEDUP_TABLE_MIN;
+    while (table_size < 4L * d->n_slots && table_size < (1 << 30)) {
+        table_size *= 2;
+    }
+    d->table_mask = table_size - 1;
+    d->fd = memfd_create("mm_dedup", MFD_CLOEXEC);
+    d->slots = malloc(d->n_slots * sizeof(dedup_slot));
+    d->table = malloc(table_size * sizeof(dedup_bucket));
+    if (d->fd == -1 || d->slots == NULL || d->table == NULL
+            || ftruncate(d->fd, (off_t)d->n_slots * ctx->page_size) == -1
+            || radix_init(&d->refs, ctx->n_pages, sizeof(int)) == -1) {
+        return -1;
+    }
+    d->map = mmap(NULL, (size_t)d->n_slots * ctx->page_size, PROT_READ|PROT_WRITE, MAP_SHARED, d->fd, 0);
+    if (d->map == MAP_FAILED) {
+        return -1;
+    }
+    int i = 0;
+    for (i = 0; i < d->n_slots; i++) {
+        d->slots[i].refs = 0;
+        d->slots[i].sharing = 0;
+        d->slots[i].next_free = i + 1 < d->n_slots ? i + 1 : -1;
+    }
+    d->free_slot = 0;
+    for (i = 0; i < table_size; i++) {
+        d->table[i].slot = -1;
+        d->table[i].page = -1;
+    }
+    d->scan = scan;
+    ctx->dedup = d;
+    return 0;
+}
+
+// Frees a copy without references. Called with d->lock held.
+static void slot_free(mm_context* ctx, dedup_store* d, int slot) {
+    dedup_bucket *bucket = &d->table[d->slots[slot].hash & d->table_mask];
+    if (bucket->slot == slot) {
+        bucket->slot = -1;
+        bucket->page = -1;
+    }
+    d->slots[slot].next_free = d->free_slot;
+    d->free_slot = slot;
+    d->used--;
+    fallocate(d->fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, (off_t)slot * ctx->page_size, ctx->page_size);
+}
+
+// Drops a reference taken with dedup_take
+void dedup_put(mm_context* ctx, int slot) {
+    dedup_store *d = ctx->dedup;
+    if (slot < 0) {
+        return;
+    }
+    spin_lock(&d->lock);
+    d->pages--;
+    if (--d->slots[slot].refs == 0) {
+        slot_free(ctx, d, slot);
+    }
+    spin_unlock(&d->lock);
+}
+
+// Detaches the reference of page 'number' and returns its slot, or -1 if it has none.
+// The copy stays until dedup_put, so a mapping of it can be replaced first.
+int dedup_take(mm_context* ctx, int number) {
+    int *ref = radix_find(&ctx->dedup->refs, number);
+    if (ref == NULL || *ref == 0) {
+        return -1;
+    }
+    int slot = *ref - 1;
+    *ref = 0;
+    return slot;
+}
+
+// Gives page 'number' back the reference dedup_take detached
+void dedup_ref(mm_context* ctx, int number, int slot) {
+    if (slot >= 0) {
+        *(int*)radix_get(&ctx->dedup->refs, number) = slot + 1;
+    }
+}
+
+// Returns the copy holding the saved contents of page 'number'
+const char *dedup_contents(mm_context* ctx, int number) {
+    int *ref = radix_find(&ctx->dedup->refs, number);
+    return slot_data(ctx->dedup, *ref - 1, ctx->page_size);
+}
+
+// Maps the copy of page 'number' over its memory with 'prot'. Returns 0, or -1 if it could not be mapped.
+static int slot_map(mm_context* ctx, int number, int slot, int prot) {
+    char *start = (char*)ctx->vm_start + (size_t)number * ctx->page_size;
+    void *mapped = mmap(start, ctx->page_size, prot, MAP_PRIVATE|MAP_FIXED, ctx->dedup->fd, (off_t)slot * ctx->page_size);
+    return mapped == MAP_FAILED ? -1 : 0;
+}
+
+static void sharing_add(dedup_store* d, int slot, int n) {
+    if (d->slots[slot].sharing == 0) {
+        d->shared_copies++;
+    }
+    d->slots[slot].sharing += n;
+    d->sharing += n;
+    if (d->slots[slot].sharing == 0) {
+        d->shared_copies--;
+    }
+}
+
+// Makes a resident page that references a copy use the copy's memory. Called with the page's lock
+// held while the page is PROT_NONE or PROT_READ and the copy has its contents. Returns 0 or -1.
+static int page_share(mm_context* ctx, page_entry* entry, int number, int prot) {
+    dedup_store *d = ctx->dedup;
+    int slot = *(int*)radix_get(&d->refs, number) - 1;
+    if (slot_map(ctx, number, slot, prot) == -1) {
+        return -1;
+    }
+    entry->store |= SWAP_MAPPED|SWAP_SHARING;
+    spin_lock(&d->lock);
+    sharing_add(d, slot, 1);
+    spin_unlock(&d->lock);
+    return 0;
+}
+
+// Maps the copy holding the saved contents of a page that is becoming resident, in place of copying them.
+// Called like swap_in. Returns 0, or -1 if the contents have to be copied.
+int dedup_map(mm_context* ctx, virtual_page* page) {
+    page_entry *entry = page_entry_get(ctx, page->number);
+    return page_share(ctx, entry, page->number, PROT_NONE);
+}
+
+// A resident page mapping a copy is being made writable, it stops sharing the copy's frame
+void dedup_write(mm_context* ctx, page_entry* entry, int number) {
+    dedup_store *d = ctx->dedup;
+    if (d == NULL || !(entry->store & SWAP_SHARING)) {
+        return;
+    }
+    entry->store &= ~SWAP_SHARING;
+    int *ref = radix_find(&d->refs, number);
+    if (ref != NULL && *ref != 0) {
+        spin_lock(&d->lock);
+        sharing_add(d, *ref - 1, -1);
+        spin_unlock(&d->lock);
+    }
+}
+
+// Gives page 'number' anonymous memory again in place of a copy, PROT_NONE, with its contents if 'keep'.
+// Called with the page's lock held, before its reference is dropped.
+void dedup_unmap(mm_context* ctx, page_entry* entry, int number, int keep, char* buffer) {
+    char *start = (char*)ctx->vm_start + (size_t)number * ctx->page_size;
+    if (!(entry->store & SWAP_MAPPED)) {
+        return;
+    }
+    dedup_write(ctx, entry, number);
+    if (keep) {
+        memcpy(buffer, start, ctx->page_size);
+    }
+    mmap(start, ctx->page_size, keep ? PROT_READ|PROT_WRITE : PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0);
+    if (keep) {
+        memcpy(start, buffer, ctx->page_size);
+    }
+    entry->store &= ~(SWAP_MAPPED|SWAP_SHARING);
+}
+
+// References 'slot' for page 'number'. Called with d->lock held.
+static void slot_ref(dedup_store* d, int slot, int number) {
+    *(int*)radix_get(&d->refs, number) = slot + 1;
+    d->slots[slot].refs++;
+    d->pages++;
+}
+
+// Loads the contents of candidate page 'number' into 'out' and compares them with 'data'. A resident
+// candidate is made read only first, it stays so if they match. Called with the candidate's lock held.
+static int candidate_match(mm_context* ctx, page_entry* entry, int number, char* out, const char* data) {
+    virtual_page *page = entry->page;
+    if (entry->store & (SWAP_DEDUP|SWAP_MAPPED)) {
+        return 0;
+    }
+    if (page == NULL) {
+        return swap_load(ctx, number, out) && memcmp(out, data, ctx->page_size) == 0;
+    }
+    // Stall writers while the contents are compared
+    mprotect(page->start, page->size, PROT_READ);
+    memcpy(out, page->start, ctx->page_size);
+    if (memcmp(out, data, ctx->page_size) == 0) {
+        return 1;
+    }
+    page_reprotect(ctx, page);
+    return 0;
+}
+
+// The saved contents of page 'number' are in a copy now, in place of the swap store
+static void saved_in_copy(mm_context* ctx, page_entry* entry, int number) {
+    if ((entry->store & SWAP_ZPOOL) && ctx->zpool != NULL) {
+        zpool_drop(ctx, number);
+    }
+    entry->store = SWAP_DEDUP | (entry->store & (SWAP_MAPPED|SWAP_SHARING));
+    if (entry->page != NULL) {
+        entry->page->modified = 0;
+    }
+}
+
+// Page 'number', locked by the caller and without a reference, is being saved with contents 'data'.
+// Returns 1 if a copy holds them now and the page references it, 0 if it has to be saved some other way.
+int dedup_save(mm_context* ctx, int number, const char* data) {
+    dedup_store *d = ctx->dedup;
+    uint64_t hash = page_hash(data, ctx->page_size);
+
+    spin_lock(&d->lock);
+    dedup_bucket *bucket = &d->table[hash & d->table_mask];
+    if (bucket->slot >= 0 && bucket->hash == hash && memcmp(slot_data(d, bucket->slot, ctx->page_size), data, ctx->page_size) == 0) {
+        slot_ref(d, bucket->slot, number);
+        spin_unlock(&d->lock);
+        return 1;
+    }
+    int candidate = bucket->slot < 0 && bucket->hash == hash ? bucket->page : -1;
+    int slot = d->free_slot;
+    if (candidate < 0 || candidate == number || slot < 0) {
+        // Copies stay findable, a candidate only takes a bucket without one
+        if (bucket->slot < 0) {
+            bucket->hash = hash;
+            bucket->page = number;
+        }
+        spin_unlock(&d->lock);
+        return 0;
+    }
+    d->free_slot = d->slots[slot].next_free;
+    d->slots[slot].refs = 1;
+    d->used++;
+    spin_unlock(&d->lock);
+
+    // The candidate's contents are read straight into the new copy
+    char *copy = slot_data(d, slot, ctx->page_size);
+    page_entry *entry = page_entry_get(ctx, candidate);
+    int match = 0;
+    if (spin_trylock(&entry->lock)) {
+        match = candidate_match(ctx, entry, candidate, copy, data);
+        if (match) {
+            spin_lock(&d->lock);
+            d->slots[slot].hash = hash;
+            d->slots[slot].refs = 0;
+            slot_ref(d, slot, candidate);
+            slot_ref(d, slot, number);
+            if (bucket->slot < 0) {
+                bucket->hash = hash;
+                bucket->slot = slot;
+                bucket->page = -1;
+            }
+            spin_unlock(&d->lock);
+            saved_in_copy(ctx, entry, candidate);
+            if (entry->page != NULL && page_share(ctx, entry, candidate, PROT_READ) == -1) {
+                mprotect(entry->page->start, entry->page->size, PROT_READ);
+            }
+        }
+        spin_unlock(&entry->lock);
+    }
+    if (!match) {
+        spin_lock(&d->lock);
+        d->slots[slot].hash = hash;
+        d->slots[slot].refs = 0;
+        slot_free(ctx, d, slot);
+        if (bucket->slot < 0) {
+            bucket->hash = hash;
+            bucket->page = number;
+        }
+        spin_unlock(&d->lock);
+    }
+    return match;
+}
+
+// Counts an eviction whose contents were found in a copy
+void dedup_saved(mm_context* ctx) {
+    atomic_fetch_add_explicit(&ctx->dedup->saves, 1, memory_order_relaxed);
+}
+
+// Shares resident page 'number' if a copy or another page has the same contents. Called with its lock held.
+static void scan_page(mm_context* ctx, page_entry* entry, int number) {
+    virtual_page *page = entry->page;
+    if (entry->store & SWAP_MAPPED) {
+        return;
+    }
+    // Stall writers while the contents are looked up
+    mprotect(page->start, page->size, PROT_READ);
+    int old = dedup_take(ctx, number);
+    if (dedup_save(ctx, number, page->start)) {
+        saved_in_copy(ctx, entry, number);
+        if (page_share(ctx, entry, number, PROT_READ) == 0) {
+            dedup_put(ctx, old);
+            return;
+        }
+    } else {
+        dedup_ref(ctx, number, old);
+        old = -1;
+    }
+    dedup_put(ctx, old);
+    page_reprotect(ctx, page);
+}
+
+// Idle scan of the background reclaimer: looks at up to DEDUP_SCAN_BATCH resident pages, going round the
+// region. Returns 0 if the region does not scan.
+int dedup_scan(mm_context* ctx) {
+    dedup_store *d = ctx->dedup;
+    if (d == NULL || !d->scan) {
+        return 0;
+    }
+    int n = 0;
+    int number = radix_next(&ctx->page_index, d->cursor, ctx->n_pages);
+    while (n < DEDUP_SCAN_BATCH) {
+        if (number < 0) {
+            number = radix_next(&ctx->page_index, 0, ctx->n_pages);
+            if (number < 0 || n > 0) {
+                break;
+            }
+        }
+        page_entry *entry = page_entry_find(ctx, number);
+        if (entry->page != NULL && spin_trylock(&entry->lock)) {
+            if (entry->page != NULL) {
+                scan_page(ctx, entry, number);
+                n++;
+            }
+            spin_unlock(&entry->lock);
+        }
+        number = radix_next(&ctx->page_index, number + 1, ctx->n_pages);
+    }
+    d->cursor = number < 0 ? 0 : number;
+    return 1;
+}
+
+void dedup_report(mm_context* ctx, mm_stats* stats) {
+    dedup_store *d = ctx->dedup;
+    if (d == NULL) {
+        return;
+    }
+    spin_lock(&d->lock);
+    stats->dedup_pages = d->pages;
+    stats->dedup_copies = d->used;
+    stats->dedup_bytes_saved = (uint64_t)(d->pages - d->used) * ctx->page_size;
+    stats->dedup_frames_saved = d->sharing - d->shared_copies;
+    spin_unlock(&d->lock);
+    stats->dedup_write_backs_saved = atomic_load_explicit(&d->saves, memory_order_relaxed);
+}
+
+void dedup_destroy(mm_context* ctx) {
+    dedup_store *d = ctx->dedup;
+    if (d == NULL) {
+        return;
+    }
+    munmap(d->map, (size_t)d->n_slots * ctx->page_size);
+    close(d->fd);
+    radix_destroy(&d->refs);
+    free(d->slots);
+    free(d->table);
+    free(d);
+    ctx->dedup = NULL;
+}
@@ -0,0 +1,490 @@
+#ifndef _473_MM_INTERNAL_H
+#define _473_MM_INTERNAL_H
+
+#include "473_mm.h"
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+// Spin lock that is safe to take inside the SIGSEGV handler
+typedef atomic_uchar mm_lock;
+
+static inline int spin_trylock(mm_lock* lock) {
+    return !atomic_exchange_explicit(lock, 1, memory_order_acquire);
+}
+
+static inline void spin_lock(mm_lock* lock) {
+    while (!spin_trylock(lock)) {
+        int spins = 0;
+        while (atomic_load_explicit(lock, memory_order_relaxed)) {
+            if (++spins == 64) {
+                sched_yield();
+                spins = 0;
+            }
+        }
+    }
+}
+
+static inline void spin_unlock(mm_lock* lock) {
+    atomic_store_explicit(lock, 0, memory_order_release);
+}
+
+// Radix index over page numbers (473_mm_radix.c)
+//
+// Leaves hold RADIX_FANOUT entries of 'entry_size' bytes, interior nodes RADIX_FANOUT child pointers. Only the
+// root exists after radix_init, every other node is created the first time a key below it is asked for, so
+// memory follows the part of the key space that is used. Nodes come from an arena reserved at init and are
+// never freed before radix_destroy, so lookups need no lock and creating a node never calls malloc.
+#define RADIX_BITS 9
+#define RADIX_FANOUT (1 << RADIX_BITS)
+
+typedef struct radix radix;
+struct radix {
+    int levels;             // interior levels above the leaves, 0 if the root is the only leaf
+    size_t entry_size;
+    void *root;
+    char *arena;
+    size_t arena_size;
+    size_t arena_used;      // covered by 'lock'
+    mm_lock lock;           // taken to create nodes
+};
+
+void *radix_create(radix*, int);
+int radix_init(radix*, long, size_t);
+int radix_next(radix*, int, int);
+size_t radix_bytes(radix*);
+void radix_destroy(radix*);
+
+// Returns the entry of 'key', or NULL if its leaf was never created
+static inline void *radix_find(radix* r, int key) {
+    void *node = r->root;
+    int level = 0;
+    for (level = r->levels; level > 0; level--) {
+        int index = (key >> (level * RADIX_BITS)) & (RADIX_FANOUT - 1);
+        node = atomic_load_explicit(&((_Atomic(void*)*)node)[index], memory_order_acquire);
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+    return (char*)node + (size_t)(key & (RADIX_FANOUT - 1)) * r->entry_size;
+}
+
+// Returns the entry of 'key', creating the nodes on its path if needed. New entries are zero.
+static inline void *radix_get(radix* r, int key) {
+    void *entry = radix_find(r, key);
+    return entry != NULL ? entry : radix_create(r, key);
+}
+
+// Data Structures
+typedef struct virtual_page virtual_page;
+struct virtual_page {
+    int number;
+    void* start;
+    int size;
+    int modified;
+    int referenced;
+    int state;              // policy specific, e.g. which list the page is on
+    int prefetched;         // made resident ahead of use and not known to be used yet, see PREFETCH_*
+    int pinned;             // on ctx->pinned instead of the policy's lists
+    int windowed;           // on the admission window instead of the policy's lists
+    uint64_t dirty;         // parts of the extent written, with 'dirty_subpages', see dirty_shift
+    virtual_page *next;
+    virtual_page *prev;
+};
+
+typedef struct virtual_page_queue virtual_page_queue;
+struct virtual_page_queue {
+    virtual_page *head;
+    virtual_page *tail;
+    virtual_page *hand;
+    int size;
+    unsigned long steps;    // pages passed by the hand, for the stats
+};
+
+// Frame descriptors are allocated in chunks: one at mm_init, and one more
+// every time the frame budget grows past the descriptors there are
+typedef struct pool_chunk pool_chunk;
+struct pool_chunk {
+    pool_chunk *next;
+    int size;
+    virtual_page pages[];
+};
+
+// What is left of a page between detach_page and release_evicted
+typedef struct evicted_page evicted_page;
+struct evicted_page {
+    int number;
+    void* start;
+    int size;
+    int modified;
+    uint64_t dirty;
+};
+
+// History of recently evicted page numbers, used by the adaptive policies.
+// Entries come from a fixed arena and are found through a small hash table,
+// so every operation is O(1) and never allocates.
+typedef struct ghost_entry ghost_entry;
+struct ghost_entry {
+    int number;
+    ghost_entry *next;
+    ghost_entry *prev;
+    ghost_entry *hash_next;
+};
+
+typedef struct ghost_list ghost_list;
+struct ghost_list {
+    ghost_entry *entries;
+    ghost_entry *free;
+    ghost_entry **buckets;
+    int bucket_mask;
+    ghost_entry *head;      // oldest entry
+    ghost_entry *tail;      // newest entry
+    int size;
+    int capacity;
+    int allocated;          // entries in the arena, at least 'capacity'
+    unsigned long steps;    // entries visited by lookups, for the stats
+};
+
+// Replacement policy operations. 'state' is whatever 'init' returned.
+//      init        - set up the policy for a context with 'n_frames' frames
+//      on_fault    - a page has just become resident
+//      on_write    - a resident page took a write fault (or a read fault on a page it was not open to)
+//      pick_victim - the frames are full, choose the page to evict for page number 'incoming' (-1 for none).
+//                    The caller drops the victim if it is busy, so this only chooses and leaves what the
+//                    policy remembers alone. Otherwise on_evict of the victim follows right away.
+//      on_evict    - a page is leaving its frame
+//      report      - add the policy's hand and lookup steps to a stats snapshot
+//      resize      - the frame budget changed to 'n_frames', pages over it are evicted afterwards
+//      on_remove   - a resident page leaves the policy without being evicted (pinned or discarded),
+//                    nothing is remembered about it
+// Read accesses to resident pages never fault, so writes are the only hits a policy can observe.
+typedef struct mm_policy mm_policy;
+struct mm_policy {
+    const char *name;
+    void* (*init)(mm_context* ctx, int n_frames);
+    void (*destroy)(void* state);
+    void (*on_fault)(void* state, virtual_page* page);
+    void (*on_write)(void* state, virtual_page* page);
+    virtual_page* (*pick_victim)(void* state, int incoming);
+    void (*on_evict)(void* state, virtual_page* page);
+    void (*report)(void* state, mm_stats* stats);
+    void (*resize)(void* state, int n_frames);
+    void (*on_remove)(void* state, virtual_page* page);
+};
+
+// Sequential fault detection. A stream is confirmed when two faults in a row
+// are 'stride' pages apart; every confirmation prefetches the next 'window'
+// pages of the stream and doubles the window, up to 'max_window'.
+#define READAHEAD_MAX_WINDOW 64
+#define READAHEAD_INITIAL_WINDOW 4
+
+// Why a page was prefetched, counted in prefetches/faults_avoided or in the advised_* counters
+#define PREFETCH_READAHEAD 1
+#define PREFETCH_ADVISED 2
+
+typedef struct readahead_state readahead_state;
+struct readahead_state {
+    int limit;              // the 'readahead' option
+    int max_window;         // 0 when readahead is off
+    int window;
+    int stride;
+    int last;               // last page of the stream, faulted or prefetched
+    int pending;            // pages prefetched since the stream was last confirmed
+};
+
+typedef struct uffd_backend uffd_backend;
+typedef struct trace_recorder trace_recorder;
+typedef struct swap_store swap_store;
+typedef struct reclaimer reclaimer;
+typedef struct zpool zpool;
+typedef struct mrc_state mrc_state;
+typedef struct writeback writeback;
+typedef struct shared_region shared_region;
+typedef struct dedup_store dedup_store;
+
+// Per-page entry of the page index
+typedef struct page_entry page_entry;
+struct page_entry {
+    virtual_page *page;     // resident frame descriptor, or NULL if the page is not resident
+    mm_lock lock;
+    unsigned char store;    // state of the page in the swap store or the userfaultfd backend
+    unsigned char advice;   // ADVICE_* flags set by mm_advise
+    uint32_t evicted;       // eviction the page left its frame in, for the admission filter, 0 if none
+};
+
+// Per-page swap state, kept in 'store' for the SIGSEGV backend (473_mm_swap.c, 473_mm_dedup.c)
+#define SWAP_VALID 1    // swap file holds the current contents of the page
+#define SWAP_DATA  2    // page held data at mm_init time that is not in the swap file yet
+#define SWAP_ZPOOL 4    // compressed pool holds the current contents of the page
+#define SWAP_QUEUED 8   // an asynchronous write of the page was queued and may not be done yet
+#define SWAP_DEDUP 16   // a shared copy holds the current contents of the page
+#define SWAP_MAPPED 32  // the resident page is a mapping of that copy
+#define SWAP_SHARING 64 // and has not been written since, so it shares the copy's memory
+
+// Per-page hints from mm_advise
+#define ADVICE_SEQUENTIAL 1
+#define ADVICE_RANDOM 2
+#define ADVICE_PIN 4
+
+// Everything needed to manage one region. The region given to mm_init() is
+// managed by DEFAULT_CONTEXT, every mm_create() makes a new context.
+//
+// Locking: faults on the same page are serialized by that page's entry in
+// page_locks. policy_lock covers the policy lists, resident_pages, the
+// descriptor pool and the trace buffer, and is never held across mprotect.
+// A thread holding policy_lock only ever try-locks a page, so the two kinds
+// of lock cannot deadlock.
+struct mm_context {
+    void *vm_start;
+    size_t vm_size;
+    int n_frames;
+    int page_size;
+    int page_shift;         // log2 of page_size if it is a power of two, otherwise -1
+    int subpages;           // pages per extent, 1 unless 'extent_pages' is set; page_size is the extent's size
+    int dirty_subpages;     // the 'dirty_subpages' option, in effect
+    int dirty_shift;        // log2 of the part of an extent a bit of virtual_page.dirty stands for
+    int huge_pages;         // the region was given MADV_HUGEPAGE
+    int policy;
+    int backend;
+    atomic_ulong fault_count;
+    atomic_ulong write_back_count;
+    atomic_ulong bytes_released;
+    atomic_ulong bytes_restored;
+    atomic_ulong protection_faults;
+    atomic_ulong prefetches;
+    atomic_ulong faults_avoided;
+    atomic_ulong read_faults;
+    atomic_ulong write_upgrades;
+    atomic_ulong evictions;
+    atomic_ulong reclaimed;
+    atomic_ulong advised_prefetches;
+    atomic_ulong advised_faults_avoided;
+    atomic_ulong discarded;
+    atomic_ulong subpages_written;
+    atomic_ulong subpages_skipped;
+    atomic_ulong fault_latency[MM_LATENCY_BUCKETS];
+    atomic_ulong protection_latency[MM_LATENCY_BUCKETS];
+
+    // Cycle counter and clock at mm_init, to convert ticks to time
+    uint64_t start_ticks;
+    uint64_t start_ns;
+
+    // Replacement policy in use and its private state
+    mm_policy *policy_ops;
+    void *policy_state;
+
+    // Number of frames currently holding a page
+    int resident_pages;
+
+    // Pages pinned by mm_advise, at most half of the frames. They hold frames
+    // but are out of the policy's reach.
+    virtual_page_queue pinned;
+
+    mm_lock policy_lock;
+
+    // Page table indexed by virtual page number, a radix index of page_entry.
+    // Only the parts of the region that were touched have entries.
+    int n_pages;
+    radix page_index;
+
+    // Preallocated frame descriptors. Unused descriptors are chained through
+    // their next pointer, so the fault path never calls malloc or free.
+    // There are always at least n_frames of them.
+    pool_chunk *page_pool;
+    int pool_size;
+    virtual_page *free_pages;
+
+    readahead_state readahead; // covered by policy_lock
+
+    // Free frame watermarks of the background reclaimer
+    int free_low;
+    int free_high;
+
+    uffd_backend *uffd;         // only for MM_BACKEND_USERFAULTFD
+    trace_recorder *trace;      // NULL unless a trace is being recorded
+    swap_store *swap;           // NULL unless 'reclaim' or 'file_path' is set
+    writeback *writeback;       // asynchronous writes of the swap store, NULL if they are synchronous
+    reclaimer *reclaimer;       // NULL unless 'reclaimer' is set
+    zpool *zpool;               // NULL unless 'compress_budget' is set
+    mrc_state *mrc;             // NULL unless 'mrc_samples' is set, covered by policy_lock
+    shared_region *shared;      // NULL unless the region is from mm_shared_open
+    dedup_store *dedup;         // NULL unless 'dedup_budget' is set
+};
+
+// What the faulting access is known to be
+#define FAULT_UNKNOWN 0
+#define FAULT_READ 1
+#define FAULT_WRITE 2
+
+// What handle_segv did with a fault
+#define FAULT_RETRY 0       // the victim page was busy, the access has to fault again
+#define FAULT_MAPPED 1      // a page fault made the page resident
+#define FAULT_UPGRADED 2    // a protection fault changed the rights of a resident page
+
+// Cheap cycle counter for fault latencies, in ticks
+static inline uint64_t stats_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Returns the page index entry of a page number, creating it if needed
+static inline page_entry *page_entry_get(mm_context* ctx, int number) {
+    return radix_get(&ctx->page_index, number);
+}
+
+// Returns the page index entry of a page number, or NULL if no page near it was ever touched
+static inline page_entry *page_entry_find(mm_context* ctx, int number) {
+    return radix_find(&ctx->page_index, number);
+}
+
+// Function prototypes
+int handle_fault(mm_context*, void*, int);
+int handle_segv(mm_context*, void*, int);
+void detach_page(mm_context*, virtual_page*, evicted_page*);
+void free_frame(mm_context*, virtual_page*, evicted_page*);
+void release_evicted(mm_context*, evicted_page*);
+void account_evicted(mm_context*, evicted_page*);
+void page_protect(mm_context*, virtual_page*, int);
+void page_reprotect(mm_context*, virtual_page*);
+void subpage_write(mm_context*, virtual_page*, void*);
+void protect_range(mm_context*, void*, size_t, int);
+void scan_resident(mm_context*, void (*)(mm_context*, int));
+
+int translate_to_page_number(mm_context*, void*);
+virtual_page *get_page(mm_context*, void*);
+virtual_page* init_page(mm_context*, int, void*, int, int);
+
+// Replacement policies (473_mm_policy.c)
+mm_policy *find_policy(int);
+
+void enqueue(virtual_page_queue*, virtual_page*);
+virtual_page* dequeue(virtual_page_queue*);
+void queue_remove(virtual_page_queue*, virtual_page*);
+
+void clock_init(mm_context*, virtual_page_queue*, int);
+void circular_enqueue(virtual_page_queue*, virtual_page*);
+void circular_remove(virtual_page_queue*, virtual_page*);
+
+void ghost_init(ghost_list*, int);
+void ghost_resize(ghost_list*, int);
+void ghost_destroy(ghost_list*);
+int ghost_contains(ghost_list*, int);
+int ghost_remove(ghost_list*, int);
+int ghost_push(ghost_list*, int);
+void ghost_pop(ghost_list*);
+
+// Admission filter in front of a policy (473_mm_admission.c)
+extern mm_policy ADMISSION_POLICY;
+void *admission_init(mm_context*, mm_policy*, int);
+
+// Functions for the statistics (473_mm_stats.c)
+void stats_init(mm_context*);
+void stats_latency(mm_context*, int, uint64_t);
+
+// Functions for the frame descriptor pool
+void pool_init(mm_context*, int);
+pool_chunk *pool_chunk_new(int);
+void pool_add(mm_context*, pool_chunk*);
+void pool_free(mm_context*, virtual_page*);
+void pool_destroy(mm_context*);
+
+// Functions for readahead (473_mm_readahead.c)
+void readahead_init(mm_context*, int);
+int readahead_collect(mm_context*, int, int, virtual_page**, evicted_page*);
+void readahead_admit(mm_context*, virtual_page**, int);
+void prefetch_used(mm_context*, virtual_page*);
+void readahead_map(mm_context*, virtual_page*, int, virtual_page**, evicted_page*, int);
+
+// Functions for application hints (473_mm_advise.c)
+int page_pin(mm_context*, virtual_page*);
+void pin_limit(mm_context*);
+
+// Functions for the background reclaimer (473_mm_reclaim.c)
+int reclaimer_init(mm_context*, int, int);
+void reclaimer_watermarks(mm_context*);
+void reclaimer_wake(mm_context*);
+void reclaimer_destroy(mm_context*);
+void release_batch(mm_context*, evicted_page*, int);
+
+// Functions for the region index (473_mm_region.c)
+mm_context *region_find(void*);
+int region_add(mm_context*);
+void region_remove(mm_context*);
+
+// Functions for the userfaultfd backend (473_mm_uffd.c)
+int uffd_init(mm_context*);
+void uffd_protect(mm_context*, void*, int);
+void uffd_discard(mm_context*, void*);
+void uffd_destroy(mm_context*);
+
+// Functions for the swap store (473_mm_swap.c)
+int swap_open(mm_context*, const char*, int);
+char *swap_map(mm_context*);
+int swap_out(mm_context*, evicted_page*);
+int swap_load(mm_context*, int, char*);
+void swap_in(mm_context*, virtual_page*);
+void swap_discard(mm_context*, int);
+void swap_close(mm_context*);
+
+// Functions for content deduplication (473_mm_dedup.c)
+int dedup_init(mm_context*, size_t, int);
+int dedup_save(mm_context*, int, const char*);
+void dedup_saved(mm_context*);
+int dedup_take(mm_context*, int);
+void dedup_ref(mm_context*, int, int);
+void dedup_put(mm_context*, int);
+const char *dedup_contents(mm_context*, int);
+int dedup_map(mm_context*, virtual_page*);
+void dedup_write(mm_context*, page_entry*, int);
+void dedup_unmap(mm_context*, page_entry*, int, int, char*);
+int dedup_scan(mm_context*);
+void dedup_report(mm_context*, mm_stats*);
+void dedup_destroy(mm_context*);
+
+// Functions for asynchronous write back (473_mm_writeback.c)
+int writeback_init(mm_context*, int);
+int writeback_write(int, const void*, size_t, off_t);
+int writeback_queue(mm_context*, int, const void*);
+int writeback_read(mm_context*, int, void*);
+void writeback_drain(mm_context*);
+void writeback_report(mm_context*, mm_stats*);
+void writeback_destroy(mm_context*);
+
+// Functions for the compressed tier (473_mm_zpool.c)
+int zpool_init(mm_context*, size_t);
+int zpool_store(mm_context*, int, const void*);
+int zpool_load(mm_context*, int, void*, int);
+void zpool_drop(mm_context*, int);
+void zpool_report(mm_context*, mm_stats*);
+void zpool_destroy(mm_context*);
+
+// Functions for the miss ratio curve estimator (473_mm_mrc.c)
+int mrc_init(mm_context*, int);
+void mrc_access(mm_context*, int);
+void mrc_destroy(mm_context*);
+
+// Functions for shared regions (473_mm_shared.c)
+int shared_fault(mm_context*, void*, int);
+int shared_set_frames(mm_context*, int);
+void shared_report(mm_context*, mm_stats*);
+void shared_close(mm_context*);
+
+// Functions for the fault trace recorder (473_mm_trace.c)
+int trace_open(mm_context*, const char*);
+void trace_event(mm_context*, int, int);
+void trace_close(mm_context*);
+
+// Global variables
+extern mm_context *DEFAULT_CONTEXT;
+
+#endif
@@ -0,0 +1,304 @@
+#include "473_mm_internal.h"
+#include <string.h>
+
+// Online miss ratio curve
+//
+// Every fault is a reference to its page. A reference is sampled when a hash of the page number falls below a
+// threshold (spatial sampling, as in SHARDS by Waldspurger et al.), so a page is either always or never
+// sampled. For a sampled reference the estimator finds its reuse distance, the number of distinct sampled
+// pages referenced since the previous reference to the same page, scales it by the inverse of the sampling
+// rate and adds it to a histogram. With c frames under LRU a reference faults exactly when its reuse distance
+// is at least c, so the histogram gives the fault ratio at every frame count.
+//
+// At most 'capacity' sampled pages are tracked. When a new page would go over, the threshold is halved and the
+// pages above it are forgotten, so memory is bounded and the sampling rate adapts to the size of the working set.
+//
+// Reuse distances come from a Fenwick tree over reference slots: every sampled reference takes the next slot,
+// and the distance is the number of pages whose last reference has a later slot. When the slots run out the
+// live ones are renumbered in order. An unsampled fault costs a hash; a sampled one O(log capacity), with
+// the renumbering amortized over the slots it frees.
+//
+// Everything is preallocated at mm_init and only touched under ctx->policy_lock.
+
+#define MRC_HASH_BITS 24
+#define MRC_EMPTY -1
+
+// Histogram buckets: distances 0 to 15 have their own bucket, larger ones 8 buckets per power of two
+#define MRC_LINEAR 16
+#define MRC_SUB_BITS 3
+#define MRC_BUCKETS (MRC_LINEAR + (32 - 4) * (1 << MRC_SUB_BITS))
+
+typedef struct mrc_sample mrc_sample;
+struct mrc_sample {
+    int page;
+    int slot;
+};
+
+struct mrc_state {
+    uint32_t threshold;     // a page is sampled when its hash is below this
+    int capacity;
+    int size;
+
+    // Open addressing table of sampled pages
+    mrc_sample *samples;
+    int table_mask;
+
+    // Slots in reference order, each holds the index of its sample in 'samples' or MRC_EMPTY
+    int *slots;
+    int *tree;              // Fenwick tree over the occupied slots
+    int n_slots;
+    int next_slot;
+
+    // Histogram of scaled reuse distances, weighted by the inverse sampling rate
+    double hist[MRC_BUCKETS];
+    double cold;            // first references to a sampled page
+    double total;
+};
+
+static uint32_t mrc_hash(int page) {
+    uint64_t h = (uint64_t)(unsigned int)page * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    return (uint32_t)h & ((1u << MRC_HASH_BITS) - 1);
+}
+
+static int mrc_bucket(long distance) {
+    if (distance < MRC_LINEAR) {
+        return (int)distance;
+    }
+    int e = 63 - __builtin_clzl(distance);
+    int sub = (distance >> (e - MRC_SUB_BITS)) & ((1 << MRC_SUB_BITS) - 1);
+    int bucket = MRC_LINEAR + (e - 4) * (1 << MRC_SUB_BITS) + sub;
+    return bucket < MRC_BUCKETS ? bucket : MRC_BUCKETS - 1;
+}
+
+// Smallest distance that falls into 'bucket'
+static long mrc_bucket_low(int bucket) {
+    if (bucket < MRC_LINEAR) {
+        return bucket;
+    }
+    int e = (bucket - MRC_LINEAR) / (1 << MRC_SUB_BITS) + 4;
+    int sub = (bucket - MRC_LINEAR) % (1 << MRC_SUB_BITS);
+    return (1L << e) + ((long)sub << (e - MRC_SUB_BITS));
+}
+
+int mrc_init(mm_context* ctx, int capacity) {
+    mrc_state *m = calloc(1, sizeof(mrc_state));
+    if (m == NULL) {
+        return -1;
+    }
+    ctx->mrc = m;
+
+    int table_size = 1;
+    while (table_size < 2 * capacity) {
+        table_size <<= 1;
+    }
+    m->capacity = capacity;
+    m->threshold = 1u << MRC_HASH_BITS;
+    m->table_mask = table_size - 1;
+    m->n_slots = 4 * capacity;
+    m->samples = malloc(table_size * sizeof(mrc_sample));
+    m->slots = malloc(m->n_slots * sizeof(int));
+    m->tree = calloc(m->n_slots + 1, sizeof(int));
+    if (m->samples == NULL || m->slots == NULL || m->tree == NULL) {
+        return -1;
+    }
+
+    int i = 0;
+    for (i = 0; i < table_size; i++) {
+        m->samples[i].page = MRC_EMPTY;
+    }
+    for (i = 0; i < m->n_slots; i++) {
+        m->slots[i] = MRC_EMPTY;
+    }
+    return 0;
+}
+
+void mrc_destroy(mm_context* ctx) {
+    mrc_state *m = ctx->mrc;
+    if (m == NULL) {
+        return;
+    }
+    free(m->samples);
+    free(m->slots);
+    free(m->tree);
+    free(m);
+    ctx->mrc = NULL;
+}
+
+static void tree_add(mrc_state* m, int slot, int delta) {
+    int i = 0;
+    for (i = slot + 1; i <= m->n_slots; i += i & -i) {
+        m->tree[i] += delta;
+    }
+}
+
+// Number of occupied slots up to and including 'slot'
+static int tree_prefix(mrc_state* m, int slot) {
+    int sum = 0;
+    int i = 0;
+    for (i = slot + 1; i > 0; i -= i & -i) {
+        sum += m->tree[i];
+    }
+    return sum;
+}
+
+// Renumbers the occupied slots from 0 in the same order and rebuilds the tree
+static void mrc_compact(mrc_state* m) {
+    int used = 0;
+    int i = 0;
+    for (i = 0; i < m->n_slots; i++) {
+        int sample = m->slots[i];
+        if (sample != MRC_EMPTY) {
+            m->slots[i] = MRC_EMPTY;
+            m->slots[used] = sample;
+            m->samples[sample].slot = used;
+            used++;
+        }
+    }
+    memset(m->tree, 0, (m->n_slots + 1) * sizeof(int));
+    for (i = 0; i < used; i++) {
+        tree_add(m, i, 1);
+    }
+    m->next_slot = used;
+}
+
+static int mrc_find(mrc_state* m, int page) {
+    int i = mrc_hash(page) & m->table_mask;
+    while (m->samples[i].page != MRC_EMPTY && m->samples[i].page != page) {
+        i = (i + 1) & m->table_mask;
+    }
+    return i;
+}
+
+// Halves the sampling rate, forgets the pages above the new threshold and rebuilds the table
+static void mrc_shrink(mrc_state* m) {
+    m->threshold /= 2;
+
+    int i = 0;
+    for (i = 0; i < m->n_slots; i++) {
+        int sample = m->slots[i];
+        if (sample != MRC_EMPTY) {
+            m->slots[i] = mrc_hash(m->samples[sample].page) < m->threshold ? m->samples[sample].page : MRC_EMPTY;
+        }
+    }
+    for (i = 0; i <= m->table_mask; i++) {
+        m->samples[i].page = MRC_EMPTY;
+    }
+
+    // The slots hold page numbers for now, put the pages back and point the slots at them
+    m->size = 0;
+    for (i = 0; i < m->n_slots; i++) {
+        int page = m->slots[i];
+        if (page != MRC_EMPTY) {
+            int sample = mrc_find(m, page);
+            m->samples[sample].page = page;
+            m->samples[sample].slot = i;
+            m->slots[i] = sample;
+            m->size++;
+        }
+    }
+    mrc_compact(m);
+}
+
+// Records a reference to 'page'. Called with ctx->policy_lock held.
+void mrc_access(mm_context* ctx, int page) {
+    mrc_state *m = ctx->mrc;
+    if (mrc_hash(page) >= m->threshold) {
+        return;
+    }
+
+    double weight = (double)(1u << MRC_HASH_BITS) / m->threshold;
+    int sample = mrc_find(m, page);
+    if (m->samples[sample].page == page) {
+        int slot = m->samples[sample].slot;
+        long distance = m->size - tree_prefix(m, slot);
+        m->hist[mrc_bucket((long)(distance * weight))] += weight;
+        tree_add(m, slot, -1);
+        m->slots[slot] = MRC_EMPTY;
+    } else {
+        m->cold += weight;
+        if (m->size == m->capacity) {
+            mrc_shrink(m);
+            if (mrc_hash(page) >= m->threshold) {
+                m->total += weight;
+                return;
+            }
+            sample = mrc_find(m, page);
+        }
+        m->samples[sample].page = page;
+        m->size++;
+    }
+    m->total += weight;
+
+    if (m->next_slot == m->n_slots) {
+        mrc_compact(m);
+    }
+    m->samples[sample].slot = m->next_slot;
+    m->slots[m->next_slot] = sample;
+    tree_add(m, m->next_slot, 1);
+    m->next_slot++;
+}
+
+// Fraction of the references that would fault with 'n_frames' frames under LRU
+static double mrc_ratio(mrc_state* m, long n_frames) {
+    if (m->total == 0) {
+        return 0.0;
+    }
+    double faults = m->cold;
+    int i = 0;
+    for (i = 0; i < MRC_BUCKETS; i++) {
+        long low = mrc_bucket_low(i);
+        long high = i + 1 < MRC_BUCKETS ? mrc_bucket_low(i + 1) : low * 2;
+        if (low >= n_frames) {
+            faults += m->hist[i];
+        } else if (high > n_frames) {
+            // Spread the bucket evenly over the distances it covers
+            faults += m->hist[i] * (high - n_frames) / (high - low);
+        }
+    }
+    return faults / m->total;
+}
+
+double mm_predict_fault_ratio(int n_frames) {
+    return DEFAULT_CONTEXT == NULL ? 0.0 : mm_context_predict_fault_ratio(DEFAULT_CONTEXT, n_frames);
+}
+
+int mm_frames_for_fault_ratio(double target) {
+    return DEFAULT_CONTEXT == NULL ? -1 : mm_context_frames_for_fault_ratio(DEFAULT_CONTEXT, target);
+}
+
+double mm_context_predict_fault_ratio(mm_context* ctx, int n_frames) {
+    if (ctx->mrc == NULL) {
+        return -1.0;
+    }
+    spin_lock(&ctx->policy_lock);
+    double ratio = mrc_ratio(ctx->mrc, n_frames);
+    spin_unlock(&ctx->policy_lock);
+    return ratio;
+}
+
+int mm_context_frames_for_fault_ratio(mm_context* ctx, double target) {
+    if (ctx->mrc == NULL) {
+        return -1;
+    }
+    spin_lock(&ctx->policy_lock);
+    // The ratio never grows with the frames, so search for the first frame count that meets the target
+    int frames = -1;
+    if (mrc_ratio(ctx->mrc, ctx->n_pages) <= target) {
+        int low = 1;
+        int high = ctx->n_pages;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (mrc_ratio(ctx->mrc, mid) <= target) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        frames = low;
+    }
+    spin_unlock(&ctx->policy_lock);
+    return frames;
+}
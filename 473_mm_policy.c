@@ -0,0 +1,999 @@
+#include "473_mm_internal.h"
+
+// Replacement policies
+//
+// Every policy keeps its own lists of resident pages, threaded through the
+// next/prev pointers of the frame descriptors, and gets told about faults,
+// writes and evictions through its mm_policy table. All bookkeeping is O(1)
+// or amortized O(1) per fault: lists are only ever touched at their ends or
+// at a known node, ghost lookups go through a hash table, and the clock hands
+// only pass a page more than once after clearing its referenced bit.
+//
+// pick_victim only chooses: its caller may find the victim busy and drop it,
+// so it leaves the ghost lists and targets alone and records the victim and
+// the incoming page instead. The eviction may push the oldest ghost entry out
+// before the incoming page reaches on_fault, so policies with ghost lists take
+// the incoming page out of them in on_evict, when the recorded victim leaves,
+// and remember the hit in 'ghost_hit' until on_fault, which comes next under
+// the same hold of the policy lock.
+
+// Queue helpers shared by the policies
+
+void enqueue(virtual_page_queue* queue, virtual_page* page) {
+    page->next = NULL;
+    if (queue->head == NULL) {
+        page->prev = NULL;
+        queue->head = page;
+        queue->tail = page;
+    } else {
+        page->prev = queue->tail;
+        queue->tail->next = page;
+        queue->tail = page;
+    }
+    queue->size++;
+}
+
+virtual_page* dequeue(virtual_page_queue* queue) {
+    virtual_page *temp = queue->head;
+    if (temp != NULL) {
+        queue_remove(queue, temp);
+    }
+    return temp;
+}
+
+void queue_remove(virtual_page_queue* queue, virtual_page* page) {
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        queue->head = page->next;
+    }
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    } else {
+        queue->tail = page->prev;
+    }
+    page->next = NULL;
+    page->prev = NULL;
+    queue->size--;
+}
+
+static virtual_page_queue *new_queue() {
+    virtual_page_queue *queue = calloc(1, sizeof(virtual_page_queue));
+    if (queue == NULL) {
+        printf("queue allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return queue;
+}
+
+static void no_op(void* state, virtual_page* page) {
+}
+
+static void no_report(void* state, mm_stats* stats) {
+}
+
+static void no_resize(void* state, int n_frames) {
+}
+
+// FIFO: evict the page that became resident first
+
+static void* fifo_init(mm_context* ctx, int n_frames) {
+    return new_queue();
+}
+
+static void fifo_on_fault(void* state, virtual_page* page) {
+    enqueue(state, page);
+}
+
+static virtual_page* fifo_pick_victim(void* state, int incoming) {
+    return ((virtual_page_queue*)state)->head;
+}
+
+static void fifo_on_evict(void* state, virtual_page* page) {
+    queue_remove(state, page);
+}
+
+// Clock: a ring of frames swept by a hand that gives referenced pages a second chance.
+// The ring is reached only through the hand, new pages are inserted just behind it.
+// The blank pages from clock_init only fill the frames of the initial budget. When the
+// budget grows the new frames start out free, and when it shrinks blank pages are evicted
+// like any other page, so the ring never has to be rebuilt.
+
+// Initializes blank referenced pages for clock algorithm
+void clock_init(mm_context* ctx, virtual_page_queue* queue, int n) {
+
+    // Create initial head page, then attach the rest of the pages
+    // Need to create n empty pages, they occupy frames until they are replaced
+    virtual_page *head_page = init_page(ctx, -1, (char*)ctx->vm_start + ctx->page_size, 0, 1);
+    circular_enqueue(queue, head_page);
+    ctx->resident_pages++;
+
+    // Attach empty pages to head page
+    int i = 0;
+    for (i = 0; i < n-1; i++) {
+        void* page_start_addr = (char*)ctx->vm_start + (size_t)i * ctx->page_size;
+        virtual_page *new_page = init_page(ctx, -1, page_start_addr, 0, 1);
+        circular_enqueue(queue, new_page);
+        ctx->resident_pages++;
+    }
+}
+
+// Inserts a page just behind the hand, where the last victim used to be
+void circular_enqueue(virtual_page_queue* queue, virtual_page* page) {
+    if (queue->hand == NULL) {
+        page->next = page;
+        page->prev = page;
+        queue->hand = page;
+    } else {
+        page->next = queue->hand;
+        page->prev = queue->hand->prev;
+        queue->hand->prev->next = page;
+        queue->hand->prev = page;
+    }
+    queue->size++;
+}
+
+// Unlinks a page from the ring, moving the hand past it if needed
+void circular_remove(virtual_page_queue* queue, virtual_page* page) {
+    if (page->next == page) {
+        queue->hand = NULL;
+    } else {
+        if (queue->hand == page) {
+            queue->hand = page->next;
+        }
+        page->prev->next = page->next;
+        page->next->prev = page->prev;
+    }
+    page->next = NULL;
+    page->prev = NULL;
+    queue->size--;
+}
+
+static void* clock_policy_init(mm_context* ctx, int n_frames) {
+    virtual_page_queue *queue = new_queue();
+    clock_init(ctx, queue, n_frames);
+    return queue;
+}
+
+static void clock_on_fault(void* state, virtual_page* page) {
+    page->referenced = 1;
+    circular_enqueue(state, page);
+}
+
+static void clock_on_write(void* state, virtual_page* page) {
+    page->referenced = 1;
+}
+
+static virtual_page* clock_pick_victim(void* state, int incoming) {
+    virtual_page_queue *queue = state;
+    virtual_page *current = queue->hand;
+    while (current->referenced == 1) {
+        current->referenced = 0;
+        current = current->next;
+        queue->steps++;
+    }
+    queue->hand = current;
+    return current;
+}
+
+static void clock_on_evict(void* state, virtual_page* page) {
+    circular_remove(state, page);
+}
+
+static void clock_report(void* state, mm_stats* stats) {
+    stats->hand_steps += ((virtual_page_queue*)state)->steps;
+}
+
+// LRU: like FIFO, but a write moves the page back to the most recently used end
+
+static void lru_on_write(void* state, virtual_page* page) {
+    queue_remove(state, page);
+    enqueue(state, page);
+}
+
+static void queue_destroy(void* state) {
+    free(state);
+}
+
+// Bitmap clock: the clock above, with the ring kept as an array of frame slots in ring order and the
+// referenced bits in a bitmap indexed by slot. The hand finds the next unreferenced page a 64 bit word
+// at a time, clearing the bits it passes, instead of following next pointers through the descriptors.
+// A page's slot is kept in its 'state'.
+//
+// A new page takes the free slot just behind the hand, where the list clock links it in. The free slots
+// behind the hand form one run of 'gap' slots. A page leaving the ring anywhere else leaves a hole, which
+// joins the run when the hand reaches it. While the run is not empty the hand moves each page it passes
+// down into the run, so the pages keep their ring order, and only an empty run is scanned by words. The run
+// is empty whenever a fault evicts its own victim. When a page has to go in while the run is empty but
+// there are holes elsewhere, or the frame budget grew past the array, the ring is compacted into a new
+// array that starts at the hand. Victims, and so all counts, are the same as with the list clock.
+
+typedef struct bitclock_state bitclock_state;
+struct bitclock_state {
+    mm_context *ctx;
+    virtual_page **slots;   // NULL for a free slot
+    uint64_t *referenced;
+    int capacity;
+    int size;               // pages in the ring
+    int hand;
+    int gap;                // free slots just behind the hand
+    unsigned long steps;    // pages passed by the hand, for the stats
+};
+
+static int bitclock_next(bitclock_state* s, int slot) {
+    return slot + 1 < s->capacity ? slot + 1 : 0;
+}
+
+// Slot 'distance' slots behind 'slot'
+static int bitclock_behind(bitclock_state* s, int slot, int distance) {
+    return slot >= distance ? slot - distance : slot - distance + s->capacity;
+}
+
+static void bitclock_alloc(bitclock_state* s, int capacity) {
+    s->slots = calloc(capacity, sizeof(virtual_page*));
+    s->referenced = calloc((capacity + 63) / 64, sizeof(uint64_t));
+    if (s->slots == NULL || s->referenced == NULL) {
+        printf("clock bitmap allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    s->capacity = capacity;
+}
+
+// Slots are never negative, the unsigned casts keep the bit arithmetic to shifts and masks
+static void bitclock_set(bitclock_state* s, int slot) {
+    s->referenced[(unsigned)slot / 64] |= 1ull << ((unsigned)slot % 64);
+}
+
+static int bitclock_test(bitclock_state* s, int slot) {
+    return (s->referenced[(unsigned)slot / 64] >> ((unsigned)slot % 64)) & 1;
+}
+
+static void bitclock_clear(bitclock_state* s, int slot) {
+    s->referenced[(unsigned)slot / 64] &= ~(1ull << ((unsigned)slot % 64));
+}
+
+static void bitclock_place(bitclock_state* s, virtual_page* page, int slot, int referenced) {
+    s->slots[slot] = page;
+    page->state = slot;
+    if (referenced) {
+        bitclock_set(s, slot);
+    }
+}
+
+// Same blank referenced pages as clock_init, in the same ring order
+static void* bitclock_init(mm_context* ctx, int n_frames) {
+    bitclock_state *s = calloc(1, sizeof(bitclock_state));
+    if (s == NULL) {
+        printf("clock bitmap allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    s->ctx = ctx;
+    bitclock_alloc(s, n_frames);
+
+    bitclock_place(s, init_page(ctx, -1, (char*)ctx->vm_start + ctx->page_size, 0, 1), 0, 1);
+    int i = 0;
+    for (i = 1; i < n_frames; i++) {
+        void* page_start_addr = (char*)ctx->vm_start + (size_t)(i - 1) * ctx->page_size;
+        bitclock_place(s, init_page(ctx, -1, page_start_addr, 0, 1), i, 1);
+    }
+    s->size = n_frames;
+    ctx->resident_pages += n_frames;
+    return s;
+}
+
+static void bitclock_destroy(void* state) {
+    bitclock_state *s = state;
+    free(s->slots);
+    free(s->referenced);
+    free(s);
+}
+
+// Moves the ring into a new array of at least the frame budget, in ring order from the hand,
+// with every free slot in the run behind it
+static void bitclock_compact(bitclock_state* s) {
+    virtual_page **slots = s->slots;
+    uint64_t *referenced = s->referenced;
+    int old_capacity = s->capacity;
+    int capacity = s->ctx->n_frames > s->size ? s->ctx->n_frames : s->size + 1;
+    if (capacity < old_capacity) {
+        capacity = old_capacity;
+    }
+    bitclock_alloc(s, capacity);
+
+    int n = 0;
+    int i = 0;
+    for (i = 0; i < old_capacity; i++) {
+        int slot = (s->hand + i) % old_capacity;
+        if (slots[slot] != NULL) {
+            bitclock_place(s, slots[slot], n++, (referenced[(unsigned)slot / 64] >> ((unsigned)slot % 64)) & 1);
+        }
+    }
+    s->hand = 0;
+    s->gap = capacity - n;
+    free(slots);
+    free(referenced);
+}
+
+static void bitclock_on_fault(void* state, virtual_page* page) {
+    bitclock_state *s = state;
+    if (s->gap == 0) {
+        bitclock_compact(s);
+    }
+    bitclock_place(s, page, bitclock_behind(s, s->hand, s->gap), 1);
+    s->gap--;
+    s->size++;
+}
+
+static void bitclock_on_write(void* state, virtual_page* page) {
+    bitclock_set(state, page->state);
+}
+
+// Clears the referenced bits from the hand up to the first slot without one, a word at a time,
+// and returns that slot
+static int bitclock_scan(bitclock_state* s) {
+    int i = s->hand;
+    while (1) {
+        int w = (unsigned)i / 64;
+        uint64_t from = ~0ull << ((unsigned)i % 64);
+        uint64_t clear = ~s->referenced[w] & from;
+        if (clear != 0) {
+            int found = w * 64 + __builtin_ctzll(clear);
+            if (found < s->capacity) {
+                s->referenced[w] &= ~(from & ((1ull << ((unsigned)found % 64)) - 1));
+                s->steps += found - i;
+                return found;
+            }
+            // Bits past the last slot are never set, wrap around
+        }
+        int end = (w + 1) * 64 < s->capacity ? (w + 1) * 64 : s->capacity;
+        s->referenced[w] &= ~from;
+        s->steps += end - i;
+        i = end < s->capacity ? end : 0;
+    }
+}
+
+static virtual_page* bitclock_pick_victim(void* state, int incoming) {
+    bitclock_state *s = state;
+    while (1) {
+        if (s->gap == 0) {
+            s->hand = bitclock_scan(s);
+        }
+        virtual_page *page = s->slots[s->hand];
+        if (page == NULL) {
+            // A hole joins the run behind the hand
+            s->gap++;
+        } else if (!bitclock_test(s, s->hand)) {
+            return page;
+        } else {
+            bitclock_clear(s, s->hand);
+            s->slots[s->hand] = NULL;
+            bitclock_place(s, page, bitclock_behind(s, s->hand, s->gap), 0);
+            s->steps++;
+        }
+        s->hand = bitclock_next(s, s->hand);
+    }
+}
+
+static void bitclock_on_evict(void* state, virtual_page* page) {
+    bitclock_state *s = state;
+    int slot = page->state;
+    s->slots[slot] = NULL;
+    bitclock_clear(s, slot);
+    s->size--;
+    if (slot == s->hand) {
+        s->gap++;
+        s->hand = bitclock_next(s, slot);
+    }
+    // Holes right in front of the run belong to it
+    while (s->gap < s->capacity - s->size && s->slots[bitclock_behind(s, s->hand, s->gap + 1)] == NULL) {
+        s->gap++;
+    }
+}
+
+static void bitclock_report(void* state, mm_stats* stats) {
+    stats->hand_steps += ((bitclock_state*)state)->steps;
+}
+
+// 2Q (Johnson and Shasha): new pages enter a FIFO (A1in). Pages evicted from A1in are
+// remembered in a ghost list (A1out), and a page that faults again while it is remembered
+// goes to the main LRU queue (Am).
+
+#define TWOQ_A1IN 1
+#define TWOQ_AM 2
+
+typedef struct twoq_state twoq_state;
+struct twoq_state {
+    virtual_page_queue a1in;
+    virtual_page_queue am;
+    ghost_list a1out;
+    int kin;
+    int ghost_hit;
+    virtual_page *victim;   // last pick_victim result, and the page it was picked for
+    int incoming;
+};
+
+static void* twoq_init(mm_context* ctx, int n_frames) {
+    twoq_state *s = calloc(1, sizeof(twoq_state));
+    if (s == NULL) {
+        printf("2q allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    s->kin = n_frames / 4 > 0 ? n_frames / 4 : 1;
+    s->ghost_hit = -1;
+    ghost_init(&s->a1out, n_frames / 2);
+    return s;
+}
+
+static void twoq_resize(void* state, int n_frames) {
+    twoq_state *s = state;
+    s->kin = n_frames / 4 > 0 ? n_frames / 4 : 1;
+    ghost_resize(&s->a1out, n_frames / 2);
+}
+
+static void twoq_destroy(void* state) {
+    twoq_state *s = state;
+    ghost_destroy(&s->a1out);
+    free(s);
+}
+
+static void twoq_on_fault(void* state, virtual_page* page) {
+    twoq_state *s = state;
+    int hit = s->ghost_hit == page->number || ghost_remove(&s->a1out, page->number);
+    s->ghost_hit = -1;
+    if (hit) {
+        page->state = TWOQ_AM;
+        enqueue(&s->am, page);
+    } else {
+        page->state = TWOQ_A1IN;
+        enqueue(&s->a1in, page);
+    }
+}
+
+static void twoq_on_write(void* state, virtual_page* page) {
+    twoq_state *s = state;
+    if (page->state == TWOQ_AM) {
+        queue_remove(&s->am, page);
+        enqueue(&s->am, page);
+    }
+}
+
+static virtual_page* twoq_pick_victim(void* state, int incoming) {
+    twoq_state *s = state;
+    s->incoming = incoming;
+    if (s->a1in.size > 0 && (s->a1in.size > s->kin || s->am.size == 0)) {
+        s->victim = s->a1in.head;
+    } else {
+        s->victim = s->am.head;
+    }
+    return s->victim;
+}
+
+static void twoq_report(void* state, mm_stats* stats) {
+    stats->lookup_steps += ((twoq_state*)state)->a1out.steps;
+}
+
+static void twoq_on_remove(void* state, virtual_page* page) {
+    twoq_state *s = state;
+    if (page == s->victim) {
+        s->victim = NULL;
+    }
+    queue_remove(page->state == TWOQ_A1IN ? &s->a1in : &s->am, page);
+}
+
+static void twoq_on_evict(void* state, virtual_page* page) {
+    twoq_state *s = state;
+    if (page == s->victim && s->incoming >= 0 && ghost_remove(&s->a1out, s->incoming)) {
+        s->ghost_hit = s->incoming;
+    }
+    s->victim = NULL;
+    if (page->state == TWOQ_A1IN) {
+        queue_remove(&s->a1in, page);
+        ghost_push(&s->a1out, page->number);
+    } else {
+        queue_remove(&s->am, page);
+    }
+}
+
+// ARC (Megiddo and Modha): T1 holds pages seen once, T2 pages seen at least twice, and the
+// ghost lists B1/B2 remember pages recently evicted from each. Ghost hits move the target
+// size of T1 ('p') towards whichever list would have kept the page.
+
+#define ARC_T1 1
+#define ARC_T2 2
+
+typedef struct arc_state arc_state;
+struct arc_state {
+    virtual_page_queue t1;
+    virtual_page_queue t2;
+    ghost_list b1;
+    ghost_list b2;
+    int c;
+    int p;
+    int ghost_hit;
+    virtual_page *victim;   // last pick_victim result, and the page it was picked for
+    int incoming;
+};
+
+static void* arc_init(mm_context* ctx, int n_frames) {
+    arc_state *s = calloc(1, sizeof(arc_state));
+    if (s == NULL) {
+        printf("arc allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    s->c = n_frames;
+    s->p = 0;
+    s->ghost_hit = -1;
+    ghost_init(&s->b1, n_frames);
+    ghost_init(&s->b2, 2 * n_frames);
+    return s;
+}
+
+// T1 and T2 may hold more than 'c' pages right after a shrink, pick_victim drains them
+static void arc_resize(void* state, int n_frames) {
+    arc_state *s = state;
+    s->c = n_frames;
+    if (s->p > s->c) {
+        s->p = s->c;
+    }
+    ghost_resize(&s->b1, n_frames);
+    ghost_resize(&s->b2, 2 * n_frames);
+}
+
+static void arc_destroy(void* state) {
+    arc_state *s = state;
+    ghost_destroy(&s->b1);
+    ghost_destroy(&s->b2);
+    free(s);
+}
+
+// Returns 1 if a page is remembered in B1, 2 if it is in B2 and 0 if it is not remembered
+static int arc_ghost_find(arc_state* s, int number) {
+    if (ghost_contains(&s->b1, number)) {
+        return 1;
+    }
+    return ghost_contains(&s->b2, number) ? 2 : 0;
+}
+
+// 'p' moved towards the list a ghost hit came from
+static int arc_target(arc_state* s, int hit) {
+    if (hit == 1) {
+        int delta = s->b2.size > s->b1.size ? s->b2.size / s->b1.size : 1;
+        return s->p + delta < s->c ? s->p + delta : s->c;
+    }
+    if (hit == 2) {
+        int delta = s->b1.size > s->b2.size ? s->b1.size / s->b2.size : 1;
+        return s->p - delta > 0 ? s->p - delta : 0;
+    }
+    return s->p;
+}
+
+// Moves 'p' towards the list a ghost hit came from and forgets the ghost.
+// Returns 1 for a hit in B1, 2 for a hit in B2 and 0 if the page is not remembered.
+static int arc_ghost_hit(arc_state* s, int number) {
+    int hit = arc_ghost_find(s, number);
+    if (hit) {
+        s->p = arc_target(s, hit);
+        ghost_remove(hit == 1 ? &s->b1 : &s->b2, number);
+    }
+    return hit;
+}
+
+// Whether T1 alone fills the cache, then its LRU page is dropped without being remembered
+static int arc_t1_full(arc_state* s, int hit) {
+    return !hit && s->t1.size >= s->c;
+}
+
+static virtual_page* arc_pick_victim(void* state, int incoming) {
+    arc_state *s = state;
+    int hit = arc_ghost_find(s, incoming);
+    int p = arc_target(s, hit);
+
+    s->incoming = incoming;
+    if (arc_t1_full(s, hit) || (s->t1.size > 0 && (s->t1.size > p || (hit == 2 && s->t1.size == p) || s->t2.size == 0))) {
+        s->victim = s->t1.head;
+    } else {
+        s->victim = s->t2.head;
+    }
+    return s->victim;
+}
+
+// Does what choosing the victim for the incoming page implies, now that the victim is leaving:
+// the ghost hit of the incoming page, or making room in B1/B2. Returns 0 if the victim is not remembered.
+static int arc_replace(arc_state* s) {
+    int hit = arc_ghost_hit(s, s->incoming);
+    if (hit) {
+        s->ghost_hit = s->incoming;
+    } else if (arc_t1_full(s, hit)) {
+        return 0;
+    } else if (s->t1.size + s->b1.size >= s->c) {
+        ghost_pop(&s->b1);
+    } else if (s->t1.size + s->t2.size + s->b1.size + s->b2.size >= 2 * s->c) {
+        ghost_pop(&s->b2);
+    }
+    return 1;
+}
+
+static void arc_on_evict(void* state, virtual_page* page) {
+    arc_state *s = state;
+    int remember = page == s->victim ? arc_replace(s) : 1;
+    s->victim = NULL;
+    if (page->state == ARC_T1) {
+        queue_remove(&s->t1, page);
+        if (remember) {
+            ghost_push(&s->b1, page->number);
+        }
+    } else {
+        queue_remove(&s->t2, page);
+        if (remember) {
+            ghost_push(&s->b2, page->number);
+        }
+    }
+}
+
+static void arc_on_remove(void* state, virtual_page* page) {
+    arc_state *s = state;
+    if (page == s->victim) {
+        s->victim = NULL;
+    }
+    queue_remove(page->state == ARC_T1 ? &s->t1 : &s->t2, page);
+}
+
+static void arc_report(void* state, mm_stats* stats) {
+    arc_state *s = state;
+    stats->lookup_steps += s->b1.steps + s->b2.steps;
+}
+
+static void arc_on_fault(void* state, virtual_page* page) {
+    arc_state *s = state;
+    int hit = s->ghost_hit == page->number || arc_ghost_hit(s, page->number);
+    s->ghost_hit = -1;
+    if (hit) {
+        page->state = ARC_T2;
+        enqueue(&s->t2, page);
+    } else {
+        page->state = ARC_T1;
+        enqueue(&s->t1, page);
+    }
+}
+
+static void arc_on_write(void* state, virtual_page* page) {
+    arc_state *s = state;
+    queue_remove(page->state == ARC_T1 ? &s->t1 : &s->t2, page);
+    page->state = ARC_T2;
+    enqueue(&s->t2, page);
+}
+
+// CLOCK-Pro (Jiang, Chen and Zhang): resident pages are hot or cold. A new cold page
+// starts a test period; if it is referenced again during the test it is promoted to hot.
+// Cold pages evicted during their test are remembered in a ghost list, and a fault on a
+// remembered page grows the cold target 'mc', while tests that expire shrink it.
+// The cold and hot hands are kept as two queues, a hand step pops the head and either
+// acts on the page or moves it to the tail.
+
+#define CLOCKPRO_HOT 1
+#define CLOCKPRO_COLD 2
+#define CLOCKPRO_TEST 4
+
+typedef struct clockpro_state clockpro_state;
+struct clockpro_state {
+    virtual_page_queue hot;
+    virtual_page_queue cold;
+    ghost_list test;
+    int c;
+    int mc;
+    int max_mc;
+    int ghost_hit;
+    virtual_page *victim;   // last pick_victim result, and the page it was picked for
+    int incoming;
+};
+
+static void* clockpro_init(mm_context* ctx, int n_frames) {
+    clockpro_state *s = calloc(1, sizeof(clockpro_state));
+    if (s == NULL) {
+        printf("clock-pro allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    s->c = n_frames;
+    s->max_mc = n_frames > 1 ? n_frames - 1 : 1;
+    s->mc = n_frames / 2 > 0 ? n_frames / 2 : 1;
+    s->ghost_hit = -1;
+    ghost_init(&s->test, n_frames);
+    return s;
+}
+
+static void clockpro_destroy(void* state) {
+    clockpro_state *s = state;
+    ghost_destroy(&s->test);
+    free(s);
+}
+
+// Moves the hot hand until one unreferenced hot page has been demoted to cold
+static void clockpro_run_hand_hot(clockpro_state* s) {
+    while (s->hot.size > 0) {
+        virtual_page *page = dequeue(&s->hot);
+        s->hot.steps++;
+        if (page->referenced) {
+            page->referenced = 0;
+            enqueue(&s->hot, page);
+        } else {
+            page->state = CLOCKPRO_COLD;
+            enqueue(&s->cold, page);
+            return;
+        }
+    }
+}
+
+static void clockpro_balance(clockpro_state* s) {
+    while (s->hot.size > 0 && s->hot.size > s->c - s->mc) {
+        clockpro_run_hand_hot(s);
+    }
+}
+
+static void clockpro_resize(void* state, int n_frames) {
+    clockpro_state *s = state;
+    s->c = n_frames;
+    s->max_mc = n_frames > 1 ? n_frames - 1 : 1;
+    if (s->mc > s->max_mc) {
+        s->mc = s->max_mc;
+    }
+    ghost_resize(&s->test, n_frames);
+    clockpro_balance(s);
+}
+
+static void clockpro_on_fault(void* state, virtual_page* page) {
+    clockpro_state *s = state;
+    int hit = s->ghost_hit == page->number || ghost_remove(&s->test, page->number);
+    s->ghost_hit = -1;
+    if (hit) {
+        // Reused within its test period
+        if (s->mc < s->max_mc) {
+            s->mc++;
+        }
+        page->state = CLOCKPRO_HOT;
+        enqueue(&s->hot, page);
+        clockpro_balance(s);
+    } else {
+        page->state = CLOCKPRO_COLD | CLOCKPRO_TEST;
+        enqueue(&s->cold, page);
+    }
+}
+
+static void clockpro_on_write(void* state, virtual_page* page) {
+    page->referenced = 1;
+}
+
+static virtual_page* clockpro_pick_victim(void* state, int incoming) {
+    clockpro_state *s = state;
+    s->incoming = incoming;
+    while (1) {
+        if (s->cold.size == 0) {
+            clockpro_run_hand_hot(s);
+            continue;
+        }
+
+        virtual_page *page = s->cold.head;
+        if (!page->referenced) {
+            s->victim = page;
+            return page;
+        }
+
+        page->referenced = 0;
+        dequeue(&s->cold);
+        s->cold.steps++;
+        if (page->state & CLOCKPRO_TEST) {
+            page->state = CLOCKPRO_HOT;
+            enqueue(&s->hot, page);
+            clockpro_balance(s);
+        } else {
+            page->state |= CLOCKPRO_TEST;
+            enqueue(&s->cold, page);
+        }
+    }
+}
+
+static void clockpro_on_evict(void* state, virtual_page* page) {
+    clockpro_state *s = state;
+    if (page == s->victim && s->incoming >= 0 && ghost_remove(&s->test, s->incoming)) {
+        s->ghost_hit = s->incoming;
+    }
+    s->victim = NULL;
+    if (page->state & CLOCKPRO_HOT) {
+        queue_remove(&s->hot, page);
+        return;
+    }
+
+    queue_remove(&s->cold, page);
+    if (page->state & CLOCKPRO_TEST) {
+        // Remembering this page may end the oldest test period unused
+        if (ghost_push(&s->test, page->number) && s->mc > 1) {
+            s->mc--;
+        }
+    }
+}
+
+static void clockpro_on_remove(void* state, virtual_page* page) {
+    clockpro_state *s = state;
+    if (page == s->victim) {
+        s->victim = NULL;
+    }
+    queue_remove(page->state & CLOCKPRO_HOT ? &s->hot : &s->cold, page);
+}
+
+static void clockpro_report(void* state, mm_stats* stats) {
+    clockpro_state *s = state;
+    stats->hand_steps += s->hot.steps + s->cold.steps;
+    stats->lookup_steps += s->test.steps;
+}
+
+// Ghost lists
+
+static ghost_entry **ghost_bucket(ghost_list* g, int number) {
+    unsigned int h = (unsigned int)number * 2654435761u;
+    return &g->buckets[(h ^ (h >> 16)) & g->bucket_mask];
+}
+
+void ghost_init(ghost_list* g, int capacity) {
+    if (capacity < 1) {
+        capacity = 1;
+    }
+    int n_buckets = 1;
+    while (n_buckets < 2 * capacity) {
+        n_buckets <<= 1;
+    }
+
+    g->entries = malloc(capacity * sizeof(ghost_entry));
+    g->buckets = calloc(n_buckets, sizeof(ghost_entry*));
+    if (g->entries == NULL || g->buckets == NULL) {
+        printf("ghost list allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    g->bucket_mask = n_buckets - 1;
+    g->head = NULL;
+    g->tail = NULL;
+    g->size = 0;
+    g->capacity = capacity;
+    g->allocated = capacity;
+    g->steps = 0;
+
+    g->free = NULL;
+    int i = 0;
+    for (i = 0; i < capacity; i++) {
+        g->entries[i].next = g->free;
+        g->free = &g->entries[i];
+    }
+}
+
+void ghost_destroy(ghost_list* g) {
+    free(g->entries);
+    free(g->buckets);
+    g->entries = NULL;
+    g->buckets = NULL;
+}
+
+// Changes the capacity, dropping the oldest entries that no longer fit. Growing past
+// the arena moves the remembered page numbers, oldest first, into a new one.
+void ghost_resize(ghost_list* g, int capacity) {
+    if (capacity < 1) {
+        capacity = 1;
+    }
+    while (g->size > capacity) {
+        ghost_pop(g);
+    }
+    if (capacity <= g->allocated) {
+        g->capacity = capacity;
+        return;
+    }
+
+    ghost_list old = *g;
+    ghost_init(g, capacity);
+    g->steps = old.steps;
+    ghost_entry *entry = NULL;
+    for (entry = old.head; entry != NULL; entry = entry->next) {
+        ghost_push(g, entry->number);
+    }
+    ghost_destroy(&old);
+}
+
+static ghost_entry *ghost_find(ghost_list* g, int number) {
+    ghost_entry *entry = *ghost_bucket(g, number);
+    while (entry != NULL && entry->number != number) {
+        entry = entry->hash_next;
+        g->steps++;
+    }
+    return entry;
+}
+
+static void ghost_unlink(ghost_list* g, ghost_entry* entry) {
+    ghost_entry **link = ghost_bucket(g, entry->number);
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+        g->steps++;
+    }
+    *link = entry->hash_next;
+
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        g->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        g->tail = entry->prev;
+    }
+    g->size--;
+
+    entry->next = g->free;
+    g->free = entry;
+}
+
+int ghost_contains(ghost_list* g, int number) {
+    return ghost_find(g, number) != NULL;
+}
+
+// Forgets a page number, returns 1 if it was remembered
+int ghost_remove(ghost_list* g, int number) {
+    ghost_entry *entry = ghost_find(g, number);
+    if (entry == NULL) {
+        return 0;
+    }
+    ghost_unlink(g, entry);
+    return 1;
+}
+
+// Forgets the oldest page number
+void ghost_pop(ghost_list* g) {
+    if (g->head != NULL) {
+        ghost_unlink(g, g->head);
+    }
+}
+
+// Remembers a page number as the newest entry, returns 1 if the oldest entry had to be dropped
+int ghost_push(ghost_list* g, int number) {
+    int dropped = 0;
+    if (g->size >= g->capacity) {
+        ghost_pop(g);
+        dropped = 1;
+    }
+
+    ghost_entry *entry = g->free;
+    g->free = entry->next;
+    entry->number = number;
+    entry->next = NULL;
+    entry->prev = g->tail;
+    if (g->tail != NULL) {
+        g->tail->next = entry;
+    } else {
+        g->head = entry;
+    }
+    g->tail = entry;
+
+    ghost_entry **bucket = ghost_bucket(g, number);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    g->size++;
+    return dropped;
+}
+
+// Policy tables, indexed by the 'policy' argument of mm_init
+
+mm_policy FIFO_POLICY = {"fifo", fifo_init, queue_destroy, fifo_on_fault, no_op, fifo_pick_victim, fifo_on_evict, no_report, no_resize, fifo_on_evict};
+mm_policy CLOCK_POLICY = {"clock", clock_policy_init, queue_destroy, clock_on_fault, clock_on_write, clock_pick_victim, clock_on_evict, clock_report, no_resize, clock_on_evict};
+mm_policy LRU_POLICY = {"lru", fifo_init, queue_destroy, fifo_on_fault, lru_on_write, fifo_pick_victim, fifo_on_evict, no_report, no_resize, fifo_on_evict};
+mm_policy TWOQ_POLICY = {"2q", twoq_init, twoq_destroy, twoq_on_fault, twoq_on_write, twoq_pick_victim, twoq_on_evict, twoq_report, twoq_resize, twoq_on_remove};
+mm_policy ARC_POLICY = {"arc", arc_init, arc_destroy, arc_on_fault, arc_on_write, arc_pick_victim, arc_on_evict, arc_report, arc_resize, arc_on_remove};
+mm_policy CLOCKPRO_POLICY = {"clock-pro", clockpro_init, clockpro_destroy, clockpro_on_fault, clockpro_on_write, clockpro_pick_victim, clockpro_on_evict, clockpro_report, clockpro_resize, clockpro_on_remove};
+mm_policy BITCLOCK_POLICY = {"clock-bitmap", bitclock_init, bitclock_destroy, bitclock_on_fault, bitclock_on_write, bitclock_pick_victim, bitclock_on_evict, bitclock_report, no_resize, bitclock_on_evict};
+
+mm_policy *find_policy(int policy) {
+    switch (policy) {
+        case MM_POLICY_FIFO: return &FIFO_POLICY;
+        case MM_POLICY_CLOCK: return &CLOCK_POLICY;
+        case MM_POLICY_LRU: return &LRU_POLICY;
+        case MM_POLICY_2Q: return &TWOQ_POLICY;
+        case MM_POLICY_ARC: return &ARC_POLICY;
+        case MM_POLICY_CLOCK_PRO: return &CLOCKPRO_POLICY;
+        case MM_POLICY_CLOCK_BITMAP: return &BITCLOCK_POLICY;
+        default: return NULL;
+    }
+}
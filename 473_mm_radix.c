@@ -0,0 +1,114 @@
+#include "473_mm_internal.h"
+#include <string.h>
+
+// Radix index
+//
+// The arena is reserved with MAP_NORESERVE for the largest tree the key space can need, one leaf for every
+// RADIX_FANOUT keys plus the interior nodes above them, so only the nodes that are created use memory.
+// Nodes are created under r->lock by bumping 'arena_used' and published with a release store, which makes
+// radix_create safe to call from the SIGSEGV handler.
+
+#define RADIX_ALIGN 64
+
+static size_t radix_node_size(radix* r, int level) {
+    size_t size = level == 0 ? RADIX_FANOUT * r->entry_size : RADIX_FANOUT * sizeof(void*);
+    return (size + RADIX_ALIGN - 1) & ~(size_t)(RADIX_ALIGN - 1);
+}
+
+// Sets up an index for keys 0 to n_keys - 1
+int radix_init(radix* r, long n_keys, size_t entry_size) {
+    memset(r, 0, sizeof(radix));
+    r->entry_size = entry_size;
+
+    // Enough levels for the root to cover every key, and the number of nodes each level can have
+    long nodes = (n_keys + RADIX_FANOUT - 1) / RADIX_FANOUT;
+    size_t arena_size = nodes * radix_node_size(r, 0);
+    while (nodes > 1) {
+        nodes = (nodes + RADIX_FANOUT - 1) / RADIX_FANOUT;
+        r->levels++;
+        arena_size += nodes * radix_node_size(r, r->levels);
+    }
+    if (arena_size == 0) {
+        arena_size = radix_node_size(r, 0);
+    }
+
+    r->arena = mmap(NULL, arena_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (r->arena == MAP_FAILED) {
+        r->arena = NULL;
+        return -1;
+    }
+    r->arena_size = arena_size;
+    r->root = r->arena;
+    r->arena_used = radix_node_size(r, r->levels);
+    return 0;
+}
+
+// Slow path of radix_get: creates the missing nodes on the path to 'key'
+void *radix_create(radix* r, int key) {
+    spin_lock(&r->lock);
+    void *node = r->root;
+    int level = 0;
+    for (level = r->levels; level > 0; level--) {
+        _Atomic(void*) *children = node;
+        int index = (key >> (level * RADIX_BITS)) & (RADIX_FANOUT - 1);
+        void *child = atomic_load_explicit(&children[index], memory_order_acquire);
+        if (child == NULL) {
+            size_t size = radix_node_size(r, level - 1);
+            if (r->arena_used + size > r->arena_size) {
+                // Cannot happen, the arena has room for every node
+                spin_unlock(&r->lock);
+                return NULL;
+            }
+            // Arena memory is zero until it is first used
+            child = r->arena + r->arena_used;
+            r->arena_used += size;
+            atomic_store_explicit(&children[index], child, memory_order_release);
+        }
+        node = child;
+    }
+    spin_unlock(&r->lock);
+    return (char*)node + (size_t)(key & (RADIX_FANOUT - 1)) * r->entry_size;
+}
+
+// Returns the first key from 'key' up to 'limit' - 1 whose leaf exists, or -1 if there is none.
+// Whole subtrees that were never created are skipped.
+int radix_next(radix* r, int key, int limit) {
+    while (key < limit) {
+        void *node = r->root;
+        int level = 0;
+        for (level = r->levels; level > 0; level--) {
+            int index = (key >> (level * RADIX_BITS)) & (RADIX_FANOUT - 1);
+            node = atomic_load_explicit(&((_Atomic(void*)*)node)[index], memory_order_acquire);
+            if (node == NULL) {
+                break;
+            }
+        }
+        if (node != NULL) {
+            return key;
+        }
+        // Move to the first key of the next subtree at this level
+        long span = 1L << (level * RADIX_BITS);
+        long next = ((long)key / span + 1) * span;
+        if (next >= limit) {
+            break;
+        }
+        key = (int)next;
+    }
+    return -1;
+}
+
+// Bytes of memory the created nodes take
+size_t radix_bytes(radix* r) {
+    spin_lock(&r->lock);
+    size_t used = r->arena_used;
+    spin_unlock(&r->lock);
+    return used;
+}
+
+void radix_destroy(radix* r) {
+    if (r->arena != NULL) {
+        munmap(r->arena, r->arena_size);
+    }
+    r->arena = NULL;
+    r->root = NULL;
+}
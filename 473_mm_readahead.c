@@ -0,0 +1,186 @@
+#include "473_mm_internal.h"
+
+// Readahead
+//
+// Every region tracks one stream of faults. When a fault lands 'stride' pages after the previous one
+// the stream is confirmed: the pages prefetched for it since the last confirmation count as used,
+// and the next 'window' pages of the stream are made resident along with the faulting page, so the
+// scan does not fault on them. A fault anywhere else starts a new stream with a closed window.
+//
+// Prefetched pages go through the policy exactly like faulted ones, and each takes a frame the same
+// way, evicting a victim when the frames are full. The frames of the whole window are taken before
+// the faulting page and the prefetched pages join the policy, so none of them can be picked as a
+// victim, and the window is capped at half of the frames. Readahead stops early at a page that is
+// already resident or busy, or when the victim it would need is busy, which is then another thread's.
+//
+// A read of a prefetched page does not fault, so a page only counts as used when the stream moves
+// past it or when it takes a write fault.
+//
+// A fault on a page advised MM_ADVICE_SEQUENTIAL skips the detection: it prefetches a full window of the
+// following advised pages right away, even with readahead off. Those prefetches are counted as advised ones.
+// Faults on pages advised MM_ADVICE_RANDOM never prefetch.
+
+void readahead_init(mm_context* ctx, int max_window) {
+    readahead_state *ra = &ctx->readahead;
+
+    ra->limit = max_window;
+    if (max_window > READAHEAD_MAX_WINDOW) {
+        max_window = READAHEAD_MAX_WINDOW;
+    }
+    if (max_window > ctx->n_frames / 2) {
+        max_window = ctx->n_frames / 2;
+    }
+    ra->max_window = max_window > 0 ? max_window : 0;
+    ra->window = 0;
+    ra->stride = 0;
+    ra->last = -1;
+    ra->pending = 0;
+}
+
+// Credits the pages prefetched for the stream since it was last confirmed
+static void readahead_credit(mm_context* ctx) {
+    readahead_state *ra = &ctx->readahead;
+    int i = 0;
+    for (i = 0; i < ra->pending; i++) {
+        page_entry *entry = page_entry_find(ctx, ra->last - i * ra->stride);
+        virtual_page *page = entry == NULL ? NULL : entry->page;
+        if (page != NULL && page->prefetched) {
+            prefetch_used(ctx, page);
+        }
+    }
+}
+
+// Counts a prefetched page as used
+void prefetch_used(mm_context* ctx, virtual_page* page) {
+    if (page->prefetched == PREFETCH_ADVISED) {
+        atomic_fetch_add_explicit(&ctx->advised_faults_avoided, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&ctx->faults_avoided, 1, memory_order_relaxed);
+    }
+    page->prefetched = 0;
+}
+
+// Feeds a fault on 'page_number' to the stream detector and prefetches the next pages of the stream.
+// 'advice' holds the page's ADVICE_* flags.
+// Called with ctx->policy_lock and the page's lock held, after the page became resident and before it
+// is given to the policy. The prefetched pages are returned locked in 'pages', and the pages they
+// displaced in 'victims'. They are given to the policy by readahead_admit. Returns the number of pages
+// prefetched.
+int readahead_collect(mm_context* ctx, int page_number, int advice, virtual_page** pages, evicted_page* victims) {
+    readahead_state *ra = &ctx->readahead;
+    int delta = page_number - ra->last;
+    int sequential = advice & ADVICE_SEQUENTIAL;
+
+    if (ra->last < 0 && !sequential) {
+        // First fault of the region
+        ra->last = page_number;
+        return 0;
+    }
+    if (delta == 0) {
+        return 0;
+    }
+    if (ra->last >= 0 && delta == ra->stride) {
+        readahead_credit(ctx);
+        ra->window = ra->window == 0 ? READAHEAD_INITIAL_WINDOW : ra->window * 2;
+        if (ra->window > ra->max_window) {
+            ra->window = ra->max_window;
+        }
+    } else {
+        ra->stride = delta;
+        ra->window = 0;
+    }
+    if (sequential) {
+        ra->stride = 1;
+        ra->window = ctx->n_frames / 2 < READAHEAD_MAX_WINDOW ? ctx->n_frames / 2 : READAHEAD_MAX_WINDOW;
+    }
+
+    int n = 0;
+    while (n < ra->window) {
+        int number = page_number + (n + 1) * ra->stride;
+        if (number < 0 || number >= ctx->n_pages) {
+            break;
+        }
+        page_entry *entry = page_entry_get(ctx, number);
+        if (sequential && !(entry->advice & ADVICE_SEQUENTIAL)) {
+            break;
+        }
+        if (entry->page != NULL || !spin_trylock(&entry->lock)) {
+            break;
+        }
+
+        victims[n].start = NULL;
+        if (ctx->resident_pages >= ctx->n_frames) {
+            // Nothing on the policy's lists to evict, the other resident pages are pinned
+            if (ctx->resident_pages - ctx->pinned.size - (n + 1) <= 0) {
+                spin_unlock(&entry->lock);
+                break;
+            }
+            virtual_page *victim_page = ctx->policy_ops->pick_victim(ctx->policy_state, number);
+            if (victim_page->number >= 0 && !spin_trylock(&page_entry_get(ctx, victim_page->number)->lock)) {
+                spin_unlock(&entry->lock);
+                break;
+            }
+            detach_page(ctx, victim_page, &victims[n]);
+        }
+
+        void* page_start_addr = (char*)ctx->vm_start + (size_t)number * ctx->page_size;
+        virtual_page *page = init_page(ctx, number, page_start_addr, 0, 0);
+        page->prefetched = sequential ? PREFETCH_ADVISED : PREFETCH_READAHEAD;
+        entry->page = page;
+        ctx->resident_pages++;
+        pages[n++] = page;
+    }
+
+    ra->last = page_number + n * ra->stride;
+    ra->pending = n;
+    atomic_fetch_add_explicit(sequential ? &ctx->advised_prefetches : &ctx->prefetches, n, memory_order_relaxed);
+    return n;
+}
+
+// Gives the pages of readahead_collect to the policy, after the faulting page. Called with ctx->policy_lock held.
+void readahead_admit(mm_context* ctx, virtual_page** pages, int n) {
+    int i = 0;
+    for (i = 0; i < n; i++) {
+        ctx->policy_ops->on_fault(ctx->policy_state, pages[i]);
+        if (page_entry_get(ctx, pages[i]->number)->advice & ADVICE_PIN) {
+            page_pin(ctx, pages[i]);
+        }
+    }
+}
+
+// Finishes a readahead once ctx->policy_lock is dropped: releases the victims, gives the faulting
+// page 'prot', makes the prefetched pages readable and unlocks them.
+void readahead_map(mm_context* ctx, virtual_page* faulted, int prot, virtual_page** pages, evicted_page* victims, int n) {
+    int i = 0;
+    for (i = 0; i < n; i++) {
+        if (victims[i].start != NULL) {
+            release_evicted(ctx, &victims[i]);
+        }
+        if (ctx->swap != NULL && ctx->backend == MM_BACKEND_SIGSEGV) {
+            swap_in(ctx, pages[i]);
+        }
+    }
+
+    // A forward or backward scan covers one contiguous range, which includes
+    // the faulting page unless it is being written
+    int stride = pages[0]->number - faulted->number;
+    if (ctx->backend == MM_BACKEND_SIGSEGV && (stride == 1 || stride == -1)) {
+        virtual_page *first = stride == 1 ? pages[0] : pages[n - 1];
+        if (prot == PROT_READ) {
+            first = stride == 1 ? faulted : first;
+            protect_range(ctx, first->start, (size_t)(n + 1) * ctx->page_size, PROT_READ);
+        } else {
+            page_protect(ctx, faulted, prot);
+            protect_range(ctx, first->start, (size_t)n * ctx->page_size, PROT_READ);
+        }
+    } else {
+        page_protect(ctx, faulted, prot);
+        for (i = 0; i < n; i++) {
+            page_protect(ctx, pages[i], PROT_READ);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        spin_unlock(&page_entry_get(ctx, pages[i]->number)->lock);
+    }
+}
@@ -0,0 +1,263 @@
+#include "473_mm_internal.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+// Background reclaimer and frame budget resizing
+//
+// A thread per region keeps the number of free frames between the 'free_low' and 'free_high' watermarks,
+// so a fault usually finds a free frame and does no eviction work itself. A fault that leaves fewer than
+// 'free_low' frames free wakes the thread with sem_post, which is safe to call from the SIGSEGV handler.
+//
+// The thread evicts in batches of up to RECLAIM_BATCH pages. Victims are chosen and detached under
+// ctx->policy_lock exactly like in the fault path, then the lock is dropped and the batch is released:
+// write backs and swap outs happen here instead of in a faulting thread, and with the SIGSEGV backend
+// runs of adjacent pages are protected with a single mprotect.
+//
+// If the frames fill up anyway, the fault path still evicts a victim itself.
+//
+// With 'dedup_scan' the thread also wakes up every RECLAIM_IDLE_MS while it has nothing to evict, to share
+// the memory of resident pages with the same contents (dedup_scan).
+//
+// mm_set_frames changes the budget while the region is in use. Growing only adds descriptors to the pool,
+// the new frames are free and faults fill them. Shrinking lowers the budget first, so faults stop taking
+// frames, then evicts the pages over it through the policy in the same batches as the reclaimer.
+
+#define RECLAIM_BATCH 32
+#define RECLAIM_IDLE_MS 10
+
+struct reclaimer {
+    pthread_t thread;
+    sem_t wake;
+    atomic_int waking;      // a wake up is pending or the thread is working
+    atomic_int stop;
+    int low;                // the watermarks asked for, 0 for the defaults
+    int high;
+};
+
+// Evicts up to RECLAIM_BATCH pages while fewer than 'free' frames are free, returns how many were evicted
+static int evict_batch(mm_context* ctx, int free) {
+    evicted_page victims[RECLAIM_BATCH];
+    int n = 0;
+
+    spin_lock(&ctx->policy_lock);
+    while (n < RECLAIM_BATCH && ctx->resident_pages > 0 && ctx->n_frames - ctx->resident_pages < free) {
+        virtual_page *victim_page = ctx->policy_ops->pick_victim(ctx->policy_state, -1);
+        // The victim is faulting right now, try again on the next wake up
+        if (victim_page->number >= 0 && !spin_trylock(&page_entry_get(ctx, victim_page->number)->lock)) {
+            break;
+        }
+        detach_page(ctx, victim_page, &victims[n++]);
+    }
+    spin_unlock(&ctx->policy_lock);
+
+    release_batch(ctx, victims, n);
+    return n;
+}
+
+static int reclaim_batch(mm_context* ctx) {
+    spin_lock(&ctx->policy_lock);
+    int free_high = ctx->free_high;
+    spin_unlock(&ctx->policy_lock);
+
+    int n = evict_batch(ctx, free_high);
+    atomic_fetch_add_explicit(&ctx->reclaimed, n, memory_order_relaxed);
+    return n;
+}
+
+// Waits for a wake up, or RECLAIM_IDLE_MS if the region has an idle scan
+static int reclaimer_wait(reclaimer* r, int scan) {
+    if (!scan) {
+        return sem_wait(&r->wake);
+    }
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += RECLAIM_IDLE_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    return sem_timedwait(&r->wake, &until);
+}
+
+static void *reclaimer_thread(void* arg) {
+    mm_context *ctx = arg;
+    reclaimer *r = ctx->reclaimer;
+    int scan = 1;
+
+    while (1) {
+        if (reclaimer_wait(r, scan) == -1) {
+            if (errno == ETIMEDOUT) {
+                scan = dedup_scan(ctx);
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (atomic_load(&r->stop)) {
+            break;
+        }
+        while (reclaim_batch(ctx) == RECLAIM_BATCH);
+        atomic_store(&r->waking, 0);
+    }
+    return NULL;
+}
+
+// Sets the watermarks from the ones asked for and the current number of frames. A watermark of 0 picks
+// the default, 1/64 of the frames for 'low' and 1/16 for 'high'. With too few frames to keep any free
+// both are 0 and the thread is never woken. Called with ctx->policy_lock held after mm_init.
+void reclaimer_watermarks(mm_context* ctx) {
+    int low = ctx->reclaimer->low;
+    int high = ctx->reclaimer->high;
+    if (low <= 0) {
+        low = ctx->n_frames / 64 > 0 ? ctx->n_frames / 64 : 1;
+    }
+    if (high <= low) {
+        high = ctx->n_frames / 16 > low ? ctx->n_frames / 16 : low + 1;
+    }
+    // Keep at least half of the frames for pages
+    if (high > ctx->n_frames / 2) {
+        high = ctx->n_frames / 2;
+    }
+    if (low >= high) {
+        low = high - 1;
+    }
+    if (low < 1) {
+        low = 0;
+        high = 0;
+    }
+    ctx->free_low = low;
+    ctx->free_high = high;
+}
+
+// Starts the thread
+int reclaimer_init(mm_context* ctx, int low, int high) {
+    reclaimer *r = calloc(1, sizeof(reclaimer));
+    if (r == NULL || sem_init(&r->wake, 0, 0) == -1) {
+        free(r);
+        return -1;
+    }
+    r->low = low;
+    r->high = high;
+    ctx->reclaimer = r;
+    reclaimer_watermarks(ctx);
+    if (pthread_create(&r->thread, NULL, reclaimer_thread, ctx) != 0) {
+        sem_destroy(&r->wake);
+        free(r);
+        ctx->reclaimer = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Called once a fault has left fewer than 'free_low' frames free
+void reclaimer_wake(mm_context* ctx) {
+    reclaimer *r = ctx->reclaimer;
+    if (!atomic_exchange(&r->waking, 1)) {
+        sem_post(&r->wake);
+    }
+}
+
+// Stops the thread. Called before the region becomes accessible again.
+void reclaimer_destroy(mm_context* ctx) {
+    reclaimer *r = ctx->reclaimer;
+    if (r == NULL) {
+        return;
+    }
+    atomic_store(&r->stop, 1);
+    sem_post(&r->wake);
+    pthread_join(r->thread, NULL);
+    sem_destroy(&r->wake);
+    free(r);
+    ctx->reclaimer = NULL;
+}
+
+// Finishes the eviction of 'n' detached pages and unlocks them. With the SIGSEGV backend and no swap store
+// there is nothing to do per page but count and protect it, so adjacent pages are protected together.
+void release_batch(mm_context* ctx, evicted_page* pages, int n) {
+    int i = 0;
+    int j = 0;
+
+    if (ctx->swap != NULL || ctx->backend != MM_BACKEND_SIGSEGV) {
+        for (i = 0; i < n; i++) {
+            release_evicted(ctx, &pages[i]);
+        }
+        return;
+    }
+
+    // Sort by page number, blank clock pages first
+    for (i = 1; i < n; i++) {
+        evicted_page page = pages[i];
+        for (j = i; j > 0 && pages[j - 1].number > page.number; j--) {
+            pages[j] = pages[j - 1];
+        }
+        pages[j] = page;
+    }
+
+    i = 0;
+    while (i < n && pages[i].number < 0) {
+        release_evicted(ctx, &pages[i++]);
+    }
+    while (i < n) {
+        j = i + 1;
+        while (j < n && pages[j].number == pages[j - 1].number + 1) {
+            j++;
+        }
+        protect_range(ctx, pages[i].start, (size_t)(j - i) * ctx->page_size, PROT_NONE);
+        for (; i < j; i++) {
+            account_evicted(ctx, &pages[i]);
+            spin_unlock(&page_entry_get(ctx, pages[i].number)->lock);
+        }
+    }
+}
+
+int mm_set_frames(int n_frames) {
+    return DEFAULT_CONTEXT == NULL ? -1 : mm_context_set_frames(DEFAULT_CONTEXT, n_frames);
+}
+
+int mm_context_set_frames(mm_context* ctx, int n_frames) {
+    if (ctx->shared != NULL) {
+        return shared_set_frames(ctx, n_frames);
+    }
+    if (n_frames < 1) {
+        return -1;
+    }
+
+    // Only this function adds descriptors, so the pool size can be read without the lock
+    pool_chunk *chunk = NULL;
+    if (n_frames > ctx->pool_size) {
+        chunk = pool_chunk_new(n_frames - ctx->pool_size);
+        if (chunk == NULL) {
+            return -1;
+        }
+    }
+
+    spin_lock(&ctx->policy_lock);
+    if (chunk != NULL) {
+        pool_add(ctx, chunk);
+    }
+    ctx->n_frames = n_frames;
+    ctx->policy_ops->resize(ctx->policy_state, n_frames);
+    // The readahead window is capped by the frames, start over with a new stream
+    readahead_init(ctx, ctx->readahead.limit);
+    if (ctx->reclaimer != NULL) {
+        reclaimer_watermarks(ctx);
+    }
+    pin_limit(ctx);
+    int over = ctx->resident_pages > ctx->n_frames;
+    spin_unlock(&ctx->policy_lock);
+
+    while (over) {
+        // A victim in the middle of its own fault stops the batch, let the fault finish
+        if (evict_batch(ctx, 0) == 0) {
+            sched_yield();
+        }
+        spin_lock(&ctx->policy_lock);
+        over = ctx->resident_pages > ctx->n_frames;
+        spin_unlock(&ctx->policy_lock);
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "473_mm_internal.h"
+#include <string.h>
+
+// Region index
+//
+// The SIGSEGV handler has to find the context of a faulting address without taking a lock, so the
+// regions are kept in an array sorted by start address that is never modified in place. Adding or
+// removing a region builds a new array, publishes it, and frees the old one once no handler can
+// still be reading it. Lookups are a binary search, O(log n) in the number of regions.
+//
+// region_add and region_remove are called with CONTEXT_LOCK held, so there is only ever one writer.
+
+typedef struct region region;
+struct region {
+    char *start;
+    char *end;
+    mm_context *ctx;
+};
+
+typedef struct region_index region_index;
+struct region_index {
+    int size;
+    region regions[];
+};
+
+_Atomic(region_index*) REGIONS;
+
+// Number of lookups in progress. A replaced index is freed only after this
+// has been seen at zero, at which point every lookup sees the new index.
+atomic_int REGION_READERS;
+
+mm_context *region_find(void* address) {
+    char *addr = address;
+    mm_context *ctx = NULL;
+
+    atomic_fetch_add(&REGION_READERS, 1);
+    region_index *index = atomic_load(&REGIONS);
+    if (index != NULL) {
+        // Find the last region starting at or below the address
+        int low = 0;
+        int high = index->size - 1;
+        while (low <= high) {
+            int mid = (low + high) / 2;
+            if (index->regions[mid].start <= addr) {
+                low = mid + 1;
+            } else {
+                high = mid - 1;
+            }
+        }
+        if (high >= 0 && addr < index->regions[high].end) {
+            ctx = index->regions[high].ctx;
+        }
+    }
+    atomic_fetch_sub(&REGION_READERS, 1);
+
+    return ctx;
+}
+
+static void region_publish(region_index* index) {
+    region_index *old = atomic_exchange(&REGIONS, index);
+    while (atomic_load(&REGION_READERS) != 0) {
+        sched_yield();
+    }
+    free(old);
+}
+
+static region_index *region_alloc(int size) {
+    region_index *index = malloc(sizeof(region_index) + size * sizeof(region));
+    if (index == NULL) {
+        printf("region index allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    index->size = size;
+    return index;
+}
+
+// Returns -1 if the context's region overlaps one that is already managed
+int region_add(mm_context* ctx) {
+    region_index *old = atomic_load(&REGIONS);
+    int old_size = old == NULL ? 0 : old->size;
+    char *start = ctx->vm_start;
+    char *end = start + ctx->vm_size;
+
+    int i = 0;
+    while (i < old_size && old->regions[i].start < start) {
+        i++;
+    }
+    if ((i > 0 && old->regions[i - 1].end > start) || (i < old_size && old->regions[i].start < end)) {
+        return -1;
+    }
+
+    region_index *index = region_alloc(old_size + 1);
+    if (i > 0) {
+        memcpy(index->regions, old->regions, i * sizeof(region));
+    }
+    index->regions[i].start = start;
+    index->regions[i].end = end;
+    index->regions[i].ctx = ctx;
+    if (old_size > i) {
+        memcpy(index->regions + i + 1, old->regions + i, (old_size - i) * sizeof(region));
+    }
+
+    region_publish(index);
+    return 0;
+}
+
+void region_remove(mm_context* ctx) {
+    region_index *old = atomic_load(&REGIONS);
+    if (old == NULL) {
+        return;
+    }
+
+    region_index *index = region_alloc(old->size - 1);
+    int i = 0;
+    int j = 0;
+    for (i = 0; i < old->size; i++) {
+        if (old->regions[i].ctx != ctx) {
+            if (j == index->size) {
+                // Not in the index
+                free(index);
+                return;
+            }
+            index->regions[j++] = old->regions[i];
+        }
+    }
+
+    region_publish(index);
+}
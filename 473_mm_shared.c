@@ -0,0 +1,397 @@
+#define _GNU_SOURCE
+#include "473_mm_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Shared regions
+//
+// Several processes map the same memfd or POSIX shared memory object and share one frame budget. The object
+// starts with the frame table, the rest of it holds the pages, so every process sees the same data and only
+// one copy of it is in memory. The frame table is in shared memory too and holds no pointers: a clock over
+// frame numbers, which page every frame holds, which frame every page is in, and a log of the last
+// SHARED_LOG evictions. A futex in the table serializes the fault handlers of all processes.
+//
+// Every process still maps the pages with its own rights, mprotect in its own SIGSEGV handler. A fault on a
+// page that is not resident makes it resident, evicting the clock's victim if the frames are full. A fault
+// on a page that another process made resident only opens it to this process, it takes no frame. An
+// eviction can only take the rights of the evicting process away, the others find the page in the log the
+// next time they fault and take theirs away then. Until then they can still use the page, which is safe
+// because the data never moves, but is not seen by the clock or counted as a write.
+//
+// The contents of the region stay in the object, evicting a page does not release its memory.
+
+#define SHARED_MAGIC 0x4d4d5348
+#define SHARED_LOG 16384
+#define SHARED_ATTACH_TRIES 1000
+
+typedef struct shared_frame shared_frame;
+struct shared_frame {
+    int page;               // -1 if the frame is free
+    int referenced;
+};
+
+typedef struct shared_page shared_page;
+struct shared_page {
+    int frame;              // -1 if the page is not resident
+    int modified;
+};
+
+// Start of the object. Everything below 'lock' is covered by it, the counters are read without it.
+typedef struct shared_header shared_header;
+struct shared_header {
+    _Atomic uint32_t magic; // set once the creator filled in the table
+    int page_size;
+    int n_pages;
+    size_t vm_size;
+    atomic_int lock;        // 0 free, 1 held, 2 held with waiters
+    int n_frames;
+    int resident;           // frames 0 to resident - 1 hold pages, the others are free
+    int hand;
+    uint64_t log_head;      // evictions ever logged
+    atomic_ulong page_faults;
+    atomic_ulong write_backs;
+    int log[SHARED_LOG];
+};
+
+// What one process keeps about a shared region
+struct shared_region {
+    int fd;
+    shared_header *header;
+    size_t table_size;
+    shared_frame *frames;
+    shared_page *pages;
+    unsigned char *mapped;  // rights of this process on every page, PROT_NONE, PROT_READ or both
+    int n_mapped;
+    uint64_t seen;          // evictions of the log this process took its rights back for
+    atomic_ulong shared_hits;
+    atomic_ulong revoked;
+};
+
+static void futex(atomic_int* word, int op, int value) {
+    syscall(SYS_futex, word, op, value, NULL, NULL, 0);
+}
+
+// Mutex on a futex shared between processes, safe to take in the SIGSEGV handler
+static void shared_lock(atomic_int* lock) {
+    int c = 0;
+    if (atomic_compare_exchange_strong(lock, &c, 1)) {
+        return;
+    }
+    if (c != 2) {
+        c = atomic_exchange(lock, 2);
+    }
+    while (c != 0) {
+        futex(lock, FUTEX_WAIT, 2);
+        c = atomic_exchange(lock, 2);
+    }
+}
+
+static void shared_unlock(atomic_int* lock) {
+    if (atomic_exchange(lock, 0) == 2) {
+        futex(lock, FUTEX_WAKE, 1);
+    }
+}
+
+// Offsets of the frames and the pages in the table, returns the size of the table in whole pages
+static size_t shared_layout(int n_pages, int page_size, size_t* frames, size_t* pages) {
+    *frames = (sizeof(shared_header) + 63) & ~(size_t)63;
+    *pages = *frames + (size_t)n_pages * sizeof(shared_frame);
+    size_t end = *pages + (size_t)n_pages * sizeof(shared_page);
+    return (end + page_size - 1) / page_size * page_size;
+}
+
+static void page_rights(mm_context* ctx, shared_region* r, int number, int prot) {
+    if ((r->mapped[number] != 0) != (prot != 0)) {
+        r->n_mapped += prot != 0 ? 1 : -1;
+    }
+    r->mapped[number] = prot;
+    mprotect((char*)ctx->vm_start + (size_t)number * ctx->page_size, ctx->page_size, prot);
+}
+
+// Takes the rights back for the pages other processes evicted since this process last looked
+static void shared_sync(mm_context* ctx, shared_region* r) {
+    shared_header *h = r->header;
+    if (h->log_head - r->seen > SHARED_LOG) {
+        // Too far behind to know which pages went, start over without rights on any page
+        mprotect(ctx->vm_start, ctx->vm_size, PROT_NONE);
+        madvise(r->mapped, ctx->n_pages, MADV_DONTNEED);
+        atomic_fetch_add_explicit(&r->revoked, r->n_mapped, memory_order_relaxed);
+        r->n_mapped = 0;
+    } else {
+        for (; r->seen < h->log_head; r->seen++) {
+            int number = h->log[r->seen % SHARED_LOG];
+            if (r->mapped[number] != 0) {
+                page_rights(ctx, r, number, PROT_NONE);
+                atomic_fetch_add_explicit(&r->revoked, 1, memory_order_relaxed);
+            }
+        }
+    }
+    r->seen = h->log_head;
+}
+
+static int clock_victim(shared_region* r) {
+    shared_header *h = r->header;
+    while (r->frames[h->hand].referenced) {
+        r->frames[h->hand].referenced = 0;
+        h->hand = (h->hand + 1) % h->n_frames;
+    }
+    int frame = h->hand;
+    h->hand = (frame + 1) % h->n_frames;
+    return frame;
+}
+
+// Empties 'frame'. The page is logged for the other processes, this one takes its rights back right away.
+static void shared_evict(mm_context* ctx, shared_region* r, int frame) {
+    shared_header *h = r->header;
+    int number = r->frames[frame].page;
+    shared_page *page = &r->pages[number];
+    if (page->modified) {
+        atomic_fetch_add_explicit(&ctx->write_back_count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&h->write_backs, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&ctx->evictions, 1, memory_order_relaxed);
+    page->frame = -1;
+    page->modified = 0;
+    r->frames[frame].page = -1;
+    r->frames[frame].referenced = 0;
+    h->resident--;
+
+    h->log[h->log_head++ % SHARED_LOG] = number;
+    r->seen = h->log_head;
+    if (r->mapped[number] != 0) {
+        page_rights(ctx, r, number, PROT_NONE);
+    }
+}
+
+// Fault handler of shared regions, in place of handle_segv. Returns FAULT_MAPPED or FAULT_UPGRADED.
+int shared_fault(mm_context* ctx, void* address, int access) {
+    shared_region *r = ctx->shared;
+    shared_header *h = r->header;
+    int number = translate_to_page_number(ctx, address);
+    int result = FAULT_UPGRADED;
+
+    shared_lock(&h->lock);
+    shared_sync(ctx, r);
+    shared_page *page = &r->pages[number];
+
+    // Without the fault access, a fault on a page this process can read has to be a write
+    int write = access == FAULT_WRITE || (access == FAULT_UNKNOWN && r->mapped[number] != 0);
+    if (page->frame < 0) {
+        result = FAULT_MAPPED;
+        int frame = h->resident;
+        if (h->resident >= h->n_frames) {
+            frame = clock_victim(r);
+            shared_evict(ctx, r, frame);
+        }
+        r->frames[frame].page = number;
+        r->frames[frame].referenced = 1;
+        page->frame = frame;
+        page->modified = write;
+        h->resident++;
+        atomic_fetch_add_explicit(&h->page_faults, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ctx->fault_count, 1, memory_order_relaxed);
+        if (!write) {
+            atomic_fetch_add_explicit(&ctx->read_faults, 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_fetch_add_explicit(&ctx->protection_faults, 1, memory_order_relaxed);
+        if (r->mapped[number] == 0) {
+            atomic_fetch_add_explicit(&r->shared_hits, 1, memory_order_relaxed);
+        }
+        if (write) {
+            page->modified = 1;
+            atomic_fetch_add_explicit(&ctx->write_upgrades, 1, memory_order_relaxed);
+        }
+        r->frames[page->frame].referenced = 1;
+    }
+    page_rights(ctx, r, number, page->modified ? PROT_READ|PROT_WRITE : PROT_READ);
+
+    shared_unlock(&h->lock);
+    return result;
+}
+
+// Moves the page in frame 'from' to the free frame 'to'
+static void frame_move(shared_region* r, int from, int to) {
+    if (from == to) {
+        return;
+    }
+    r->frames[to] = r->frames[from];
+    r->pages[r->frames[to].page].frame = to;
+    r->frames[from].page = -1;
+    r->frames[from].referenced = 0;
+}
+
+// mm_context_set_frames for a shared region. More frames than pages are of no use, the budget stops there.
+int shared_set_frames(mm_context* ctx, int n_frames) {
+    shared_region *r = ctx->shared;
+    shared_header *h = r->header;
+    if (n_frames < 1) {
+        return -1;
+    }
+    if (n_frames > ctx->n_pages) {
+        n_frames = ctx->n_pages;
+    }
+
+    shared_lock(&h->lock);
+    shared_sync(ctx, r);
+    // The clock only goes round the frames in use, the last of them fills the frame each victim leaves
+    while (h->resident > n_frames) {
+        h->n_frames = h->resident;
+        h->hand %= h->n_frames;
+        int frame = clock_victim(r);
+        shared_evict(ctx, r, frame);
+        frame_move(r, h->resident, frame);
+    }
+    h->n_frames = n_frames;
+    h->hand %= n_frames;
+    shared_unlock(&h->lock);
+    return 0;
+}
+
+void shared_report(mm_context* ctx, mm_stats* stats) {
+    shared_region *r = ctx->shared;
+    if (r == NULL) {
+        return;
+    }
+    stats->shared_hits = atomic_load_explicit(&r->shared_hits, memory_order_relaxed);
+    stats->revoked_pages = atomic_load_explicit(&r->revoked, memory_order_relaxed);
+    stats->shared_page_faults = atomic_load_explicit(&r->header->page_faults, memory_order_relaxed);
+    stats->shared_write_backs = atomic_load_explicit(&r->header->write_backs, memory_order_relaxed);
+}
+
+// Unmaps the region and the frame table of this process, the object lives on for the others
+void shared_close(mm_context* ctx) {
+    shared_region *r = ctx->shared;
+    if (r == NULL) {
+        return;
+    }
+    munmap(ctx->vm_start, ctx->vm_size);
+    munmap(r->header, r->table_size);
+    munmap(r->mapped, ctx->n_pages);
+    close(r->fd);
+    free(r);
+    ctx->shared = NULL;
+}
+
+// Maps the table of an object someone else created, once it is filled in. Returns NULL if it is not
+// a region with the same size and page size.
+static shared_header *shared_attach(int fd, size_t vm_size, int page_size, size_t table_size) {
+    int tries = 0;
+    struct stat st;
+    // The creator sizes the object first
+    while (fstat(fd, &st) == 0 && st.st_size == 0 && ++tries < SHARED_ATTACH_TRIES) {
+        usleep(1000);
+    }
+    if (st.st_size < (off_t)(table_size + vm_size)) {
+        return NULL;
+    }
+    shared_header *h = mmap(NULL, table_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+        return NULL;
+    }
+    while (atomic_load_explicit(&h->magic, memory_order_acquire) != SHARED_MAGIC && ++tries < SHARED_ATTACH_TRIES) {
+        usleep(1000);
+    }
+    if (atomic_load_explicit(&h->magic, memory_order_acquire) != SHARED_MAGIC || h->vm_size != vm_size || h->page_size != page_size) {
+        munmap(h, table_size);
+        return NULL;
+    }
+    return h;
+}
+
+mm_context *mm_shared_open(const char* name, size_t vm_size, int n_frames, int page_size, void** vm) {
+    if (page_size <= 0 || page_size % sysconf(_SC_PAGE_SIZE) != 0 || vm_size == 0 || vm_size % page_size != 0
+            || vm_size / page_size > INT_MAX || n_frames < 1) {
+        return NULL;
+    }
+    int n_pages = vm_size / page_size;
+    size_t frames_offset, pages_offset;
+    size_t table_size = shared_layout(n_pages, page_size, &frames_offset, &pages_offset);
+
+    int created = 1;
+    int fd = -1;
+    if (name == NULL) {
+        fd = memfd_create("mm_shared", MFD_CLOEXEC);
+    } else {
+        fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+        if (fd == -1 && errno == EEXIST) {
+            created = 0;
+            fd = shm_open(name, O_RDWR, 0);
+        }
+    }
+    if (fd == -1) {
+        return NULL;
+    }
+
+    shared_header *h = NULL;
+    if (created) {
+        if (ftruncate(fd, table_size + vm_size) == -1) {
+            close(fd);
+            return NULL;
+        }
+        h = mmap(NULL, table_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (h == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+        h->page_size = page_size;
+        h->n_pages = n_pages;
+        h->vm_size = vm_size;
+        h->n_frames = n_frames < n_pages ? n_frames : n_pages;
+        shared_frame *frames = (shared_frame*)((char*)h + frames_offset);
+        shared_page *pages = (shared_page*)((char*)h + pages_offset);
+        int i = 0;
+        for (i = 0; i < n_pages; i++) {
+            frames[i].page = -1;
+            pages[i].frame = -1;
+        }
+        atomic_store_explicit(&h->magic, SHARED_MAGIC, memory_order_release);
+    } else {
+        h = shared_attach(fd, vm_size, page_size, table_size);
+        if (h == NULL) {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    shared_region *r = calloc(1, sizeof(shared_region));
+    void *start = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, table_size);
+    void *mapped = mmap(NULL, n_pages, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (r == NULL || start == MAP_FAILED || mapped == MAP_FAILED) {
+        free(r);
+        if (start != MAP_FAILED) {
+            munmap(start, vm_size);
+        }
+        if (mapped != MAP_FAILED) {
+            munmap(mapped, n_pages);
+        }
+        munmap(h, table_size);
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    r->header = h;
+    r->table_size = table_size;
+    r->frames = (shared_frame*)((char*)h + frames_offset);
+    r->pages = (shared_page*)((char*)h + pages_offset);
+    r->mapped = mapped;
+
+    // The context only registers the region and protects it, its own frames and policy are not used
+    mm_context *ctx = mm_create(start, vm_size, 1, page_size, MM_POLICY_FIFO, NULL);
+    shared_lock(&h->lock);
+    r->seen = h->log_head;
+    shared_unlock(&h->lock);
+    ctx->shared = r;
+    *vm = start;
+    return ctx;
+}
+
+int mm_shared_unlink(const char* name) {
+    return shm_unlink(name);
+}
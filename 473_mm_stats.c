@@ -0,0 +1,109 @@
+#include "473_mm_internal.h"
+#include <string.h>
+
+// Statistics
+//
+// Fault counters are atomics bumped with relaxed ordering by whichever thread handles the fault. The
+// latency of every handled fault goes into a histogram with power of two buckets, so recording it is a
+// count of leading zeros and one atomic add. Hand and lookup steps live in the policy's own lists, which
+// are only read under ctx->policy_lock.
+
+static uint64_t stats_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void stats_init(mm_context* ctx) {
+    ctx->start_ns = stats_now_ns();
+    ctx->start_ticks = stats_ticks();
+}
+
+// Records the latency of a fault handle_segv finished with 'result'
+void stats_latency(mm_context* ctx, int result, uint64_t ticks) {
+    int bucket = ticks == 0 ? 0 : 63 - __builtin_clzll(ticks);
+    if (bucket >= MM_LATENCY_BUCKETS) {
+        bucket = MM_LATENCY_BUCKETS - 1;
+    }
+    atomic_ulong *histogram = result == FAULT_MAPPED ? ctx->fault_latency : ctx->protection_latency;
+    atomic_fetch_add_explicit(&histogram[bucket], 1, memory_order_relaxed);
+}
+
+// Memory of the region backed by transparent huge pages, from the AnonHugePages lines of /proc/self/smaps
+static uint64_t stats_huge_page_bytes(mm_context* ctx) {
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    uintptr_t start = (uintptr_t)ctx->vm_start;
+    uintptr_t end = start + ctx->vm_size;
+    int inside = 0;
+    uint64_t bytes = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long from, to, kb;
+        if (sscanf(line, "%lx-%lx ", &from, &to) == 2) {
+            // The first line of a mapping
+            inside = from < end && to > start;
+        } else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            bytes += (uint64_t)kb * 1024;
+        }
+    }
+    fclose(f);
+    return bytes;
+}
+
+void mm_get_stats(mm_stats* stats) {
+    if (DEFAULT_CONTEXT == NULL) {
+        memset(stats, 0, sizeof(mm_stats));
+        return;
+    }
+    mm_context_get_stats(DEFAULT_CONTEXT, stats);
+}
+
+void mm_context_get_stats(mm_context* ctx, mm_stats* stats) {
+    memset(stats, 0, sizeof(mm_stats));
+
+    stats->page_faults = atomic_load_explicit(&ctx->fault_count, memory_order_relaxed);
+    stats->read_faults = atomic_load_explicit(&ctx->read_faults, memory_order_relaxed);
+    stats->write_faults = stats->page_faults - stats->read_faults;
+    stats->protection_faults = atomic_load_explicit(&ctx->protection_faults, memory_order_relaxed);
+    stats->write_upgrades = atomic_load_explicit(&ctx->write_upgrades, memory_order_relaxed);
+    stats->write_backs = atomic_load_explicit(&ctx->write_back_count, memory_order_relaxed);
+    stats->evictions_dirty = stats->write_backs;
+    stats->evictions_clean = atomic_load_explicit(&ctx->evictions, memory_order_relaxed) - stats->evictions_dirty;
+    stats->prefetches = atomic_load_explicit(&ctx->prefetches, memory_order_relaxed);
+    stats->faults_avoided = atomic_load_explicit(&ctx->faults_avoided, memory_order_relaxed);
+    stats->bytes_released = atomic_load_explicit(&ctx->bytes_released, memory_order_relaxed);
+    stats->bytes_restored = atomic_load_explicit(&ctx->bytes_restored, memory_order_relaxed);
+    stats->reclaimed = atomic_load_explicit(&ctx->reclaimed, memory_order_relaxed);
+    stats->advised_prefetches = atomic_load_explicit(&ctx->advised_prefetches, memory_order_relaxed);
+    stats->advised_faults_avoided = atomic_load_explicit(&ctx->advised_faults_avoided, memory_order_relaxed);
+    stats->discarded_pages = atomic_load_explicit(&ctx->discarded, memory_order_relaxed);
+    stats->subpages_written = atomic_load_explicit(&ctx->subpages_written, memory_order_relaxed);
+    stats->subpages_skipped = atomic_load_explicit(&ctx->subpages_skipped, memory_order_relaxed);
+    if (ctx->huge_pages) {
+        stats->huge_page_bytes = stats_huge_page_bytes(ctx);
+    }
+
+    int i = 0;
+    for (i = 0; i < MM_LATENCY_BUCKETS; i++) {
+        stats->fault_latency[i] = atomic_load_explicit(&ctx->fault_latency[i], memory_order_relaxed);
+        stats->protection_latency[i] = atomic_load_explicit(&ctx->protection_latency[i], memory_order_relaxed);
+    }
+
+    zpool_report(ctx, stats);
+    writeback_report(ctx, stats);
+    shared_report(ctx, stats);
+    dedup_report(ctx, stats);
+    stats->page_index_bytes = radix_bytes(&ctx->page_index);
+
+    spin_lock(&ctx->policy_lock);
+    ctx->policy_ops->report(ctx->policy_state, stats);
+    stats->pinned_pages = ctx->pinned.size;
+    spin_unlock(&ctx->policy_lock);
+
+    uint64_t elapsed_ns = stats_now_ns() - ctx->start_ns;
+    uint64_t elapsed_ticks = stats_ticks() - ctx->start_ticks;
+    stats->ticks_per_ns = elapsed_ns > 0 ? (double)elapsed_ticks / elapsed_ns : 1.0;
+}
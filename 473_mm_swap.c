@@ -0,0 +1,384 @@
+#include "473_mm_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+// Swap store for regions with 'reclaim' or 'file_path' set
+//
+// An evicted page is released with MADV_DONTNEED, so only resident pages use memory. Before that,
+// a page whose contents are not already in the swap file is written to it at offset
+// page number * page size, and a page that faults back in is read from there.
+//
+// A file backed region works the same way with the user's file in place of the swap file, except that
+// every page starts out saved: the first fault on a page reads it from the file, and parts of the region
+// past the end of the file read as zeros. Writing back dirty pages makes the file grow as needed.
+//
+// With the SIGSEGV backend writes are asynchronous (473_mm_writeback.c). The page is copied into a write
+// buffer and released at once, and SWAP_QUEUED tells a later fault to look for it in the buffers before
+// reading the file. Reads use pread into one of the 'staging' buffers.
+//
+// The copy back happens while the page is still PROT_NONE, by writing through /proc/self/mem, so no
+// other thread can see a half restored page. Where /proc/self/mem is not available the page is made
+// writable for the copy instead.
+//
+// For the userfaultfd backend the swap file is mapped instead, and the mapping is its shadow.
+//
+// With a compressed tier, a page that has to be saved is offered to the pool first and only written to the
+// file if the pool cannot take it. A page restored from the pool is decompressed into a staging buffer and
+// copied in like a page from the file.
+//
+// With deduplication (473_mm_dedup.c), a page that has to be saved is looked up among the shared copies
+// before anything else, and a page whose saved contents are in a copy maps the copy when it faults in.
+//
+// With dirty subpages, an extent whose clean parts are in the file as they are in memory (it was last saved
+// there, or the region is backed by the file) and has no older write queued only writes its dirty parts,
+// with a pwrite per run of them, on the evicting thread.
+
+// Pages being read back at the same time
+#define SWAP_STAGING 4
+
+struct swap_store {
+    int fd;
+    int mem_fd;
+    int file;               // the region is backed by the user's file, not a swap file
+    char *map;              // only for the userfaultfd backend
+    char *staging[SWAP_STAGING];
+    mm_lock staging_locks[SWAP_STAGING];
+};
+
+static int swap_create_file(const char* path, int file) {
+    if (file) {
+        return open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+    }
+    if (path != NULL) {
+        return open(path, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0600);
+    }
+
+    // Unnamed temporary file, removed as soon as it is closed
+    const char *dir = getenv("TMPDIR");
+    char name[4096];
+    snprintf(name, sizeof(name), "%s/mm_swap_XXXXXX", dir != NULL ? dir : "/tmp");
+    int fd = mkstemp(name);
+    if (fd != -1) {
+        unlink(name);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+static void swap_mark_data(mm_context* ctx, int number) {
+    page_entry_get(ctx, number)->store = SWAP_DATA;
+}
+
+// Opens the swap file at 'path', or the file backing the region if 'file' is set
+int swap_open(mm_context* ctx, const char* path, int file) {
+    swap_store *swap = calloc(1, sizeof(swap_store));
+    if (swap == NULL) {
+        return -1;
+    }
+    swap->file = file;
+    swap->fd = swap_create_file(path, file);
+    if (swap->fd == -1 || (!file && ftruncate(swap->fd, ctx->vm_size) == -1)) {
+        return -1;
+    }
+    if (ctx->backend == MM_BACKEND_USERFAULTFD) {
+        swap->map = mmap(NULL, ctx->vm_size, PROT_READ|PROT_WRITE, MAP_SHARED, swap->fd, 0);
+        if (swap->map == MAP_FAILED) {
+            return -1;
+        }
+    }
+    swap->mem_fd = open("/proc/self/mem", O_RDWR|O_CLOEXEC);
+    int i = 0;
+    for (i = 0; i < SWAP_STAGING; i++) {
+        swap->staging[i] = malloc(ctx->page_size);
+        if (swap->staging[i] == NULL) {
+            return -1;
+        }
+    }
+
+    ctx->swap = swap;
+
+    if (ctx->backend == MM_BACKEND_SIGSEGV) {
+        // Without the writer threads every write back is synchronous
+        writeback_init(ctx, swap->fd);
+    }
+
+    if (file) {
+        // The region takes its contents from the file
+        madvise(ctx->vm_start, ctx->vm_size, MADV_DONTNEED);
+    } else if (ctx->backend == MM_BACKEND_SIGSEGV) {
+        // Pages that already hold data have to be saved the first time they are evicted.
+        // The userfaultfd backend saves them itself.
+        scan_resident(ctx, swap_mark_data);
+    }
+    return 0;
+}
+
+// Returns the mapping of the swap file, the same size as the region
+char *swap_map(mm_context* ctx) {
+    return ctx->swap->map;
+}
+
+// Writes the parts of extent 'number' at 'start' set in 'dirty', if the file holds the rest of it as it is
+// in memory according to 'state'. Returns 0 if it does not, or a write failed.
+static int swap_write_dirty(mm_context* ctx, char* start, int number, uint64_t dirty, unsigned char state) {
+    if (!ctx->dirty_subpages || dirty == 0 || (state & (SWAP_DATA|SWAP_ZPOOL|SWAP_QUEUED|SWAP_DEDUP))
+            || !(ctx->swap->file || (state & SWAP_VALID))) {
+        return 0;
+    }
+    off_t offset = (off_t)number * ctx->page_size;
+    uint64_t left = dirty;
+    while (left != 0) {
+        int first = __builtin_ctzll(left);
+        uint64_t rest = ~left >> first;
+        int n = rest == 0 ? 64 - first : __builtin_ctzll(rest);
+        size_t skip = (size_t)first << ctx->dirty_shift;
+        if (writeback_write(ctx->swap->fd, start + skip, (size_t)n << ctx->dirty_shift, offset + skip) == -1) {
+            return 0;
+        }
+        left = first + n < 64 ? left & (~0ull << (first + n)) : 0;
+    }
+    int per_bit = ctx->subpages > 64 ? ctx->subpages / 64 : 1;
+    int written = __builtin_popcountll(dirty) * per_bit;
+    atomic_fetch_add_explicit(&ctx->subpages_written, written, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ctx->subpages_skipped, ctx->subpages - written, memory_order_relaxed);
+    return 1;
+}
+
+// Saves an evicted page if needed and releases its memory.
+// Called instead of protecting the page PROT_NONE. Returns 1 if the contents were found in a shared
+// copy, so nothing was written.
+int swap_out(mm_context* ctx, evicted_page* page) {
+    swap_store *swap = ctx->swap;
+    page_entry *entry = page_entry_get(ctx, page->number);
+    unsigned char *state = &entry->store;
+    int deduplicated = 0;
+    int old = -1;
+
+    if (page->modified || (*state & SWAP_DATA)) {
+        // Stall writers while the page is saved
+        mprotect(page->start, page->size, PROT_READ);
+
+        unsigned char saved = SWAP_VALID;
+        if (ctx->dedup != NULL) {
+            dedup_write(ctx, entry, page->number);
+            old = dedup_take(ctx, page->number);
+            deduplicated = dedup_save(ctx, page->number, page->start);
+        }
+        if (deduplicated) {
+            saved = SWAP_DEDUP;
+            dedup_saved(ctx);
+        } else if (ctx->zpool != NULL && zpool_store(ctx, page->number, page->start)) {
+            saved = SWAP_ZPOOL;
+        } else if (page->modified && swap_write_dirty(ctx, page->start, page->number, page->dirty, *state)) {
+            saved = SWAP_VALID;
+        } else if (ctx->writeback != NULL && writeback_queue(ctx, page->number, page->start)) {
+            saved = SWAP_VALID | SWAP_QUEUED;
+        } else if (writeback_write(swap->fd, page->start, page->size, (off_t)page->number * ctx->page_size) == -1) {
+            // Keep the page rather than lose its contents
+            mprotect(page->start, page->size, PROT_NONE);
+            if (ctx->dedup != NULL) {
+                dedup_ref(ctx, page->number, old);
+            }
+            return 0;
+        }
+        *state = saved | (*state & (SWAP_MAPPED|SWAP_SHARING));
+    }
+
+    if (*state & SWAP_MAPPED) {
+        // Only a page that stopped sharing the copy had memory of its own
+        if (!(*state & SWAP_SHARING)) {
+            atomic_fetch_add_explicit(&ctx->bytes_released, page->size, memory_order_relaxed);
+        }
+        dedup_unmap(ctx, entry, page->number, 0, NULL);
+    } else {
+        mprotect(page->start, page->size, PROT_NONE);
+        madvise(page->start, page->size, MADV_DONTNEED);
+        atomic_fetch_add_explicit(&ctx->bytes_released, page->size, memory_order_relaxed);
+    }
+    if (old >= 0) {
+        dedup_put(ctx, old);
+    }
+    return deduplicated;
+}
+
+// Writes 'src' into a page that is still PROT_NONE
+static void swap_copy_in(mm_context* ctx, virtual_page* page, const char* src) {
+    swap_store *swap = ctx->swap;
+    if (swap->mem_fd == -1 || pwrite(swap->mem_fd, src, page->size, (off_t)(uintptr_t)page->start) != page->size) {
+        mprotect(page->start, page->size, PROT_READ|PROT_WRITE);
+        memcpy(page->start, src, page->size);
+    }
+}
+
+// Takes a free staging buffer
+static int staging_acquire(swap_store* swap) {
+    while (1) {
+        int i = 0;
+        for (i = 0; i < SWAP_STAGING; i++) {
+            if (spin_trylock(&swap->staging_locks[i])) {
+                return i;
+            }
+        }
+        sched_yield();
+    }
+}
+
+// Reads page 'number' from the file. What is past the end of the file reads as zeros.
+static void swap_read(mm_context* ctx, int number, char* out) {
+    size_t done = 0;
+    off_t offset = (off_t)number * ctx->page_size;
+    while (done < (size_t)ctx->page_size) {
+        ssize_t n = pread(ctx->swap->fd, out + done, ctx->page_size - done, offset + done);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += n;
+    }
+    memset(out + done, 0, ctx->page_size - done);
+}
+
+// Copies the saved contents of page 'number', which is not resident, into 'out'.
+// Returns 0 if nothing is saved in the file or the compressed pool. Called with the page's lock held.
+int swap_load(mm_context* ctx, int number, char* out) {
+    page_entry *entry = page_entry_get(ctx, number);
+    if (entry->store & SWAP_ZPOOL) {
+        return zpool_load(ctx, number, out, 0);
+    }
+    if (!(entry->store & SWAP_VALID)) {
+        return 0;
+    }
+    if (!(entry->store & SWAP_QUEUED) || !writeback_read(ctx, number, out)) {
+        entry->store &= ~SWAP_QUEUED;
+        swap_read(ctx, number, out);
+    }
+    return 1;
+}
+
+// Copies a page that is becoming resident back from the file, a write buffer or the compressed pool.
+// Called with the page's lock held, before the page is made readable.
+void swap_in(mm_context* ctx, virtual_page* page) {
+    swap_store *swap = ctx->swap;
+    page_entry *entry = page_entry_get(ctx, page->number);
+    if (entry->store & SWAP_DEDUP) {
+        // A read maps the shared copy, a page that is written right away gets its own memory
+        if (page->modified || dedup_map(ctx, page) == -1) {
+            swap_copy_in(ctx, page, dedup_contents(ctx, page->number));
+        }
+        return;
+    }
+    if (entry->store & SWAP_ZPOOL) {
+        int s = staging_acquire(swap);
+        zpool_load(ctx, page->number, swap->staging[s], 1);
+        swap_copy_in(ctx, page, swap->staging[s]);
+        spin_unlock(&swap->staging_locks[s]);
+        return;
+    }
+    if (!swap->file && !(entry->store & SWAP_VALID)) {
+        // Never saved, so it reads back as zeros
+        return;
+    }
+
+    int s = staging_acquire(swap);
+    if (!(entry->store & SWAP_QUEUED) || !writeback_read(ctx, page->number, swap->staging[s])) {
+        // The write is done, if there was one
+        entry->store &= ~SWAP_QUEUED;
+        swap_read(ctx, page->number, swap->staging[s]);
+    }
+    swap_copy_in(ctx, page, swap->staging[s]);
+    spin_unlock(&swap->staging_locks[s]);
+    atomic_fetch_add_explicit(&ctx->bytes_restored, page->size, memory_order_relaxed);
+}
+
+// Forgets the saved contents of a page whose contents were discarded, so it reads back as zeros.
+// A page of a file backed region reads back as last saved instead, so nothing is forgotten.
+// Called with the page's lock held while it is not resident.
+void swap_discard(mm_context* ctx, int number) {
+    if (ctx->swap->file) {
+        return;
+    }
+    page_entry *entry = page_entry_get(ctx, number);
+    if ((entry->store & SWAP_ZPOOL) && ctx->zpool != NULL) {
+        zpool_drop(ctx, number);
+    }
+    if (ctx->dedup != NULL) {
+        dedup_unmap(ctx, entry, number, 0, NULL);
+        dedup_put(ctx, dedup_take(ctx, number));
+    }
+    entry->store = 0;
+}
+
+// Writes every page of a file backed region whose current contents are not in the file yet
+static void swap_flush(mm_context* ctx) {
+    swap_store *swap = ctx->swap;
+    int i = 0;
+    for (i = radix_next(&ctx->page_index, 0, ctx->n_pages); i >= 0; i = radix_next(&ctx->page_index, i + 1, ctx->n_pages)) {
+        page_entry *entry = page_entry_find(ctx, i);
+        off_t offset = (off_t)i * ctx->page_size;
+        if (entry->page != NULL && entry->page->modified
+                && swap_write_dirty(ctx, entry->page->start, i, entry->page->dirty, entry->store)) {
+            continue;
+        }
+        if (entry->page != NULL && (entry->page->modified || (entry->store & SWAP_ZPOOL))) {
+            writeback_write(swap->fd, entry->page->start, ctx->page_size, offset);
+        } else if (entry->page == NULL && (entry->store & SWAP_ZPOOL)) {
+            zpool_load(ctx, i, swap->staging[0], 0);
+            writeback_write(swap->fd, swap->staging[0], ctx->page_size, offset);
+        }
+    }
+    fdatasync(swap->fd);
+}
+
+// Closes the swap file. For the SIGSEGV backend this is called once the region is accessible
+// again, and puts the contents of every page that is not resident back into it. A file backed
+// region instead gets its file brought up to date, and only its resident pages keep their contents.
+void swap_close(mm_context* ctx) {
+    swap_store *swap = ctx->swap;
+    if (swap == NULL) {
+        return;
+    }
+
+    // Every queued write is done after this
+    writeback_destroy(ctx);
+
+    if (swap->file) {
+        swap_flush(ctx);
+    } else if (ctx->backend == MM_BACKEND_SIGSEGV) {
+        // Only pages with an index entry can have been saved
+        int i = 0;
+        for (i = radix_next(&ctx->page_index, 0, ctx->n_pages); i >= 0; i = radix_next(&ctx->page_index, i + 1, ctx->n_pages)) {
+            page_entry *entry = page_entry_find(ctx, i);
+            char *dest = (char*)ctx->vm_start + (size_t)i * ctx->page_size;
+            if (entry->page == NULL && (entry->store & SWAP_ZPOOL)) {
+                zpool_load(ctx, i, dest, 0);
+            } else if (entry->page == NULL && (entry->store & SWAP_VALID)) {
+                swap_read(ctx, i, dest);
+            } else if (entry->page == NULL && (entry->store & SWAP_DEDUP)) {
+                memcpy(dest, dedup_contents(ctx, i), ctx->page_size);
+            } else if (entry->store & SWAP_MAPPED) {
+                // The region gets its own memory back before the copies go
+                dedup_unmap(ctx, entry, i, 1, swap->staging[0]);
+            }
+        }
+    }
+    dedup_destroy(ctx);
+
+    if (swap->map != NULL) {
+        munmap(swap->map, ctx->vm_size);
+    }
+    if (swap->mem_fd != -1) {
+        close(swap->mem_fd);
+    }
+    close(swap->fd);
+    int i = 0;
+    for (i = 0; i < SWAP_STAGING; i++) {
+        free(swap->staging[i]);
+    }
+    free(swap);
+    ctx->swap = NULL;
+}
@@ -0,0 +1,146 @@
+#include "473_mm_internal.h"
+#include "473_mm_trace.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Fault trace recorder
+//
+// Every traced region has its own recorder. Records are collected in a buffer allocated at mm_init and
+// written out with write(2) when it fills up, so recording from the SIGSEGV handler only uses
+// async-signal-safe calls.
+
+#define TRACE_BUFFER_RECORDS 8192
+
+struct trace_recorder {
+    int fd;
+    mm_trace_record *buffer;
+    int used;
+    uint64_t last_ns;
+    trace_recorder *next;
+};
+
+// Open recorders, flushed at exit
+trace_recorder *TRACES;
+pthread_mutex_t TRACES_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void trace_write_all(trace_recorder* trace, const void* data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(trace->fd, p, len);
+        if (n <= 0) {
+            return;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+static void trace_flush(trace_recorder* trace) {
+    if (trace->used > 0) {
+        trace_write_all(trace, trace->buffer, trace->used * sizeof(mm_trace_record));
+        trace->used = 0;
+    }
+}
+
+static void trace_flush_all() {
+    pthread_mutex_lock(&TRACES_LOCK);
+    trace_recorder *trace;
+    for (trace = TRACES; trace != NULL; trace = trace->next) {
+        trace_flush(trace);
+    }
+    pthread_mutex_unlock(&TRACES_LOCK);
+}
+
+static void trace_append(trace_recorder* trace, uint32_t page, uint32_t delta_ns) {
+    if (trace->used == TRACE_BUFFER_RECORDS) {
+        trace_flush(trace);
+    }
+    trace->buffer[trace->used].page = page;
+    trace->buffer[trace->used].delta_ns = delta_ns;
+    trace->used++;
+}
+
+int trace_open(mm_context* ctx, const char* path) {
+    trace_recorder *trace = malloc(sizeof(trace_recorder));
+    if (trace == NULL) {
+        return -1;
+    }
+    trace->buffer = malloc(TRACE_BUFFER_RECORDS * sizeof(mm_trace_record));
+    if (trace->buffer == NULL) {
+        free(trace);
+        return -1;
+    }
+    trace->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if (trace->fd == -1) {
+        free(trace->buffer);
+        free(trace);
+        return -1;
+    }
+
+    mm_trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MM_TRACE_MAGIC, sizeof(header.magic));
+    header.page_size = ctx->page_size;
+    header.n_pages = ctx->n_pages;
+    header.start_ns = trace_now();
+    trace_write_all(trace, &header, sizeof(header));
+
+    trace->used = 0;
+    trace->last_ns = header.start_ns;
+
+    // Keep the tail of the trace if the program exits without mm_destroy()
+    pthread_mutex_lock(&TRACES_LOCK);
+    static int registered = 0;
+    if (!registered) {
+        atexit(trace_flush_all);
+        registered = 1;
+    }
+    trace->next = TRACES;
+    TRACES = trace;
+    pthread_mutex_unlock(&TRACES_LOCK);
+
+    ctx->trace = trace;
+    return 0;
+}
+
+void trace_event(mm_context* ctx, int page_number, int write) {
+    trace_recorder *trace = ctx->trace;
+    uint64_t now = trace_now();
+    uint64_t delta = now - trace->last_ns;
+    trace->last_ns = now;
+
+    if (delta > 0xFFFFFFFFull) {
+        trace_append(trace, MM_TRACE_TIME_EXTEND, (uint32_t)(delta >> 32));
+    }
+    trace_append(trace, (uint32_t)page_number | (write ? MM_TRACE_WRITE : 0), (uint32_t)delta);
+}
+
+void trace_close(mm_context* ctx) {
+    trace_recorder *trace = ctx->trace;
+    if (trace == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&TRACES_LOCK);
+    trace_recorder **link = &TRACES;
+    while (*link != trace) {
+        link = &(*link)->next;
+    }
+    *link = trace->next;
+    pthread_mutex_unlock(&TRACES_LOCK);
+
+    trace_flush(trace);
+    close(trace->fd);
+    free(trace->buffer);
+    free(trace);
+    ctx->trace = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef _473_MM_TRACE_H
+#define _473_MM_TRACE_H
+
+#include <stdint.h>
+
+/*
+Binary fault trace written when 'mm_options.trace_path' is set, and read by mm_replay.
+
+The file starts with one 'mm_trace_header' followed by 8-byte 'mm_trace_record's in fault order.
+'page' holds the virtual page number, with MM_TRACE_WRITE set for write faults.
+'delta_ns' is the time since the previous record (or since 'start_ns' for the first one).
+A delta that does not fit in 32 bits is preceded by a record whose 'page' is MM_TRACE_TIME_EXTEND
+and whose 'delta_ns' holds the upper 32 bits of the delta.
+
+A trace recorded with n_frames = 1 sees almost every change of page, so replaying it predicts the
+faults and write backs of larger frame counts.
+*/
+#define MM_TRACE_MAGIC "MMTRACE1"
+#define MM_TRACE_WRITE 0x80000000u
+#define MM_TRACE_TIME_EXTEND 0xFFFFFFFFu
+
+typedef struct mm_trace_header mm_trace_header;
+struct mm_trace_header {
+    char magic[8];
+    uint32_t page_size;
+    uint32_t n_pages;
+    uint64_t start_ns;
+};
+
+typedef struct mm_trace_record mm_trace_record;
+struct mm_trace_record {
+    uint32_t page;
+    uint32_t delta_ns;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "473_mm_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/userfaultfd.h>
+#endif
+
+#if defined(__linux__) && defined(UFFDIO_WRITEPROTECT)
+
+// userfaultfd backend
+//
+// A page that is not resident is kept unpopulated (MADV_DONTNEED), so any access to it raises a
+// missing-page fault. Resident pages are populated with UFFDIO_COPY and stay write-protected until
+// their first write, which raises a write-protect fault. Both kinds of fault are read on a dedicated
+// thread and fed to handle_fault(), so the replacement policies see exactly what the SIGSEGV backend
+// would give them.
+//
+// Dropping a page discards its contents, so pages are saved to a shadow mapping of the same size
+// before they are dropped, and copied back from it when they become resident again.
+
+// Per-page backend state, kept in the 'store' byte of the page's index entry
+#define UFFD_MAPPED 1   // page is populated in the region
+#define UFFD_SAVED  2   // shadow holds the page contents
+#define UFFD_DIRTY  4   // page is mapped writable and may differ from the shadow
+
+struct uffd_backend {
+    int fd;
+    int stop_pipe[2];
+    pthread_t thread;
+    char *shadow;
+    char *zero_page;
+};
+
+static int uffd_page_index(mm_context* ctx, void* address) {
+    return translate_to_page_number(ctx, address);
+}
+
+static void uffd_wake(mm_context* ctx, void* start) {
+    struct uffdio_range range;
+    range.start = (uintptr_t)start;
+    range.len = ctx->page_size;
+    ioctl(ctx->uffd->fd, UFFDIO_WAKE, &range);
+}
+
+static void uffd_write_protect(mm_context* ctx, void* start, int protect) {
+    struct uffdio_writeprotect wp;
+    wp.range.start = (uintptr_t)start;
+    wp.range.len = ctx->page_size;
+    wp.mode = protect ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+    while (ioctl(ctx->uffd->fd, UFFDIO_WRITEPROTECT, &wp) == -1 && errno == EAGAIN);
+}
+
+// Populates a missing page from the shadow, or with zeros if it was never saved
+static void uffd_copy_in(mm_context* ctx, void* start, int index, unsigned char state, int protect) {
+    uffd_backend *uffd = ctx->uffd;
+    struct uffdio_copy copy;
+    copy.dst = (uintptr_t)start;
+    copy.src = (uintptr_t)(state & UFFD_SAVED ? uffd->shadow + (size_t)index * ctx->page_size : uffd->zero_page);
+    copy.len = ctx->page_size;
+    copy.mode = protect ? UFFDIO_COPY_MODE_WP : 0;
+    copy.copy = 0;
+
+    // Count before the copy wakes the faulting thread
+    int restored = ctx->swap != NULL && (state & UFFD_SAVED);
+    if (restored) {
+        atomic_fetch_add_explicit(&ctx->bytes_restored, ctx->page_size, memory_order_relaxed);
+    }
+
+    while (ioctl(uffd->fd, UFFDIO_COPY, &copy) == -1 && errno == EAGAIN) {
+        copy.copy = 0;
+    }
+
+    if (restored) {
+        madvise((void*)(uintptr_t)copy.src, ctx->page_size, MADV_DONTNEED);
+    }
+}
+
+static void *uffd_thread(void* arg) {
+    mm_context *ctx = arg;
+    uffd_backend *uffd = ctx->uffd;
+    struct pollfd fds[2];
+    fds[0].fd = uffd->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = uffd->stop_pipe[0];
+    fds[1].events = POLLIN;
+
+    while (1) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        struct uffd_msg msg;
+        if (read(uffd->fd, &msg, sizeof(msg)) != sizeof(msg) || msg.event != UFFD_EVENT_PAGEFAULT) {
+            continue;
+        }
+
+        void* address = (void*)(uintptr_t)msg.arg.pagefault.address;
+        int index = uffd_page_index(ctx, address);
+        void* page_start_addr = (char*)ctx->vm_start + (size_t)index * ctx->page_size;
+        int wp_fault = (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) != 0;
+
+        // Another thread may have raced on the same page and had its fault resolved already
+        unsigned char state = page_entry_get(ctx, index)->store;
+        if ((!wp_fault && (state & UFFD_MAPPED)) || (wp_fault && (state & UFFD_DIRTY))) {
+            uffd_wake(ctx, page_start_addr);
+            continue;
+        }
+
+        // The kernel reports whether the access was a write, so a write to a missing page is mapped
+        // writable right away. A failed attempt means another thread holds the page lock: the reclaimer's
+        // evict_batch, mm_set_frames or mm_advise. None of them faults on the region while it holds the
+        // lock, so none waits for this thread, and retrying until the lock is released cannot deadlock.
+        int access = (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE) ? FAULT_WRITE : FAULT_READ;
+        while (!handle_fault(ctx, address, access));
+    }
+    return NULL;
+}
+
+// Saves a page that holds data at mm_init time
+static void uffd_save(mm_context* ctx, int index) {
+    memcpy(ctx->uffd->shadow + (size_t)index * ctx->page_size, (char*)ctx->vm_start + (size_t)index * ctx->page_size, ctx->page_size);
+    page_entry_get(ctx, index)->store = UFFD_SAVED;
+}
+
+int uffd_init(mm_context* ctx) {
+    void *vm = ctx->vm_start;
+    size_t vm_size = ctx->vm_size;
+    int page_size = ctx->page_size;
+
+    uffd_backend *uffd = calloc(1, sizeof(uffd_backend));
+    if (uffd == NULL) {
+        return -1;
+    }
+    ctx->uffd = uffd;
+
+    uffd->fd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (uffd->fd == -1) {
+        return -1;
+    }
+
+    struct uffdio_api api;
+    api.api = UFFD_API;
+    api.features = 0;
+    if (ioctl(uffd->fd, UFFDIO_API, &api) == -1) {
+        close(uffd->fd);
+        return -1;
+    }
+
+    // With 'reclaim' the shadow is the swap file, so saved pages do not stay in memory
+    if (ctx->swap != NULL) {
+        uffd->shadow = swap_map(ctx);
+    } else {
+        uffd->shadow = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    }
+    uffd->zero_page = mmap(NULL, page_size, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (uffd->shadow == MAP_FAILED || uffd->zero_page == MAP_FAILED) {
+        close(uffd->fd);
+        return -1;
+    }
+
+    // Save the pages that already hold data. Untouched pages read back as zeros anyway.
+    scan_resident(ctx, uffd_save);
+    madvise(vm, vm_size, MADV_DONTNEED);
+    if (ctx->swap != NULL) {
+        madvise(uffd->shadow, vm_size, MADV_DONTNEED);
+    }
+
+    struct uffdio_register reg;
+    reg.range.start = (uintptr_t)vm;
+    reg.range.len = vm_size;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING | UFFDIO_REGISTER_MODE_WP;
+    if (ioctl(uffd->fd, UFFDIO_REGISTER, &reg) == -1) {
+        close(uffd->fd);
+        return -1;
+    }
+
+    if (pipe(uffd->stop_pipe) == -1 || pthread_create(&uffd->thread, NULL, uffd_thread, ctx) != 0) {
+        close(uffd->fd);
+        return -1;
+    }
+    return 0;
+}
+
+// Gives a page the access rights mprotect(start, page_size, prot) would, without losing its contents
+void uffd_protect(mm_context* ctx, void* start, int prot) {
+    uffd_backend *uffd = ctx->uffd;
+    int index = uffd_page_index(ctx, start);
+    page_entry *entry = page_entry_get(ctx, index);
+    unsigned char state = entry->store;
+
+    if (prot == PROT_NONE) {
+        if (!(state & UFFD_MAPPED)) {
+            return;
+        }
+        if (state & UFFD_DIRTY) {
+            // Stall writers while the page is saved
+            uffd_write_protect(ctx, start, 1);
+            memcpy(uffd->shadow + (size_t)index * ctx->page_size, start, ctx->page_size);
+            state |= UFFD_SAVED;
+            if (ctx->swap != NULL) {
+                madvise(uffd->shadow + (size_t)index * ctx->page_size, ctx->page_size, MADV_DONTNEED);
+            }
+        }
+        madvise(start, ctx->page_size, MADV_DONTNEED);
+        if (ctx->swap != NULL) {
+            atomic_fetch_add_explicit(&ctx->bytes_released, ctx->page_size, memory_order_relaxed);
+        }
+        state &= ~(UFFD_MAPPED | UFFD_DIRTY);
+    } else if (prot & PROT_WRITE) {
+        if (state & UFFD_MAPPED) {
+            uffd_write_protect(ctx, start, 0);
+        } else {
+            uffd_copy_in(ctx, start, index, state, 0);
+        }
+        state |= UFFD_MAPPED | UFFD_DIRTY;
+    } else {
+        if (state & UFFD_MAPPED) {
+            uffd_write_protect(ctx, start, 1);
+        } else {
+            uffd_copy_in(ctx, start, index, state, 1);
+        }
+        state |= UFFD_MAPPED;
+    }
+
+    entry->store = state;
+}
+
+// Drops a page without saving it, so it reads back as zeros. Called with the page's lock held.
+void uffd_discard(mm_context* ctx, void* start) {
+    page_entry *entry = page_entry_get(ctx, uffd_page_index(ctx, start));
+    entry->store &= ~(UFFD_SAVED | UFFD_DIRTY);
+    uffd_protect(ctx, start, PROT_NONE);
+}
+
+void uffd_destroy(mm_context* ctx) {
+    uffd_backend *uffd = ctx->uffd;
+    char stop = 1;
+    if (write(uffd->stop_pipe[1], &stop, 1) == 1) {
+        pthread_join(uffd->thread, NULL);
+    }
+    close(uffd->stop_pipe[0]);
+    close(uffd->stop_pipe[1]);
+
+    struct uffdio_range range;
+    range.start = (uintptr_t)ctx->vm_start;
+    range.len = ctx->vm_size;
+    ioctl(uffd->fd, UFFDIO_UNREGISTER, &range);
+    close(uffd->fd);
+
+    // Put the saved contents of dropped pages back into the region
+    int i = 0;
+    for (i = radix_next(&ctx->page_index, 0, ctx->n_pages); i >= 0; i = radix_next(&ctx->page_index, i + 1, ctx->n_pages)) {
+        if ((page_entry_find(ctx, i)->store & (UFFD_MAPPED | UFFD_SAVED)) == UFFD_SAVED) {
+            memcpy((char*)ctx->vm_start + (size_t)i * ctx->page_size, uffd->shadow + (size_t)i * ctx->page_size, ctx->page_size);
+        }
+    }
+
+    if (ctx->swap == NULL) {
+        munmap(uffd->shadow, ctx->vm_size);
+    }
+    munmap(uffd->zero_page, ctx->page_size);
+    free(uffd);
+    ctx->uffd = NULL;
+}
+
+#else
+
+int uffd_init(mm_context* ctx) {
+    errno = ENOSYS;
+    return -1;
+}
+
+void uffd_protect(mm_context* ctx, void* start, int prot) {
+}
+
+void uffd_discard(mm_context* ctx, void* start) {
+}
+
+void uffd_destroy(mm_context* ctx) {
+}
+
+#endif
@@ -0,0 +1,509 @@
+#include "473_mm_internal.h"
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifndef MM_NO_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+// Asynchronous write back for the swap store
+//
+// swap_out copies a page it has to save into one of WRITEBACK_BUFFERS page sized buffers and queues it, so
+// the page's memory can be released right away and the evicting thread never waits for the disk. Writer
+// threads take everything that is queued as one batch, sort it by page number and write each run of
+// adjacent pages with a single vectored write. With io_uring (a raw ring, no liburing needed) one thread
+// submits the whole batch with one io_uring_enter; where the ring cannot be set up, or with -DMM_NO_IO_URING,
+// WRITEBACK_THREADS threads each write their batch with pwritev.
+//
+// A buffer stays readable until its write completes, so a page that faults back in while it is being
+// written is copied from the buffer instead of from the file. A page evicted again while its previous
+// contents are still queued overwrites them in place; if they are already being written the eviction waits
+// for that write first, so writes of the same page never overtake each other.
+//
+// When every buffer is busy writeback_queue fails and the caller writes synchronously. A buffer whose
+// write failed is kept and stays readable, so no contents are lost.
+
+#define WRITEBACK_BUFFERS 64
+#define WRITEBACK_THREADS 4
+
+// Buffer states
+#define WB_FREE 0
+#define WB_FILLING 1    // taken by writeback_queue, being copied into
+#define WB_QUEUED 2     // waiting for a writer thread
+#define WB_WRITING 3    // taken by a writer thread
+#define WB_FAILED 4     // the write failed, the buffer keeps the contents for good
+
+struct writeback {
+    int fd;
+    int page_size;
+    char *data;                         // WRITEBACK_BUFFERS pages
+    int number[WRITEBACK_BUFFERS];      // page held by each buffer
+    int state[WRITEBACK_BUFFERS];
+    int queue[WRITEBACK_BUFFERS];       // queued buffers, oldest first
+    int head;
+    int queued;
+    mm_lock lock;                       // covers the arrays above
+
+    sem_t work;
+    atomic_int stop;
+    atomic_int busy;                    // buffers not free or failed
+    pthread_t threads[WRITEBACK_THREADS];
+    int n_threads;
+
+#ifndef MM_NO_IO_URING
+    int ring_fd;                        // -1 without io_uring
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+#endif
+
+    atomic_ulong writes;
+    atomic_ulong batches;
+    atomic_ulong hits;
+};
+
+// A run of adjacent pages written with one call
+typedef struct writeback_run writeback_run;
+struct writeback_run {
+    int first;              // index of the run's first buffer in the batch
+    int count;
+    off_t offset;
+};
+
+static int writeback_find(writeback* wb, int number) {
+    int i = 0;
+    for (i = 0; i < WRITEBACK_BUFFERS; i++) {
+        if (wb->state[i] != WB_FREE && wb->number[i] == number) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static char *writeback_buffer(writeback* wb, int i) {
+    return wb->data + (size_t)i * wb->page_size;
+}
+
+// Writes all of 'len' bytes at 'offset', returns -1 on an error
+int writeback_write(int fd, const void* data, size_t len, off_t offset) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Takes every queued buffer, in page order, and marks them WB_WRITING. Returns how many there are.
+static int writeback_take(writeback* wb, int* batch) {
+    spin_lock(&wb->lock);
+    int n = wb->queued;
+    int i = 0;
+    for (i = 0; i < n; i++) {
+        batch[i] = wb->queue[(wb->head + i) % WRITEBACK_BUFFERS];
+        wb->state[batch[i]] = WB_WRITING;
+    }
+    wb->head = (wb->head + n) % WRITEBACK_BUFFERS;
+    wb->queued = 0;
+
+    // Insertion sort, batches are small and mostly in order already
+    for (i = 1; i < n; i++) {
+        int b = batch[i];
+        int j = i;
+        while (j > 0 && wb->number[batch[j - 1]] > wb->number[b]) {
+            batch[j] = batch[j - 1];
+            j--;
+        }
+        batch[j] = b;
+    }
+    spin_unlock(&wb->lock);
+    return n;
+}
+
+// Splits a sorted batch into runs of adjacent pages and fills 'iov' with its buffers
+static int writeback_runs(writeback* wb, int* batch, int n, struct iovec* iov, writeback_run* runs) {
+    int n_runs = 0;
+    int i = 0;
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = writeback_buffer(wb, batch[i]);
+        iov[i].iov_len = wb->page_size;
+        if (i > 0 && wb->number[batch[i]] == wb->number[batch[i - 1]] + 1) {
+            runs[n_runs - 1].count++;
+        } else {
+            runs[n_runs].first = i;
+            runs[n_runs].count = 1;
+            runs[n_runs].offset = (off_t)wb->number[batch[i]] * wb->page_size;
+            n_runs++;
+        }
+    }
+    return n_runs;
+}
+
+// Writes a run whose vectored write came up short one page at a time, marking the pages that failed
+static void writeback_retry(writeback* wb, int* batch, writeback_run* run, int* failed) {
+    int i = 0;
+    for (i = run->first; i < run->first + run->count; i++) {
+        off_t offset = (off_t)wb->number[batch[i]] * wb->page_size;
+        failed[i] = writeback_write(wb->fd, writeback_buffer(wb, batch[i]), wb->page_size, offset) == -1;
+    }
+}
+
+// Frees the buffers of a written batch
+static void writeback_finish(writeback* wb, int* batch, int n, int* failed) {
+    spin_lock(&wb->lock);
+    int i = 0;
+    for (i = 0; i < n; i++) {
+        wb->state[batch[i]] = failed[i] ? WB_FAILED : WB_FREE;
+    }
+    spin_unlock(&wb->lock);
+
+    atomic_fetch_add_explicit(&wb->writes, n, memory_order_relaxed);
+    atomic_fetch_add_explicit(&wb->batches, 1, memory_order_relaxed);
+    atomic_fetch_sub(&wb->busy, n);
+}
+
+static void writeback_pwritev(writeback* wb, int* batch, int n_runs, struct iovec* iov, writeback_run* runs, int* failed) {
+    int r = 0;
+    for (r = 0; r < n_runs; r++) {
+        size_t len = (size_t)runs[r].count * wb->page_size;
+        ssize_t written = pwritev(wb->fd, &iov[runs[r].first], runs[r].count, runs[r].offset);
+        if (written != (ssize_t)len) {
+            writeback_retry(wb, batch, &runs[r], failed);
+        }
+    }
+}
+
+#ifndef MM_NO_IO_URING
+static int uring_setup(writeback* wb) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    wb->ring_fd = syscall(__NR_io_uring_setup, WRITEBACK_BUFFERS, &p);
+    if (wb->ring_fd == -1) {
+        return -1;
+    }
+
+    wb->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    wb->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (wb->cq_ring_size > wb->sq_ring_size) {
+            wb->sq_ring_size = wb->cq_ring_size;
+        }
+        wb->cq_ring_size = wb->sq_ring_size;
+    }
+    wb->sq_ring = mmap(NULL, wb->sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, wb->ring_fd, IORING_OFF_SQ_RING);
+    if (wb->sq_ring == MAP_FAILED) {
+        close(wb->ring_fd);
+        wb->ring_fd = -1;
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        wb->cq_ring = wb->sq_ring;
+    } else {
+        wb->cq_ring = mmap(NULL, wb->cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, wb->ring_fd, IORING_OFF_CQ_RING);
+    }
+    wb->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                    wb->ring_fd, IORING_OFF_SQES);
+    if (wb->cq_ring == MAP_FAILED || wb->sqes == MAP_FAILED) {
+        munmap(wb->sq_ring, wb->sq_ring_size);
+        if (wb->cq_ring != MAP_FAILED && wb->cq_ring != wb->sq_ring) {
+            munmap(wb->cq_ring, wb->cq_ring_size);
+        }
+        close(wb->ring_fd);
+        wb->ring_fd = -1;
+        return -1;
+    }
+
+    char *sq = wb->sq_ring;
+    char *cq = wb->cq_ring;
+    wb->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    wb->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    wb->sq_array = (unsigned*)(sq + p.sq_off.array);
+    wb->cq_head = (unsigned*)(cq + p.cq_off.head);
+    wb->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    wb->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    wb->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_teardown(writeback* wb) {
+    if (wb->ring_fd == -1) {
+        return;
+    }
+    munmap(wb->sqes, WRITEBACK_BUFFERS * sizeof(struct io_uring_sqe));
+    if (wb->cq_ring != wb->sq_ring) {
+        munmap(wb->cq_ring, wb->cq_ring_size);
+    }
+    munmap(wb->sq_ring, wb->sq_ring_size);
+    close(wb->ring_fd);
+}
+
+// Submits one write per run and waits for all of them. Runs the ring rejects are written with pwritev.
+static void writeback_uring(writeback* wb, int* batch, int n_runs, struct iovec* iov, writeback_run* runs, int* failed) {
+    unsigned tail = *wb->sq_tail;
+    unsigned mask = *wb->sq_mask;
+    int r = 0;
+    for (r = 0; r < n_runs; r++) {
+        unsigned slot = tail & mask;
+        struct io_uring_sqe *sqe = &wb->sqes[slot];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = wb->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&iov[runs[r].first];
+        sqe->len = runs[r].count;
+        sqe->off = runs[r].offset;
+        sqe->user_data = r;
+        wb->sq_array[slot] = slot;
+        tail++;
+    }
+    atomic_store_explicit((_Atomic unsigned*)wb->sq_tail, tail, memory_order_release);
+
+    int submitted = 0;
+    int completed = 0;
+    while (completed < n_runs) {
+        int ret = syscall(__NR_io_uring_enter, wb->ring_fd, n_runs - submitted, n_runs - completed,
+                          IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret == -1 && errno != EINTR) {
+            break;
+        }
+        if (ret > 0) {
+            submitted += ret;
+        }
+
+        unsigned head = *wb->cq_head;
+        unsigned cq_tail = atomic_load_explicit((_Atomic unsigned*)wb->cq_tail, memory_order_acquire);
+        while (head != cq_tail) {
+            struct io_uring_cqe *cqe = &wb->cqes[head & *wb->cq_mask];
+            writeback_run *run = &runs[cqe->user_data];
+            if (cqe->res != (int)((size_t)run->count * wb->page_size)) {
+                writeback_retry(wb, batch, run, failed);
+            }
+            head++;
+            completed++;
+        }
+        atomic_store_explicit((_Atomic unsigned*)wb->cq_head, head, memory_order_release);
+    }
+
+    if (completed < n_runs) {
+        // The ring is unusable, write everything again without it
+        writeback_pwritev(wb, batch, n_runs, iov, runs, failed);
+    }
+}
+#endif
+
+static void *writeback_thread(void* arg) {
+    writeback *wb = arg;
+    int batch[WRITEBACK_BUFFERS];
+    int failed[WRITEBACK_BUFFERS];
+    struct iovec iov[WRITEBACK_BUFFERS];
+    writeback_run runs[WRITEBACK_BUFFERS];
+
+    while (1) {
+        if (sem_wait(&wb->work) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (atomic_load(&wb->stop)) {
+            break;
+        }
+
+        // Earlier wake ups may have taken this buffer already
+        int n = writeback_take(wb, batch);
+        if (n == 0) {
+            continue;
+        }
+        memset(failed, 0, sizeof(failed));
+        int n_runs = writeback_runs(wb, batch, n, iov, runs);
+#ifndef MM_NO_IO_URING
+        if (wb->ring_fd != -1) {
+            writeback_uring(wb, batch, n_runs, iov, runs, failed);
+        } else {
+            writeback_pwritev(wb, batch, n_runs, iov, runs, failed);
+        }
+#else
+        writeback_pwritev(wb, batch, n_runs, iov, runs, failed);
+#endif
+        writeback_finish(wb, batch, n, failed);
+    }
+    return NULL;
+}
+
+// Starts the writer threads for the file 'fd'
+int writeback_init(mm_context* ctx, int fd) {
+    writeback *wb = calloc(1, sizeof(writeback));
+    if (wb == NULL) {
+        return -1;
+    }
+    wb->fd = fd;
+    wb->page_size = ctx->page_size;
+    wb->data = mmap(NULL, (size_t)WRITEBACK_BUFFERS * ctx->page_size, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (wb->data == MAP_FAILED || sem_init(&wb->work, 0, 0) == -1) {
+        free(wb);
+        return -1;
+    }
+
+    // One thread drives the ring, without it a few threads write in parallel
+    int n_threads = WRITEBACK_THREADS;
+#ifndef MM_NO_IO_URING
+    if (uring_setup(wb) == 0) {
+        n_threads = 1;
+    }
+#endif
+    for (wb->n_threads = 0; wb->n_threads < n_threads; wb->n_threads++) {
+        if (pthread_create(&wb->threads[wb->n_threads], NULL, writeback_thread, wb) != 0) {
+            break;
+        }
+    }
+    if (wb->n_threads == 0) {
+#ifndef MM_NO_IO_URING
+        uring_teardown(wb);
+#endif
+        sem_destroy(&wb->work);
+        munmap(wb->data, (size_t)WRITEBACK_BUFFERS * ctx->page_size);
+        free(wb);
+        return -1;
+    }
+    ctx->writeback = wb;
+    return 0;
+}
+
+// Queues the contents of page 'number' for writing. Returns 1 if they were queued, or 0 if every buffer
+// is busy, in which case no older write of the page is pending any more and the caller writes it itself.
+// Called with the page's lock held.
+int writeback_queue(mm_context* ctx, int number, const void* data) {
+    writeback *wb = ctx->writeback;
+    int i = -1;
+    while (1) {
+        spin_lock(&wb->lock);
+        i = writeback_find(wb, number);
+        if (i >= 0 && wb->state[i] == WB_QUEUED) {
+            // Not taken by a writer yet, the new contents replace the old ones
+            memcpy(writeback_buffer(wb, i), data, wb->page_size);
+            spin_unlock(&wb->lock);
+            return 1;
+        }
+        if (i >= 0 && wb->state[i] == WB_FAILED) {
+            // Try again with the new contents
+            atomic_fetch_add(&wb->busy, 1);
+            break;
+        }
+        if (i >= 0) {
+            // The previous contents are being written, wait for them
+            spin_unlock(&wb->lock);
+            sched_yield();
+            continue;
+        }
+
+        for (i = 0; i < WRITEBACK_BUFFERS && wb->state[i] != WB_FREE; i++);
+        if (i == WRITEBACK_BUFFERS) {
+            spin_unlock(&wb->lock);
+            return 0;
+        }
+        wb->number[i] = number;
+        atomic_fetch_add(&wb->busy, 1);
+        break;
+    }
+    wb->state[i] = WB_FILLING;
+    spin_unlock(&wb->lock);
+
+    // Only this thread touches a filling buffer
+    memcpy(writeback_buffer(wb, i), data, wb->page_size);
+
+    spin_lock(&wb->lock);
+    wb->state[i] = WB_QUEUED;
+    wb->queue[(wb->head + wb->queued++) % WRITEBACK_BUFFERS] = i;
+    spin_unlock(&wb->lock);
+    sem_post(&wb->work);
+    return 1;
+}
+
+// Copies the contents of page 'number' into 'out' if a buffer still holds them. Returns 1 if it did.
+// Called with the page's lock held.
+int writeback_read(mm_context* ctx, int number, void* out) {
+    writeback *wb = ctx->writeback;
+    spin_lock(&wb->lock);
+    int i = writeback_find(wb, number);
+    if (i >= 0) {
+        memcpy(out, writeback_buffer(wb, i), wb->page_size);
+    }
+    spin_unlock(&wb->lock);
+    if (i < 0) {
+        return 0;
+    }
+    atomic_fetch_add_explicit(&wb->hits, 1, memory_order_relaxed);
+    return 1;
+}
+
+// Waits until every queued write is done
+void writeback_drain(mm_context* ctx) {
+    writeback *wb = ctx->writeback;
+    if (wb == NULL) {
+        return;
+    }
+    while (atomic_load(&wb->busy) > 0) {
+        sched_yield();
+    }
+}
+
+// Fills the write back counters of a stats snapshot
+void writeback_report(mm_context* ctx, mm_stats* stats) {
+    writeback *wb = ctx->writeback;
+    if (wb == NULL) {
+        return;
+    }
+    stats->async_writes = atomic_load_explicit(&wb->writes, memory_order_relaxed);
+    stats->write_batches = atomic_load_explicit(&wb->batches, memory_order_relaxed);
+    stats->inflight_hits = atomic_load_explicit(&wb->hits, memory_order_relaxed);
+}
+
+// Writes everything still queued, stops the threads and writes the pages of failed buffers one last time
+void writeback_destroy(mm_context* ctx) {
+    writeback *wb = ctx->writeback;
+    if (wb == NULL) {
+        return;
+    }
+    writeback_drain(ctx);
+    atomic_store(&wb->stop, 1);
+    int i = 0;
+    for (i = 0; i < wb->n_threads; i++) {
+        sem_post(&wb->work);
+    }
+    for (i = 0; i < wb->n_threads; i++) {
+        pthread_join(wb->threads[i], NULL);
+    }
+    for (i = 0; i < WRITEBACK_BUFFERS; i++) {
+        if (wb->state[i] == WB_FAILED) {
+            writeback_write(wb->fd, writeback_buffer(wb, i), wb->page_size, (off_t)wb->number[i] * wb->page_size);
+        }
+    }
+#ifndef MM_NO_IO_URING
+    uring_teardown(wb);
+#endif
+    sem_destroy(&wb->work);
+    munmap(wb->data, (size_t)WRITEBACK_BUFFERS * wb->page_size);
+    free(wb);
+    ctx->writeback = NULL;
+}
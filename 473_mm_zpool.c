@@ -0,0 +1,380 @@
+#include "473_mm_internal.h"
+#include <string.h>
+
+// Compressed tier for regions with 'reclaim' set
+//
+// Before an evicted page goes to the swap file it is offered to this pool. A page whose 8-byte words are all
+// equal (zero-filled pages included) is only recorded as that word. Other pages are compressed with a small
+// LZ77 codec in the style of LZ4: a token byte holds the literal length and the match length, followed by the
+// literals and a 2-byte match offset, and lengths of 15 or more continue in extra bytes. Matches are looked
+// for in the 64 KiB before the current position, however large the page. A page that does not shrink to 3/4
+// of its size goes to the swap file instead.
+//
+// Compressed pages are kept in an arena of 'compress_budget' bytes, rounded down to whole slabs, mapped at
+// mm_init. Slabs are ZPOOL_SLAB bytes, or the size of the largest class if that is larger, so a slab always
+// holds at least one chunk. A slab is cut into chunks of one size class (multiples of ZPOOL_ALIGN) the first
+// time that class needs room. Freed chunks go back to the free list of their class, slabs are never
+// handed to another class. When no chunk is free and no slab is left, the page goes to the swap file.
+//
+// Like the swap file, the pool keeps its copy of a page after the page faults back in, so evicting it again
+// unmodified costs nothing. All pool operations are done under zpool->lock, which also covers the scratch
+// buffers, so nothing here allocates.
+
+#define ZPOOL_SLAB (64 * 1024)
+#define ZPOOL_ALIGN 64
+#define ZPOOL_NONE UINT64_MAX
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+// Where the pool keeps a page
+#define ZPAGE_EMPTY 0
+#define ZPAGE_SAME 1        // 'value' is the word the page is filled with
+#define ZPAGE_COMPRESSED 2  // 'value' is the offset of the chunk in the arena
+
+typedef struct zpage zpage;
+struct zpage {
+    uint64_t value;
+    uint32_t length;
+    uint32_t kind;
+};
+
+struct zpool {
+    mm_lock lock;
+    char *arena;
+    size_t slab_size;
+    size_t n_slabs;
+    size_t next_slab;
+    int n_classes;
+    uint64_t *free_chunks;  // first free chunk of each class, chained through their first 8 bytes
+    radix pages;            // zpage of every page number
+    unsigned char *scratch;
+    int *table;             // last position of each hash
+
+    // Statistics
+    uint64_t n_stored;
+    uint64_t n_same;
+    uint64_t stored_bytes;
+    uint64_t chunk_bytes;
+    atomic_ulong loads;
+};
+
+int zpool_init(mm_context* ctx, size_t budget) {
+    zpool *z = calloc(1, sizeof(zpool));
+    if (z == NULL) {
+        return -1;
+    }
+    ctx->zpool = z;
+
+    z->n_classes = (size_t)ctx->page_size * 3 / 4 / ZPOOL_ALIGN;
+    z->slab_size = (size_t)z->n_classes * ZPOOL_ALIGN > ZPOOL_SLAB ? (size_t)z->n_classes * ZPOOL_ALIGN : ZPOOL_SLAB;
+    z->n_slabs = budget / z->slab_size;
+    z->arena = NULL;
+    if (z->n_slabs > 0) {
+        z->arena = mmap(NULL, z->n_slabs * z->slab_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    }
+    z->free_chunks = malloc(z->n_classes * sizeof(uint64_t));
+    z->scratch = malloc(ctx->page_size);
+    z->table = malloc(sizeof(int) << LZ_HASH_BITS);
+    if (z->arena == MAP_FAILED || z->free_chunks == NULL || z->scratch == NULL || z->table == NULL
+            || radix_init(&z->pages, ctx->n_pages, sizeof(zpage)) == -1) {
+        return -1;
+    }
+
+    int i = 0;
+    for (i = 0; i < z->n_classes; i++) {
+        z->free_chunks[i] = ZPOOL_NONE;
+    }
+    return 0;
+}
+
+void zpool_destroy(mm_context* ctx) {
+    zpool *z = ctx->zpool;
+    if (z == NULL) {
+        return;
+    }
+    if (z->arena != NULL) {
+        munmap(z->arena, z->n_slabs * z->slab_size);
+    }
+    free(z->free_chunks);
+    radix_destroy(&z->pages);
+    free(z->scratch);
+    free(z->table);
+    free(z);
+    ctx->zpool = NULL;
+}
+
+// Codec
+
+static uint32_t lz_read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes a length that did not fit in its token nibble. Returns 0 if 'out' is full.
+static int lz_put_length(unsigned char* out, int* op, int limit, int length) {
+    while (length >= 255) {
+        if (*op >= limit) {
+            return 0;
+        }
+        out[(*op)++] = 255;
+        length -= 255;
+    }
+    if (*op >= limit) {
+        return 0;
+    }
+    out[(*op)++] = length;
+    return 1;
+}
+
+// Writes one sequence: 'n_literals' literals followed by a match, unless 'match' is 0
+static int lz_emit(unsigned char* out, int* op, int limit, const unsigned char* literals, int n_literals, int offset, int match) {
+    if (*op >= limit) {
+        return 0;
+    }
+    int lit_nibble = n_literals < 15 ? n_literals : 15;
+    int match_nibble = match == 0 ? 0 : (match - LZ_MIN_MATCH < 15 ? match - LZ_MIN_MATCH : 15);
+    out[(*op)++] = (lit_nibble << 4) | match_nibble;
+
+    if (lit_nibble == 15 && !lz_put_length(out, op, limit, n_literals - 15)) {
+        return 0;
+    }
+    if (*op + n_literals > limit) {
+        return 0;
+    }
+    memcpy(out + *op, literals, n_literals);
+    *op += n_literals;
+
+    if (match == 0) {
+        return 1;
+    }
+    if (*op + 2 > limit) {
+        return 0;
+    }
+    out[(*op)++] = offset & 0xff;
+    out[(*op)++] = offset >> 8;
+    if (match_nibble == 15 && !lz_put_length(out, op, limit, match - LZ_MIN_MATCH - 15)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Compresses 'n' bytes into at most 'limit' bytes of 'out'. Returns the compressed length, or 0 if it does not fit.
+static int lz_compress(const unsigned char* in, int n, unsigned char* out, int limit, int* table) {
+    memset(table, 0, sizeof(int) << LZ_HASH_BITS);
+    int ip = 0;
+    int anchor = 0;
+    int op = 0;
+
+    while (ip + LZ_MIN_MATCH <= n) {
+        uint32_t v = lz_read32(in + ip);
+        int h = lz_hash(v);
+        int ref = table[h];
+        table[h] = ip;
+        if (ref < ip && ip - ref <= 65535 && lz_read32(in + ref) == v) {
+            int match = LZ_MIN_MATCH;
+            while (ip + match < n && in[ref + match] == in[ip + match]) {
+                match++;
+            }
+            if (!lz_emit(out, &op, limit, in + anchor, ip - anchor, ip - ref, match)) {
+                return 0;
+            }
+            ip += match;
+            anchor = ip;
+        } else {
+            ip++;
+        }
+    }
+    if (anchor < n && !lz_emit(out, &op, limit, in + anchor, n - anchor, 0, 0)) {
+        return 0;
+    }
+    return op;
+}
+
+static int lz_get_length(const unsigned char* in, int* ip, int length) {
+    int byte = 255;
+    while (byte == 255) {
+        byte = in[(*ip)++];
+        length += byte;
+    }
+    return length;
+}
+
+// Decompresses exactly 'n' bytes into 'out'
+static void lz_decompress(const unsigned char* in, unsigned char* out, int n) {
+    int ip = 0;
+    int op = 0;
+    while (op < n) {
+        int token = in[ip++];
+        int n_literals = token >> 4;
+        if (n_literals == 15) {
+            n_literals = lz_get_length(in, &ip, n_literals);
+        }
+        memcpy(out + op, in + ip, n_literals);
+        ip += n_literals;
+        op += n_literals;
+        if (op >= n) {
+            break;
+        }
+
+        int offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        int match = token & 15;
+        if (match == 15) {
+            match = lz_get_length(in, &ip, match);
+        }
+        match += LZ_MIN_MATCH;
+        // Byte by byte, the match may overlap what it is copying
+        const unsigned char *ref = out + op - offset;
+        int i = 0;
+        for (i = 0; i < match; i++) {
+            out[op + i] = ref[i];
+        }
+        op += match;
+    }
+}
+
+// Slab allocator
+
+static uint64_t zpool_alloc(zpool* z, int class) {
+    if (z->free_chunks[class] == ZPOOL_NONE) {
+        if (z->next_slab == z->n_slabs) {
+            return ZPOOL_NONE;
+        }
+        // Cut a new slab into chunks of this class
+        size_t chunk = (size_t)(class + 1) * ZPOOL_ALIGN;
+        uint64_t start = z->next_slab++ * z->slab_size;
+        uint64_t offset = start + (z->slab_size / chunk - 1) * chunk;
+        while (1) {
+            memcpy(z->arena + offset, &z->free_chunks[class], sizeof(uint64_t));
+            z->free_chunks[class] = offset;
+            if (offset == start) {
+                break;
+            }
+            offset -= chunk;
+        }
+    }
+    uint64_t offset = z->free_chunks[class];
+    memcpy(&z->free_chunks[class], z->arena + offset, sizeof(uint64_t));
+    return offset;
+}
+
+static int zpool_class(int length) {
+    return (length + ZPOOL_ALIGN - 1) / ZPOOL_ALIGN - 1;
+}
+
+// Forgets the stored copy of a page. Called with zpool->lock held.
+static void zpool_forget(zpool* z, zpage* entry) {
+    if (entry->kind == ZPAGE_COMPRESSED) {
+        int class = zpool_class(entry->length);
+        memcpy(z->arena + entry->value, &z->free_chunks[class], sizeof(uint64_t));
+        z->free_chunks[class] = entry->value;
+        z->stored_bytes -= entry->length;
+        z->chunk_bytes -= (uint64_t)(class + 1) * ZPOOL_ALIGN;
+        z->n_stored--;
+    } else if (entry->kind == ZPAGE_SAME) {
+        z->n_same--;
+        z->n_stored--;
+    }
+    entry->kind = ZPAGE_EMPTY;
+}
+
+// Stores the contents of page 'number', read from 'data'. Returns 1 if the pool holds the page,
+// 0 if it has to go to the swap file. Either way an older copy in the pool is dropped.
+int zpool_store(mm_context* ctx, int number, const void* data) {
+    zpool *z = ctx->zpool;
+    zpage *entry = radix_get(&z->pages, number);
+    const uint64_t *words = data;
+    int n_words = ctx->page_size / sizeof(uint64_t);
+    int stored = 1;
+
+    spin_lock(&z->lock);
+    zpool_forget(z, entry);
+
+    int i = 1;
+    while (i < n_words && words[i] == words[0]) {
+        i++;
+    }
+    if (i == n_words) {
+        entry->kind = ZPAGE_SAME;
+        entry->value = words[0];
+        z->n_same++;
+        z->n_stored++;
+    } else {
+        int length = lz_compress(data, ctx->page_size, z->scratch, z->n_classes * ZPOOL_ALIGN, z->table);
+        uint64_t offset = length > 0 ? zpool_alloc(z, zpool_class(length)) : ZPOOL_NONE;
+        if (offset == ZPOOL_NONE) {
+            stored = 0;
+        } else {
+            memcpy(z->arena + offset, z->scratch, length);
+            entry->kind = ZPAGE_COMPRESSED;
+            entry->value = offset;
+            entry->length = length;
+            z->stored_bytes += length;
+            z->chunk_bytes += (uint64_t)(zpool_class(length) + 1) * ZPOOL_ALIGN;
+            z->n_stored++;
+        }
+    }
+
+    spin_unlock(&z->lock);
+    return stored;
+}
+
+// Copies the contents of page 'number' into 'out'. Returns 0 if the pool does not hold the page.
+// 'fault' counts the load as a fault served from the pool.
+int zpool_load(mm_context* ctx, int number, void* out, int fault) {
+    zpool *z = ctx->zpool;
+    zpage *entry = radix_find(&z->pages, number);
+    int loaded = 1;
+
+    spin_lock(&z->lock);
+    if (entry == NULL) {
+        loaded = 0;
+    } else if (entry->kind == ZPAGE_SAME) {
+        uint64_t *words = out;
+        int n_words = ctx->page_size / sizeof(uint64_t);
+        int i = 0;
+        for (i = 0; i < n_words; i++) {
+            words[i] = entry->value;
+        }
+    } else if (entry->kind == ZPAGE_COMPRESSED) {
+        lz_decompress((unsigned char*)z->arena + entry->value, out, ctx->page_size);
+    } else {
+        loaded = 0;
+    }
+    spin_unlock(&z->lock);
+
+    if (loaded && fault) {
+        atomic_fetch_add_explicit(&z->loads, 1, memory_order_relaxed);
+    }
+    return loaded;
+}
+
+// Forgets the stored copy of a page whose contents were discarded
+void zpool_drop(mm_context* ctx, int number) {
+    zpool *z = ctx->zpool;
+    zpage *entry = radix_find(&z->pages, number);
+    if (entry != NULL) {
+        spin_lock(&z->lock);
+        zpool_forget(z, entry);
+        spin_unlock(&z->lock);
+    }
+}
+
+void zpool_report(mm_context* ctx, mm_stats* stats) {
+    zpool *z = ctx->zpool;
+    if (z == NULL) {
+        return;
+    }
+    spin_lock(&z->lock);
+    stats->compressed_pages = z->n_stored;
+    stats->compressed_same_filled = z->n_same;
+    stats->compressed_bytes = z->stored_bytes;
+    stats->compressed_pool_bytes = z->chunk_bytes;
+    spin_unlock(&z->lock);
+    stats->compressed_faults = atomic_load_explicit(&z->loads, memory_order_relaxed);
+}
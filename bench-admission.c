@@ -0,0 +1,99 @@
+#include "473_mm.h"
+#include "mm_bench_workloads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Measures what the admission filter adds to the cost of a page fault, on fifo and clock with and without
+// it, as the number of frames grows. The accesses go through a region from mm_init_with_options, so every
+// fault takes the library's own path, and ns_per_fault is the whole fault including the filter. The filter
+// changes which accesses fault, so compare ns_per_fault between the rows with and without it, not the fault
+// counts. The effect on the hit ratio is measured by mm_bench -A on the same workloads.
+// Workloads are mm_bench's loopscan and zipfscan (see mm_bench_workloads.h), over eight times as many pages
+// as there are frames, writing with probability 1/4. Every configuration runs in its own child process.
+
+#define ACCESSES_PER_FRAME 4
+#define MIN_ACCESSES (1L << 18)
+
+const char *POLICY_NAMES[] = {"", "fifo", "clock", "lru", "2q", "arc", "clock-pro", "clock-bitmap"};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(int n_frames, int workload, int policy, int admission) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int n_pages = 8 * n_frames;
+    size_t vm_size = (size_t)n_pages * page_size;
+    long accesses = (long)ACCESSES_PER_FRAME * n_frames;
+    if (accesses < MIN_ACCESSES) {
+        accesses = MIN_ACCESSES;
+    }
+
+    RNG_STATE = 0x9E3779B97F4A7C15ull + workload + 1;
+    int *pages = malloc(accesses * sizeof(int));
+    unsigned char *writes = malloc(accesses);
+    if (pages == NULL || writes == NULL) {
+        printf("out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    generate_workload(workload, pages, accesses, n_pages, n_frames);
+    long k;
+    for (k = 0; k < accesses; k++) {
+        writes[k] = rng_double() < 0.25;
+    }
+
+    volatile char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mm_options options = {0};
+    options.admission = admission;
+    mm_init_with_options((void*)vm, vm_size, n_frames, page_size, policy, &options);
+
+    double start = now_ns();
+    for (k = 0; k < accesses; k++) {
+        volatile char *addr = vm + (size_t)pages[k] * page_size;
+        if (writes[k]) {
+            *addr = 1;
+        } else {
+            (void)*addr;
+        }
+    }
+    double elapsed = now_ns() - start;
+    unsigned long faults = mm_report_npage_faults();
+
+    printf("%d,%s,%s,%d,%ld,%lu,%.1f,%.1f\n", n_frames, WORKLOAD_NAMES[workload], POLICY_NAMES[policy], admission,
+           accesses, faults, faults ? elapsed / faults : 0.0, elapsed / accesses);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char** argv) {
+    int frames[] = {1024, 4096, 16384};
+    int workloads[] = {WORKLOAD_LOOPSCAN, WORKLOAD_ZIPFSCAN};
+    int policies[] = {MM_POLICY_FIFO, MM_POLICY_CLOCK};
+    int i, w, j, admission;
+
+    printf("frames,workload,policy,admission,accesses,faults,ns_per_fault,ns_per_access\n");
+    for (i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+            for (j = 0; j < sizeof(policies) / sizeof(policies[0]); j++) {
+                for (admission = 0; admission < 2; admission++) {
+                    fflush(stdout);
+                    pid_t pid = fork();
+                    if (pid == 0) {
+                        run(frames[i], workloads[w], policies[j], admission);
+                    }
+                    waitpid(pid, NULL, 0);
+                }
+            }
+        }
+    }
+    return 0;
+}
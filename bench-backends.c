@@ -0,0 +1,93 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Compares the SIGSEGV and userfaultfd backends on the access patterns of
+// test-code1.c to test-code6.c, scaled up to large regions. Each virtual page
+// of the original test becomes a block of SCALE pages and the frame count
+// grows by the same factor, so both backends see the same fault sequence.
+//
+// usage: ./bench_backends [scale]
+
+#define N_PAGES 5
+
+typedef struct pattern pattern;
+struct pattern {
+    const char *name;
+    const char *accesses;  // pairs of r/w and page index
+};
+
+pattern PATTERNS[] = {
+    {"test-code1/2", "r0w1w0r2r3r0r4w0r1"},
+    {"test-code3/4", "r0r1w0r2r3r0r4w0"},
+    {"test-code5/6", "r0w1r2r3r4r1r0r1r4"},
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(pattern *p, int policy, int backend, int scale) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int vm_size = N_PAGES * scale * page_size;
+
+    volatile char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mm_options options = {0};
+    options.backend = backend;
+    mm_init_with_options((void*)vm, vm_size, 4 * scale, page_size, policy, &options);
+
+    double start = now_ns();
+    const char *a;
+    for (a = p->accesses; a[0] != '\0'; a += 2) {
+        int block = a[1] - '0';
+        int i;
+        for (i = 0; i < scale; i++) {
+            volatile char *addr = vm + ((size_t)block * scale + i) * page_size;
+            if (a[0] == 'w') {
+                *addr = 1;
+            } else {
+                (void)*addr;
+            }
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    unsigned long faults = mm_report_npage_faults();
+    printf("%-14s %-6s %-12s %10lu %10lu %12.1f\n", p->name, policy == 1 ? "fifo" : "clock",
+           backend == MM_BACKEND_SIGSEGV ? "sigsegv" : "userfaultfd",
+           faults, mm_report_nwrite_backs(), faults ? elapsed / faults : 0.0);
+    mm_destroy();
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+    int scale = argc > 1 ? atoi(argv[1]) : 4096;
+    int n_patterns = sizeof(PATTERNS) / sizeof(PATTERNS[0]);
+    int i, policy, backend;
+
+    printf("%-14s %-6s %-12s %10s %10s %12s\n", "workload", "policy", "backend", "faults", "writebacks", "ns/fault");
+    for (i = 0; i < n_patterns; i++) {
+        for (policy = 1; policy <= 2; policy++) {
+            for (backend = MM_BACKEND_SIGSEGV; backend <= MM_BACKEND_USERFAULTFD; backend++) {
+                fflush(stdout);
+                pid_t pid = fork();
+                if (pid == 0) {
+                    run(&PATTERNS[i], policy, backend, scale);
+                }
+                waitpid(pid, NULL, 0);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "473_mm.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Cost of a page fault through the C API (mm_create with the policy and page size given at run time)
+// and through mm::ManagedRegion (both fixed at compile time), for every policy. Like bench_faults, every
+// run is a child process and reads cyclically over twice as many pages as there are frames, so every access
+// is a fault. The two APIs alternate, ROUNDS times each, and the fastest round of each is reported, since
+// the kernel's signal delivery and mprotect dominate and vary from round to round.
+
+#define FRAMES 4096
+#define PASSES 4
+#define ROUNDS 5
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Warms every frame up once, then returns the ns per fault of PASSES passes
+static double cycle(volatile char* vm, size_t page_size, int n_pages, mm_context* ctx) {
+    int i, pass;
+    for (i = 0; i < n_pages; i++) {
+        (void)vm[i * page_size];
+    }
+    unsigned long faults_before = mm_context_npage_faults(ctx);
+    double start = now_ns();
+    for (pass = 0; pass < PASSES; pass++) {
+        for (i = 0; i < n_pages; i++) {
+            (void)vm[i * page_size];
+        }
+    }
+    double elapsed = now_ns() - start;
+    unsigned long faults = mm_context_npage_faults(ctx) - faults_before;
+    return faults ? elapsed / faults : 0.0;
+}
+
+static double run_c(int policy) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int n_pages = 2 * FRAMES;
+    size_t vm_size = (size_t)n_pages * page_size;
+    char *vm = (char*)mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    mm_context *ctx = mm_create(vm, vm_size, FRAMES, page_size, policy, NULL);
+    double ns = cycle(vm, page_size, n_pages, ctx);
+    mm_destroy_context(ctx);
+    munmap(vm, vm_size);
+    return ns;
+}
+
+template <class Policy>
+static double run_cxx() {
+    mm::ManagedRegion<Policy> region(2 * FRAMES, FRAMES);
+    return cycle(region.template page<volatile char>(0), region.page_size, (int)region.pages(), region.context());
+}
+
+// Runs 'fn' in a child process and returns what it measured
+static double in_child(double (*fn)(int), int policy) {
+    int results[2];
+    double ns = 0.0;
+    if (pipe(results) == -1) {
+        return 0.0;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        ns = fn(policy);
+        if (write(results[1], &ns, sizeof(ns)) != sizeof(ns)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    if (read(results[0], &ns, sizeof(ns)) != sizeof(ns)) {
+        ns = 0.0;
+    }
+    waitpid(pid, NULL, 0);
+    close(results[0]);
+    close(results[1]);
+    return ns;
+}
+
+template <class Policy>
+static double run_cxx_policy(int) {
+    return run_cxx<Policy>();
+}
+
+template <class Policy>
+static void compare(const char* name) {
+    double best_c = 0.0, best_cxx = 0.0;
+    int round;
+    for (round = 0; round < ROUNDS; round++) {
+        double c = in_child(run_c, Policy::id);
+        double cxx = in_child(run_cxx_policy<Policy>, Policy::id);
+        if (round == 0 || c < best_c) {
+            best_c = c;
+        }
+        if (round == 0 || cxx < best_cxx) {
+            best_cxx = cxx;
+        }
+    }
+    printf("%-12s %8d %12.1f %12.1f %+8.1f%%\n", name, FRAMES, best_c, best_cxx, (best_cxx / best_c - 1) * 100);
+}
+
+int main(int argc, char** argv) {
+    printf("%-12s %8s %12s %12s %9s\n", "policy", "frames", "c ns/fault", "c++ ns/fault", "diff");
+    compare<mm::Fifo>("fifo");
+    compare<mm::Clock>("clock");
+    compare<mm::Lru>("lru");
+    compare<mm::TwoQ>("2q");
+    compare<mm::Arc>("arc");
+    compare<mm::ClockPro>("clock-pro");
+    compare<mm::ClockBitmap>("clock-bitmap");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Streaming workload managed in single pages and in extents of 16 and 512 pages (2 MiB with 4 KiB pages),
+// with and without 'dirty_subpages', and 2 MiB extents on transparent huge pages. A region of REGION_MB with
+// 'reclaim' and a quarter of it in frames is scanned PASSES times with clock, reading one int of every page
+// and writing one in every WRITE_EVERY pages. Every run is a child process with a region aligned to 2 MiB.
+// Reports page faults and protection faults (the faults the scan took), write backs, the pages partial write
+// backs wrote and skipped, the page table's memory, the memory on huge pages at the end and the wall time.
+
+#define REGION_MB 256
+#define PASSES 4
+#define WRITE_EVERY 64
+#define ALIGN (2 << 20)
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void run(int extent_pages, int dirty, int huge) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    size_t vm_size = (size_t)REGION_MB << 20;
+    int n_pages = vm_size / page_size;
+    int page_ints = page_size / sizeof(int);
+
+    char *raw = mmap(NULL, vm_size + ALIGN, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+    int *vm = (int*)(((uintptr_t)raw + ALIGN - 1) / ALIGN * ALIGN);
+
+    mm_options options = {0};
+    options.reclaim = 1;
+    options.extent_pages = extent_pages;
+    options.dirty_subpages = dirty;
+    options.huge_pages = huge;
+    mm_context *ctx = mm_create(vm, vm_size, n_pages / extent_pages / 4, page_size, MM_POLICY_CLOCK, &options);
+
+    double start = now_ms();
+    int i, pass;
+    for (pass = 0; pass < PASSES; pass++) {
+        for (i = 0; i < n_pages; i++) {
+            if (i % WRITE_EVERY == 0) {
+                vm[(size_t)i * page_ints] = pass + i;
+            } else {
+                (void)*(volatile int*)&vm[(size_t)i * page_ints];
+            }
+        }
+    }
+    double elapsed = now_ms() - start;
+
+    mm_stats stats;
+    mm_context_get_stats(ctx, &stats);
+    printf("%d,%d,%d,%lu,%lu,%lu,%lu,%lu,%.1f,%.1f,%.1f\n", extent_pages, dirty, huge,
+           (unsigned long)stats.page_faults, (unsigned long)stats.protection_faults, (unsigned long)stats.write_backs,
+           (unsigned long)stats.subpages_written, (unsigned long)stats.subpages_skipped,
+           stats.page_index_bytes / 1024.0, stats.huge_page_bytes / (double)(1 << 20), elapsed);
+    mm_destroy_context(ctx);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char** argv) {
+    int configs[][3] = {{1, 0, 0}, {16, 0, 0}, {16, 1, 0}, {512, 0, 0}, {512, 1, 0}, {512, 0, 1}};
+    int i;
+
+    printf("extent_pages,dirty_subpages,huge_pages,page_faults,protection_faults,write_backs,"
+           "subpages_written,subpages_skipped,index_kb,huge_mb,ms\n");
+    for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            run(configs[i][0], configs[i][1], configs[i][2]);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
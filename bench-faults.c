@@ -0,0 +1,75 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Measures the average cost of a page fault as the number of frames grows.
+// Every configuration runs in its own child process so that each mm_init
+// starts from a clean state. The access pattern is a cyclic read over twice
+// as many pages as there are frames, so every access is a fault under every
+// policy.
+
+#define PASSES 3
+
+const char *POLICY_NAMES[] = {"", "fifo", "clock", "lru", "2q", "arc", "clock-pro"};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(int n_frames, int policy) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int n_pages = 2 * n_frames;
+    int vm_size = n_pages * page_size;
+
+    volatile char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mm_init((void*)vm, vm_size, n_frames, page_size, policy);
+
+    // Warm up: fill every frame once
+    int i, pass;
+    for (i = 0; i < n_pages; i++) {
+        (void)vm[i * page_size];
+    }
+
+    unsigned long faults_before = mm_report_npage_faults();
+    double start = now_ns();
+    for (pass = 0; pass < PASSES; pass++) {
+        for (i = 0; i < n_pages; i++) {
+            (void)vm[i * page_size];
+        }
+    }
+    double elapsed = now_ns() - start;
+    unsigned long faults = mm_report_npage_faults() - faults_before;
+
+    printf("%-10s %10d %12lu %12.1f\n", POLICY_NAMES[policy],
+           n_frames, faults, faults ? elapsed / faults : 0.0);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+    int frame_counts[] = {64, 256, 1024, 4096, 16384, 65536};
+    int n_counts = sizeof(frame_counts) / sizeof(frame_counts[0]);
+    int policy, i;
+
+    printf("%-10s %10s %12s %12s\n", "policy", "frames", "faults", "ns/fault");
+    for (policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK_PRO; policy++) {
+        for (i = 0; i < n_counts; i++) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                run(frame_counts[i], policy);
+            }
+            waitpid(pid, NULL, 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "473_mm_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Measures the cost of the clock hand alone, the list clock against the bitmap clock, from 1K to 1M frames.
+// The policy operations are called directly on a region from mm_create, the way handle_segv calls them,
+// but no memory is faulted or protected, so only the bookkeeping is timed. Accesses are uniform over
+// twice as many pages as there are frames and write with probability 1/2, so about half of them miss and
+// many resident pages have their referenced bit set when the hand comes by.
+// Every configuration runs in its own child process. 'victims' is a checksum of the evicted page numbers,
+// the two policies have to agree on it.
+
+#define ACCESSES_PER_FRAME 4
+
+const char *POLICY_NAMES[] = {"", "fifo", "clock", "lru", "2q", "arc", "clock-pro", "clock-bitmap"};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(int n_frames, int policy) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int n_pages = 2 * n_frames;
+    size_t vm_size = (size_t)n_pages * page_size;
+    long accesses = (long)ACCESSES_PER_FRAME * n_frames;
+
+    char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    virtual_page **resident = calloc(n_pages, sizeof(virtual_page*));
+    int *pages = malloc(accesses * sizeof(int));
+    if (vm == MAP_FAILED || resident == NULL || pages == NULL) {
+        printf("allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t rng = 88172645463325252ull;
+    long k = 0;
+    for (k = 0; k < accesses; k++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        pages[k] = (int)((rng >> 1) % n_pages) * 2 + (int)(rng & 1);
+    }
+
+    mm_context *ctx = mm_create(vm, vm_size, n_frames, page_size, policy, NULL);
+    mm_policy *ops = ctx->policy_ops;
+    long misses = 0;
+    uint64_t victims = 0;
+    uint64_t pick_total = 0;
+    uint64_t pick_max = 0;
+
+    double start = now_ns();
+    for (k = 0; k < accesses; k++) {
+        int number = pages[k] / 2;
+        int write = pages[k] & 1;
+        virtual_page *page = resident[number];
+        if (page != NULL) {
+            if (write && !page->modified) {
+                page->modified = 1;
+                ops->on_write(ctx->policy_state, page);
+            }
+            continue;
+        }
+
+        misses++;
+        if (ctx->resident_pages == ctx->n_frames) {
+            uint64_t pick_start = stats_ticks();
+            virtual_page *victim = ops->pick_victim(ctx->policy_state, number);
+            uint64_t pick_ticks = stats_ticks() - pick_start;
+            pick_total += pick_ticks;
+            if (pick_ticks > pick_max) {
+                pick_max = pick_ticks;
+            }
+            ops->on_evict(ctx->policy_state, victim);
+            if (victim->number >= 0) {
+                resident[victim->number] = NULL;
+            }
+            victims = victims * 31 + victim->number;
+            pool_free(ctx, victim);
+            ctx->resident_pages--;
+        }
+        page = init_page(ctx, number, vm + (size_t)number * page_size, write, 0);
+        ops->on_fault(ctx->policy_state, page);
+        if (write) {
+            ops->on_write(ctx->policy_state, page);
+        }
+        resident[number] = page;
+        ctx->resident_pages++;
+    }
+    double elapsed = now_ns() - start;
+
+    mm_stats stats;
+    mm_context_get_stats(ctx, &stats);
+    printf("%d,%s,%ld,%.2f,%.1f,%.1f,%.0f,%016llx\n", n_frames, POLICY_NAMES[policy], misses,
+           (double)stats.hand_steps / misses, elapsed / misses, pick_total / stats.ticks_per_ns / misses,
+           pick_max / stats.ticks_per_ns, (unsigned long long)victims);
+    mm_destroy_context(ctx);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char** argv) {
+    int frames[] = {1024, 4096, 16384, 65536, 262144, 1048576};
+    int policies[] = {MM_POLICY_CLOCK, MM_POLICY_CLOCK_BITMAP};
+    int i, j;
+
+    printf("frames,policy,misses,steps_per_miss,ns_per_miss,ns_per_pick,max_pick_ns,victims\n");
+    fflush(stdout);
+    for (i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        for (j = 0; j < sizeof(policies) / sizeof(policies[0]); j++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                run(frames[i], policies[j]);
+            }
+            waitpid(pid, NULL, 0);
+        }
+    }
+    return 0;
+}
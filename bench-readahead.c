@@ -0,0 +1,104 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Cost per page of sequential, strided and random scans with and without
+// readahead. The region has four times as many pages as frames and every
+// scan makes two passes over it, so each pass has to fault everything back
+// in. Each configuration runs in its own child process.
+//
+// usage: ./bench_readahead [n_frames]
+
+#define PASSES 2
+
+const char *SCANS[] = {"read", "write", "stride-4", "random"};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(int scan, int readahead, int n_frames) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int n_pages = 4 * n_frames;
+    int vm_size = n_pages * page_size;
+
+    volatile char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mm_options options = {0};
+    options.readahead = readahead;
+    mm_init_with_options((void*)vm, vm_size, n_frames, page_size, MM_POLICY_FIFO, &options);
+
+    int *order = malloc(n_pages * sizeof(int));
+    int i, pass, n = 0;
+    if (scan == 2) {
+        int start;
+        for (start = 0; start < 4; start++) {
+            for (i = start; i < n_pages; i += 4) {
+                order[n++] = i;
+            }
+        }
+    } else {
+        for (i = 0; i < n_pages; i++) {
+            order[n++] = i;
+        }
+    }
+    if (scan == 3) {
+        srand(1);
+        for (i = n_pages - 1; i > 0; i--) {
+            int j = rand() % (i + 1);
+            int t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+    }
+
+    double start = now_ns();
+    for (pass = 0; pass < PASSES; pass++) {
+        for (i = 0; i < n; i++) {
+            volatile char *addr = vm + (size_t)order[i] * page_size;
+            if (scan == 1) {
+                *addr = 1;
+            } else {
+                (void)*addr;
+            }
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    unsigned long prefetches = mm_report_nprefetches();
+    unsigned long avoided = mm_report_nfaults_avoided();
+    printf("%-10s %10d %10lu %10lu %10lu %9.1f%% %12.1f\n", SCANS[scan], readahead,
+           mm_report_npage_faults(), prefetches, avoided,
+           prefetches ? 100.0 * avoided / prefetches : 0.0, elapsed / (PASSES * n));
+    mm_destroy();
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+    int n_frames = argc > 1 ? atoi(argv[1]) : 4096;
+    int windows[] = {0, 8, 64};
+    int scan, i;
+
+    printf("%-10s %10s %10s %10s %10s %10s %12s\n", "scan", "readahead", "faults", "prefetched", "avoided",
+           "accuracy", "ns/page");
+    for (scan = 0; scan < 4; scan++) {
+        for (i = 0; i < 3; i++) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                run(scan, windows[i], n_frames);
+            }
+            waitpid(pid, NULL, 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Cost of routing a fault to its region as the number of managed regions
+// grows. Every region has 8 pages and 4 fifo frames, and the accesses walk
+// over all pages of all regions, so every access is a fault and consecutive
+// faults land in different regions. Each configuration runs in its own child
+// process.
+//
+// usage: ./bench_regions [passes]
+
+#define REGION_PAGES 8
+#define REGION_FRAMES 4
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(int n_regions, int passes) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int vm_size = REGION_PAGES * page_size;
+
+    // Leave an unmanaged page between regions so they are not adjacent
+    volatile char *vm = mmap(NULL, (size_t)n_regions * (vm_size + page_size), PROT_READ|PROT_WRITE,
+                             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mm_context **contexts = malloc(n_regions * sizeof(mm_context*));
+    int r, i, pass;
+    for (r = 0; r < n_regions; r++) {
+        void *start = (void*)(vm + (size_t)r * (vm_size + page_size));
+        contexts[r] = mm_create(start, vm_size, REGION_FRAMES, page_size, MM_POLICY_FIFO, NULL);
+    }
+
+    double start = now_ns();
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 0; i < REGION_PAGES; i++) {
+            for (r = 0; r < n_regions; r++) {
+                (void)vm[(size_t)r * (vm_size + page_size) + (size_t)i * page_size];
+            }
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    unsigned long faults = 0;
+    for (r = 0; r < n_regions; r++) {
+        faults += mm_context_npage_faults(contexts[r]);
+        mm_destroy_context(contexts[r]);
+    }
+    printf("%10d %12lu %12.1f\n", n_regions, faults, faults ? elapsed / faults : 0.0);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+    int passes = argc > 1 ? atoi(argv[1]) : 64;
+    int n_regions;
+
+    printf("%10s %12s %12s\n", "regions", "faults", "ns/fault");
+    for (n_regions = 1; n_regions <= 1024; n_regions *= 4) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            run(n_regions, passes);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// Worker processes using the same dataset, each with a private region and its share of the frame budget, or
+// all of them with one shared region from mm_shared_open and the whole budget. The dataset has DATA_PAGES
+// pages, the budget is a quarter of them. Every worker makes WORKER_ACCESSES accesses of one int per page,
+// 90% of them to a hot tenth of the pages, writing one in 16. The workers start together and run at once.
+// Reports the page faults of all workers (pages made resident), the faults on pages another worker had made
+// resident (shared regions only), the fault ratio, the wall time, and the memory the data takes (the pages
+// touched in every private copy, or in the shared object once).
+
+#define DATA_PAGES 8192
+#define WORKER_ACCESSES 200000
+
+typedef struct worker_result worker_result;
+struct worker_result {
+    unsigned long page_faults;
+    unsigned long shared_hits;
+    unsigned long touched;
+};
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static unsigned long touched_pages(void* vm, size_t vm_size, int page_size) {
+    size_t n = vm_size / page_size;
+    unsigned char *resident = malloc(n);
+    unsigned long count = 0;
+    if (resident != NULL && mincore(vm, vm_size, resident) == 0) {
+        size_t i;
+        for (i = 0; i < n; i++) {
+            count += resident[i] & 1;
+        }
+    }
+    free(resident);
+    return count;
+}
+
+static void work(int *vm, int page_ints, unsigned int seed) {
+    int hot = DATA_PAGES / 10;
+    long k;
+    for (k = 0; k < WORKER_ACCESSES; k++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = seed >> 4;
+        int page = r % 10 != 0 ? (int)((r / 10) % hot) : (int)((r / 10) % DATA_PAGES);
+        if ((r >> 20) % 16 == 0) {
+            vm[(size_t)page * page_ints] = page;
+        } else {
+            (void)*(volatile int*)&vm[(size_t)page * page_ints];
+        }
+    }
+}
+
+static void run(int n_workers, int shared) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    size_t vm_size = (size_t)DATA_PAGES * page_size;
+    int n_frames = DATA_PAGES / 4;
+    int page_ints = page_size / sizeof(int);
+    int results[2];
+    if (pipe(results) == -1) {
+        printf("pipe failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int *vm = NULL;
+    mm_context *ctx = NULL;
+    if (shared) {
+        ctx = mm_shared_open(NULL, vm_size, n_frames, page_size, (void**)&vm);
+        if (ctx == NULL) {
+            printf("shared region creation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = now_ms();
+    int i;
+    for (i = 0; i < n_workers; i++) {
+        if (fork() != 0) {
+            continue;
+        }
+        worker_result result = {0};
+        if (!shared) {
+            vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            ctx = mm_create(vm, vm_size, n_frames / n_workers, page_size, MM_POLICY_CLOCK, NULL);
+        }
+        work(vm, page_ints, 12345u + 977u * i);
+        mm_stats stats;
+        mm_context_get_stats(ctx, &stats);
+        result.page_faults = stats.page_faults;
+        result.shared_hits = stats.shared_hits;
+        if (!shared) {
+            result.touched = touched_pages(vm, vm_size, page_size);
+        }
+        if (write(results[1], &result, sizeof(result)) != sizeof(result)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    worker_result total = {0};
+    for (i = 0; i < n_workers; i++) {
+        worker_result result;
+        if (read(results[0], &result, sizeof(result)) == sizeof(result)) {
+            total.page_faults += result.page_faults;
+            total.shared_hits += result.shared_hits;
+            total.touched += result.touched;
+        }
+        wait(NULL);
+    }
+    double elapsed = now_ms() - start;
+    if (shared) {
+        total.touched = touched_pages(vm, vm_size, page_size);
+        mm_destroy_context(ctx);
+    }
+    close(results[0]);
+    close(results[1]);
+
+    long accesses = (long)n_workers * WORKER_ACCESSES;
+    printf("%d,%s,%d,%ld,%lu,%lu,%.4f,%.1f,%.1f\n", n_workers, shared ? "shared" : "private", n_frames, accesses,
+           total.page_faults, total.shared_hits, (double)total.page_faults / accesses, elapsed,
+           total.touched * (double)page_size / (1 << 20));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int workers[] = {1, 2, 4, 8};
+    int i, shared;
+
+    printf("workers,mode,frames,accesses,page_faults,shared_hits,fault_ratio,ms,data_mb\n");
+    fflush(stdout);
+    for (i = 0; i < sizeof(workers) / sizeof(workers[0]); i++) {
+        for (shared = 0; shared < 2; shared++) {
+            run(workers[i], shared);
+        }
+    }
+    return 0;
+}
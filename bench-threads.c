@@ -0,0 +1,117 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+// Fault throughput with 1 to 64 threads faulting at the same time.
+// In the disjoint workload every thread cycles over its own slice of the
+// region. In the overlapping workload every thread cycles over the whole
+// region, starting at a different offset. Each thread reads a page and
+// writes every fourth one. The region has twice as many pages as frames,
+// so most faults also evict a page. Each configuration runs in its own
+// child process.
+//
+// usage: ./bench_threads [n_frames]
+
+#define PASSES 4
+
+typedef struct worker worker;
+struct worker {
+    volatile char *vm;
+    int page_size;
+    int first;
+    int count;
+    int offset;
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *work(void *arg) {
+    worker *w = arg;
+    int pass, i;
+    for (pass = 0; pass < PASSES; pass++) {
+        for (i = 0; i < w->count; i++) {
+            int page = w->first + (i + w->offset) % w->count;
+            volatile char *addr = w->vm + (size_t)page * w->page_size;
+            if (page % 4 == 0) {
+                *addr = 1;
+            } else {
+                (void)*addr;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void run(int n_threads, int overlapping, int n_frames, int policy) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int n_pages = 2 * n_frames;
+    int vm_size = n_pages * page_size;
+
+    volatile char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+    mm_init((void*)vm, vm_size, n_frames, page_size, policy);
+
+    pthread_t threads[64];
+    worker workers[64];
+    int t;
+    for (t = 0; t < n_threads; t++) {
+        workers[t].vm = vm;
+        workers[t].page_size = page_size;
+        if (overlapping) {
+            workers[t].first = 0;
+            workers[t].count = n_pages;
+            workers[t].offset = t * (n_pages / n_threads);
+        } else {
+            workers[t].first = t * (n_pages / n_threads);
+            workers[t].count = n_pages / n_threads;
+            workers[t].offset = 0;
+        }
+    }
+
+    double start = now_ns();
+    for (t = 0; t < n_threads; t++) {
+        pthread_create(&threads[t], NULL, work, &workers[t]);
+    }
+    for (t = 0; t < n_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double elapsed = now_ns() - start;
+
+    unsigned long faults = mm_report_npage_faults();
+    printf("%-6s %-12s %8d %12lu %12lu %14.0f\n", policy == MM_POLICY_FIFO ? "fifo" : "clock",
+           overlapping ? "overlapping" : "disjoint", n_threads, faults, mm_report_nwrite_backs(),
+           faults / (elapsed / 1e9));
+    mm_destroy();
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+    int n_frames = argc > 1 ? atoi(argv[1]) : 4096;
+    int policy, overlapping, n_threads;
+
+    printf("%-6s %-12s %8s %12s %12s %14s\n", "policy", "workload", "threads", "faults", "writebacks", "faults/sec");
+    for (policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK; policy++) {
+        for (overlapping = 0; overlapping <= 1; overlapping++) {
+            for (n_threads = 1; n_threads <= 64; n_threads *= 2) {
+                fflush(stdout);
+                pid_t pid = fork();
+                if (pid == 0) {
+                    run(n_threads, overlapping, n_frames, policy);
+                }
+                waitpid(pid, NULL, 0);
+            }
+        }
+    }
+    return 0;
+}
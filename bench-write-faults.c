@@ -0,0 +1,93 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// Faults handled per page for write-heavy workloads. The region has twice
+// as many pages as frames and is walked over PASSES times, so every access
+// to a page is a page fault. The makefile builds this twice: bench_write_faults
+// tells writes from reads with the fault error code, bench_write_faults_fallback
+// is built with -DMM_NO_FAULT_ACCESS and maps every page read-only first.
+//
+// usage: ./bench_write_faults [n_frames]
+
+#define PASSES 3
+
+const char *WORKLOADS[] = {"write", "read+write", "1/4 write"};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(int workload, int policy, int backend, int n_frames) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    int n_pages = 2 * n_frames;
+    int vm_size = n_pages * page_size;
+
+    volatile char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mm_options options = {0};
+    options.backend = backend;
+    mm_init_with_options((void*)vm, vm_size, n_frames, page_size, policy, &options);
+
+    int i, pass;
+    double start = now_ns();
+    for (pass = 0; pass < PASSES; pass++) {
+        for (i = 0; i < n_pages; i++) {
+            volatile char *addr = vm + (size_t)i * page_size;
+            if (workload == 1) {
+                (void)*addr;
+                *addr = 1;
+            } else if (workload == 0 || i % 4 == 0) {
+                *addr = 1;
+            } else {
+                (void)*addr;
+            }
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    unsigned long faults = mm_report_npage_faults();
+    unsigned long protection_faults = mm_report_nprotection_faults();
+    printf("%-11s %-6s %-12s %10lu %12lu %10.2f %12.1f\n", WORKLOADS[workload],
+           policy == MM_POLICY_FIFO ? "fifo" : "clock",
+           backend == MM_BACKEND_SIGSEGV ? "sigsegv" : "userfaultfd",
+           faults, protection_faults, (double)(faults + protection_faults) / (PASSES * n_pages),
+           elapsed / (PASSES * n_pages));
+    mm_destroy();
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv) {
+    int n_frames = argc > 1 ? atoi(argv[1]) : 4096;
+    int workload, policy, backend;
+
+#ifdef MM_NO_FAULT_ACCESS
+    printf("fault access: not used\n");
+#else
+    printf("fault access: from the fault error code\n");
+#endif
+    printf("%-11s %-6s %-12s %10s %12s %10s %12s\n", "workload", "policy", "backend", "faults",
+           "prot faults", "faults/pg", "ns/page");
+    for (workload = 0; workload < 3; workload++) {
+        for (policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK; policy++) {
+            for (backend = MM_BACKEND_SIGSEGV; backend <= MM_BACKEND_USERFAULTFD; backend++) {
+                fflush(stdout);
+                pid_t pid = fork();
+                if (pid == 0) {
+                    run(workload, policy, backend, n_frames);
+                }
+                waitpid(pid, NULL, 0);
+            }
+        }
+    }
+    return 0;
+}
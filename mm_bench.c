@@ -0,0 +1,304 @@
+#include "473_mm.h"
+#include "mm_bench_workloads.h"
+#include <getopt.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Synthetic workload driver
+//
+// Runs every combination of workload, policy, region size and frame count given on the command line
+// and prints one line per run, as CSV (with a header) or as JSON lines. Every run gets its own child
+// process so each mm_init starts from a clean state. The access sequence is generated before the
+// clock starts, so only the accesses and the faults they cause are timed.
+//
+// Workloads are seq, stride, uniform, zipf, loop, hotcold, loopscan and zipfscan, see mm_bench_workloads.h.
+// Every access is a write with probability 'write_ratio', otherwise a read.
+//
+// A read of a resident page does not fault, so the hit ratio is 1 - page faults / accesses.
+// The fault latency percentiles come from the histogram of mm_get_stats(), they are the upper bound of
+// the bucket the percentile falls in.
+// With -m, 'mrc_frames' is the frame count the miss ratio curve predicts for a fault ratio of 10%, otherwise -1.
+// With -F every run backs its region with the same file, so later runs start from what earlier ones wrote.
+// 'inflight_hits' counts the faults served from a write buffer, see mm_stats. Build mm_bench_no_uring to compare
+// the io_uring writer with the pwritev thread pool.
+// With -A, 'admitted' and 'rejected' count the pages the admission filter let in and turned away, see mm_stats.
+// This is where the filter's effect on the hit ratio is measured, bench_admission only times its cost per fault.
+//
+// usage: ./mm_bench [options]
+//      -w, --workload LIST     workloads to run (default: all)
+//      -p, --policy LIST       fifo,clock,lru,2q,arc,clock-pro,clock-bitmap (default: all)
+//      -s, --size LIST         region sizes in MB (default: 16,256,1024)
+//      -f, --frames LIST       frame counts as a percentage of the region's pages (default: 10,50)
+//      -n, --accesses N        accesses per run (default: 100000)
+//      -r, --write-ratio R     fraction of accesses that write (default: 0.25)
+//      -b, --backend NAME      sigsegv or userfaultfd (default: sigsegv)
+//      -a, --readahead N       readahead window, 0 to disable (default: 0)
+//      -R, --reclaim           release evicted pages, see mm_options.reclaim
+//      -z, --compress MB       keep evicted pages compressed in a pool of MB megabytes, needs -R
+//      -B, --background        evict from a background reclaimer thread, see mm_options.reclaimer
+//      -m, --mrc N             estimate the miss ratio curve with N samples, see mm_options.mrc_samples
+//      -F, --file PATH         back the region with the file PATH, see mm_options.file_path
+//      -A, --admission         filter new pages with a frequency sketch, see mm_options.admission
+//      -j, --json              print JSON lines instead of CSV
+//      -S, --seed N            random seed (default: 1)
+// LIST is comma separated, e.g. ./mm_bench -w zipf,loop -p lru,arc -s 64 -f 5,25,50 -n 1000000
+
+#define MAX_ITEMS 16
+
+const char *POLICY_NAMES[] = {"", "fifo", "clock", "lru", "2q", "arc", "clock-pro", "clock-bitmap"};
+#define N_POLICIES 7
+
+typedef struct bench_config bench_config;
+struct bench_config {
+    int workload;
+    int policy;
+    long size_mb;
+    int frames_percent;
+    long accesses;
+    double write_ratio;
+    int backend;
+    int readahead;
+    int reclaim;
+    int reclaimer;
+    long compress_mb;
+    int mrc_samples;
+    const char *file_path;
+    int admission;
+    int json;
+    uint64_t seed;
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Upper bound in ns of the histogram bucket holding the given fraction of the faults
+static double latency_percentile(const uint64_t *histogram, double ticks_per_ns, double fraction) {
+    uint64_t total = 0;
+    int i;
+    for (i = 0; i < MM_LATENCY_BUCKETS; i++) {
+        total += histogram[i];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    uint64_t seen = 0;
+    for (i = 0; i < MM_LATENCY_BUCKETS - 1; i++) {
+        seen += histogram[i];
+        if (seen >= fraction * total) {
+            break;
+        }
+    }
+    return (double)(2ull << i) / ticks_per_ns;
+}
+
+static void run(bench_config *c) {
+    int page_size = sysconf(_SC_PAGE_SIZE);
+    size_t vm_size = (size_t)c->size_mb * 1024 * 1024;
+    if (vm_size / page_size > INT_MAX) {
+        printf("region of %ld MB is too large\n", c->size_mb);
+        exit(EXIT_FAILURE);
+    }
+    int n_pages = vm_size / page_size;
+    int n_frames = (int)((long)n_pages * c->frames_percent / 100);
+    if (n_frames < 1) {
+        n_frames = 1;
+    }
+
+    RNG_STATE = c->seed * 0x9E3779B97F4A7C15ull + c->workload + 1;
+    int *pages = malloc(c->accesses * sizeof(int));
+    unsigned char *writes = malloc(c->accesses);
+    if (pages == NULL || writes == NULL) {
+        printf("out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    generate_workload(c->workload, pages, c->accesses, n_pages, n_frames);
+    long k;
+    for (k = 0; k < c->accesses; k++) {
+        writes[k] = rng_double() < c->write_ratio;
+    }
+
+    volatile char *vm = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (vm == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mm_options options = {0};
+    options.backend = c->backend;
+    options.readahead = c->readahead;
+    options.reclaim = c->reclaim;
+    options.reclaimer = c->reclaimer;
+    options.compress_budget = (size_t)c->compress_mb * 1024 * 1024;
+    options.mrc_samples = c->mrc_samples;
+    options.file_path = c->file_path;
+    options.admission = c->admission;
+    double init_start = now_ns();
+    mm_init_with_options((void*)vm, vm_size, n_frames, page_size, c->policy, &options);
+    double init_ms = (now_ns() - init_start) / 1e6;
+
+    double start = now_ns();
+    for (k = 0; k < c->accesses; k++) {
+        volatile char *addr = vm + (size_t)pages[k] * page_size;
+        if (writes[k]) {
+            *addr = 1;
+        } else {
+            (void)*addr;
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    mm_stats stats;
+    mm_get_stats(&stats);
+    unsigned long faults = stats.page_faults;
+    unsigned long protection_faults = stats.protection_faults;
+    unsigned long write_backs = stats.write_backs;
+    double p50_ns = latency_percentile(stats.fault_latency, stats.ticks_per_ns, 0.5);
+    double p99_ns = latency_percentile(stats.fault_latency, stats.ticks_per_ns, 0.99);
+    double hit_ratio = 1.0 - (double)faults / c->accesses;
+    double faults_per_sec = faults / (elapsed / 1e9);
+    double ns_per_fault = faults ? elapsed / faults : 0.0;
+    int mrc_frames = mm_frames_for_fault_ratio(0.1);
+
+    if (c->json) {
+        printf("{\"workload\":\"%s\",\"policy\":\"%s\",\"backend\":\"%s\",\"size_mb\":%ld,\"pages\":%d,\"frames\":%d,"
+               "\"accesses\":%ld,\"write_ratio\":%.2f,\"faults\":%lu,\"protection_faults\":%lu,\"write_backs\":%lu,"
+               "\"hit_ratio\":%.4f,\"faults_per_sec\":%.0f,\"ns_per_fault\":%.1f,\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"compressed_faults\":%lu,\"mrc_frames\":%d,\"inflight_hits\":%lu,\"admitted\":%lu,\"rejected\":%lu,\"init_ms\":%.2f,\"elapsed_s\":%.3f}\n",
+               WORKLOAD_NAMES[c->workload], POLICY_NAMES[c->policy],
+               c->backend == MM_BACKEND_SIGSEGV ? "sigsegv" : "userfaultfd", c->size_mb, n_pages, n_frames,
+               c->accesses, c->write_ratio, faults, protection_faults, write_backs,
+               hit_ratio, faults_per_sec, ns_per_fault, p50_ns, p99_ns, (unsigned long)stats.compressed_faults, mrc_frames,
+               (unsigned long)stats.inflight_hits, (unsigned long)stats.admitted_pages, (unsigned long)stats.rejected_pages,
+               init_ms, elapsed / 1e9);
+    } else {
+        printf("%s,%s,%s,%ld,%d,%d,%ld,%.2f,%lu,%lu,%lu,%.4f,%.0f,%.1f,%.0f,%.0f,%lu,%d,%lu,%lu,%lu,%.2f,%.3f\n",
+               WORKLOAD_NAMES[c->workload], POLICY_NAMES[c->policy],
+               c->backend == MM_BACKEND_SIGSEGV ? "sigsegv" : "userfaultfd", c->size_mb, n_pages, n_frames,
+               c->accesses, c->write_ratio, faults, protection_faults, write_backs,
+               hit_ratio, faults_per_sec, ns_per_fault, p50_ns, p99_ns, (unsigned long)stats.compressed_faults, mrc_frames,
+               (unsigned long)stats.inflight_hits, (unsigned long)stats.admitted_pages, (unsigned long)stats.rejected_pages,
+               init_ms, elapsed / 1e9);
+    }
+    exit(EXIT_SUCCESS);
+}
+
+// Parses a comma separated list of names (looked up in 'names') or numbers into 'out'
+static int parse_list(char *arg, const char **names, int n_names, long *out) {
+    int n = 0;
+    char *item = strtok(arg, ",");
+    while (item != NULL && n < MAX_ITEMS) {
+        if (names == NULL) {
+            out[n++] = atol(item);
+        } else {
+            int i;
+            for (i = 0; i < n_names; i++) {
+                if (names[i][0] != '\0' && strcmp(item, names[i]) == 0) {
+                    break;
+                }
+            }
+            if (i == n_names) {
+                printf("unknown value '%s'\n", item);
+                exit(EXIT_FAILURE);
+            }
+            out[n++] = i;
+        }
+        item = strtok(NULL, ",");
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    long workloads[MAX_ITEMS] = {0, 1, 2, 3, 4, 5, 6, 7};
+    long policies[MAX_ITEMS] = {1, 2, 3, 4, 5, 6, 7};
+    long sizes[MAX_ITEMS] = {16, 256, 1024};
+    long frames[MAX_ITEMS] = {10, 50};
+    int n_workloads = N_WORKLOADS, n_policies = N_POLICIES, n_sizes = 3, n_frames = 2;
+
+    bench_config c;
+    memset(&c, 0, sizeof(c));
+    c.accesses = 100000;
+    c.write_ratio = 0.25;
+    c.seed = 1;
+
+    struct option long_options[] = {
+        {"workload", required_argument, NULL, 'w'},
+        {"policy", required_argument, NULL, 'p'},
+        {"size", required_argument, NULL, 's'},
+        {"frames", required_argument, NULL, 'f'},
+        {"accesses", required_argument, NULL, 'n'},
+        {"write-ratio", required_argument, NULL, 'r'},
+        {"backend", required_argument, NULL, 'b'},
+        {"readahead", required_argument, NULL, 'a'},
+        {"reclaim", no_argument, NULL, 'R'},
+        {"background", no_argument, NULL, 'B'},
+        {"compress", required_argument, NULL, 'z'},
+        {"mrc", required_argument, NULL, 'm'},
+        {"file", required_argument, NULL, 'F'},
+        {"admission", no_argument, NULL, 'A'},
+        {"json", no_argument, NULL, 'j'},
+        {"seed", required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "w:p:s:f:n:r:b:a:RBz:m:F:AjS:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'w': n_workloads = parse_list(optarg, WORKLOAD_NAMES, N_WORKLOADS, workloads); break;
+            case 'p': n_policies = parse_list(optarg, POLICY_NAMES, N_POLICIES + 1, policies); break;
+            case 's': n_sizes = parse_list(optarg, NULL, 0, sizes); break;
+            case 'f': n_frames = parse_list(optarg, NULL, 0, frames); break;
+            case 'n': c.accesses = atol(optarg); break;
+            case 'r': c.write_ratio = atof(optarg); break;
+            case 'b': c.backend = strcmp(optarg, "userfaultfd") == 0 ? MM_BACKEND_USERFAULTFD : MM_BACKEND_SIGSEGV; break;
+            case 'a': c.readahead = atoi(optarg); break;
+            case 'R': c.reclaim = 1; break;
+            case 'B': c.reclaimer = 1; break;
+            case 'z': c.compress_mb = atol(optarg); break;
+            case 'm': c.mrc_samples = atoi(optarg); break;
+            case 'F': c.file_path = optarg; break;
+            case 'A': c.admission = 1; break;
+            case 'j': c.json = 1; break;
+            case 'S': c.seed = strtoull(optarg, NULL, 10); break;
+            default:
+                printf("usage: %s [-w workloads] [-p policies] [-s sizes_mb] [-f frame_percents] [-n accesses]\n"
+                       "       [-r write_ratio] [-b sigsegv|userfaultfd] [-a readahead] [-R] [-B] [-z compress_mb] [-m mrc_samples] [-F file] [-A] [-j] [-S seed]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (!c.json) {
+        printf("workload,policy,backend,size_mb,pages,frames,accesses,write_ratio,faults,protection_faults,"
+               "write_backs,hit_ratio,faults_per_sec,ns_per_fault,p50_ns,p99_ns,compressed_faults,mrc_frames,inflight_hits,admitted,rejected,init_ms,elapsed_s\n");
+    }
+
+    int w, p, s, f;
+    for (w = 0; w < n_workloads; w++) {
+        for (p = 0; p < n_policies; p++) {
+            for (s = 0; s < n_sizes; s++) {
+                for (f = 0; f < n_frames; f++) {
+                    c.workload = workloads[w];
+                    c.policy = policies[p];
+                    c.size_mb = sizes[s];
+                    c.frames_percent = frames[f];
+                    fflush(stdout);
+                    pid_t pid = fork();
+                    if (pid == 0) {
+                        run(&c);
+                    }
+                    int status;
+                    waitpid(pid, &status, 0);
+                    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                        fprintf(stderr, "run failed: %s %s %ld MB %ld%%\n", WORKLOAD_NAMES[c.workload],
+                                POLICY_NAMES[c.policy], c.size_mb, frames[f]);
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
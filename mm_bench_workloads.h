@@ -0,0 +1,170 @@
+#ifndef _MM_BENCH_WORKLOADS_H
+#define _MM_BENCH_WORKLOADS_H
+
+#include <math.h>
+#include <stdint.h>
+
+/*
+Synthetic access sequences shared by mm_bench and bench_admission, so both measure the same workloads.
+
+Workloads, over a region of 'n_pages' pages:
+     seq      - one sequential pass from a random start, wrapping around
+     stride   - every 16th page, starting one page further on each wrap
+     uniform  - uniformly random pages
+     zipf     - Zipfian pages (theta 0.99), scattered over the region
+     loop     - repeated sequential scans over 1.5 times as many pages as there are frames
+     hotcold  - 90% of the accesses go to 10% of the pages
+     loopscan - repeated scans over half as many pages as there are frames, and after every fourth one a
+                scan over twice as many other pages
+     zipfscan - zipf, but every fifth block of 'frames' accesses is a sequential scan instead
+
+Set RNG_STATE before generating, the sequence depends only on it and the arguments.
+*/
+
+#define WORKLOAD_SEQ      0
+#define WORKLOAD_STRIDE   1
+#define WORKLOAD_UNIFORM  2
+#define WORKLOAD_ZIPF     3
+#define WORKLOAD_LOOP     4
+#define WORKLOAD_HOTCOLD  5
+#define WORKLOAD_LOOPSCAN 6
+#define WORKLOAD_ZIPFSCAN 7
+
+#define STRIDE 16
+#define ZIPF_THETA 0.99
+
+static const char *WORKLOAD_NAMES[] = {"seq", "stride", "uniform", "zipf", "loop", "hotcold", "loopscan", "zipfscan"};
+#define N_WORKLOADS 8
+
+static uint64_t RNG_STATE;
+
+static uint64_t rng_next() {
+    // xorshift64*
+    RNG_STATE ^= RNG_STATE >> 12;
+    RNG_STATE ^= RNG_STATE << 25;
+    RNG_STATE ^= RNG_STATE >> 27;
+    return RNG_STATE * 0x2545F4914F6CDD1Dull;
+}
+
+static double rng_double() {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Zipfian page numbers in [0, n), after Gray et al., "Quickly generating billion-record synthetic
+// databases". Rank 0 is the most popular; ranks are scattered over the region with a hash so the
+// hot pages are not neighbours.
+static void zipf_fill(int *pages, long count, int n) {
+    double zetan = 0;
+    int i;
+    for (i = 1; i <= n; i++) {
+        zetan += 1.0 / pow(i, ZIPF_THETA);
+    }
+    double zeta2 = 1.0 + 1.0 / pow(2, ZIPF_THETA);
+    double alpha = 1.0 / (1.0 - ZIPF_THETA);
+    double eta = (1.0 - pow(2.0 / n, 1.0 - ZIPF_THETA)) / (1.0 - zeta2 / zetan);
+
+    long k;
+    for (k = 0; k < count; k++) {
+        double u = rng_double();
+        double uz = u * zetan;
+        uint64_t rank;
+        if (uz < 1.0) {
+            rank = 0;
+        } else if (uz < zeta2) {
+            rank = 1;
+        } else {
+            rank = (uint64_t)(n * pow(eta * u - eta + 1.0, alpha));
+        }
+        // FNV-1a over the rank
+        uint64_t h = 14695981039346656037ull;
+        int b;
+        for (b = 0; b < 8; b++) {
+            h ^= (rank >> (8 * b)) & 0xff;
+            h *= 1099511628211ull;
+        }
+        pages[k] = (int)(h % n);
+    }
+}
+
+// Fills 'pages' with 'accesses' page numbers of the given workload
+static void generate_workload(int workload, int *pages, long accesses, int n_pages, int n_frames) {
+    long k;
+    switch (workload) {
+        case WORKLOAD_SEQ: {
+            int start = rng_next() % n_pages;
+            for (k = 0; k < accesses; k++) {
+                pages[k] = (start + k) % n_pages;
+            }
+            break;
+        }
+        case WORKLOAD_STRIDE: {
+            int per_wrap = (n_pages + STRIDE - 1) / STRIDE;
+            for (k = 0; k < accesses; k++) {
+                long wrap = k / per_wrap;
+                pages[k] = (int)(((k % per_wrap) * STRIDE + wrap) % n_pages);
+            }
+            break;
+        }
+        case WORKLOAD_UNIFORM:
+            for (k = 0; k < accesses; k++) {
+                pages[k] = rng_next() % n_pages;
+            }
+            break;
+        case WORKLOAD_ZIPF:
+            zipf_fill(pages, accesses, n_pages);
+            break;
+        case WORKLOAD_LOOP: {
+            long loop = (long)n_frames * 3 / 2;
+            if (loop > n_pages) {
+                loop = n_pages;
+            }
+            for (k = 0; k < accesses; k++) {
+                pages[k] = (int)(k % loop);
+            }
+            break;
+        }
+        case WORKLOAD_HOTCOLD: {
+            int hot = n_pages / 10 > 0 ? n_pages / 10 : 1;
+            for (k = 0; k < accesses; k++) {
+                if (rng_double() < 0.9) {
+                    pages[k] = rng_next() % hot;
+                } else {
+                    pages[k] = hot + rng_next() % (n_pages - hot > 0 ? n_pages - hot : 1);
+                }
+            }
+            break;
+        }
+        case WORKLOAD_LOOPSCAN: {
+            long loop = n_frames / 2 > 0 ? n_frames / 2 : 1;
+            long cold = n_pages - loop > 0 ? n_pages - loop : 1;
+            long scan = 2L * n_frames;
+            long cursor = 0;
+            k = 0;
+            while (k < accesses) {
+                long pass, i;
+                for (pass = 0; pass < 4 && k < accesses; pass++) {
+                    for (i = 0; i < loop && k < accesses; i++) {
+                        pages[k++] = (int)(i % n_pages);
+                    }
+                }
+                for (i = 0; i < scan && k < accesses; i++) {
+                    pages[k++] = (int)((loop + cursor++ % cold) % n_pages);
+                }
+            }
+            break;
+        }
+        case WORKLOAD_ZIPFSCAN: {
+            long block = n_frames;
+            long cursor = rng_next() % n_pages;
+            zipf_fill(pages, accesses, n_pages);
+            for (k = 0; k < accesses; k++) {
+                if ((k / block) % 5 == 4) {
+                    pages[k] = (int)(cursor++ % n_pages);
+                }
+            }
+            break;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,423 @@
+#include "473_mm_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Offline replay of a fault trace recorded through 'mm_options.trace_path'.
+//
+// The trace is loaded once and every (policy, frame count) pair is simulated side by side,
+// one block of events at a time, so the whole sweep is a single pass over the trace.
+// FIFO and clock follow the library: a read of a resident page is invisible, and the first
+// write to a clean resident page sets its referenced bit. OPT is Belady's algorithm, which
+// evicts the resident page whose next use lies furthest in the future.
+//
+// usage: ./mm_replay trace_file [frames ...]
+// Without frame counts, powers of two up to the number of distinct pages are simulated.
+
+#define BLOCK_EVENTS 65536
+
+#define SIM_FIFO 0
+#define SIM_CLOCK 1
+#define SIM_OPT 2
+#define N_SIM_POLICIES 3
+
+const char *SIM_NAMES[] = {"fifo", "clock", "opt"};
+
+// Trace after loading: dense page ids, write flags and the index of each page's next use
+int N_EVENTS;
+int N_IDS;
+int *EVENT_ID;
+unsigned char *EVENT_WRITE;
+int *NEXT_USE;
+
+typedef struct sim sim;
+struct sim {
+    int policy;
+    int frames;
+    unsigned long faults;
+    unsigned long write_backs;
+
+    int used;
+    int hand;           // fifo: oldest frame, clock: hand position
+    int *slot_of;       // frame holding each page id, or -1
+    int *frame_id;      // page id held by each frame, or -1
+    unsigned char *dirty;
+    unsigned char *referenced;
+
+    // opt: max-heap of frames keyed by next use
+    int *heap;
+    int *heap_pos;
+    int *key;
+};
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (p == NULL) {
+        printf("out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Dense ids of the page numbers seen so far, in an open addressing table that doubles when half full,
+// so the memory it takes grows with the distinct pages of the trace rather than the size of the region
+typedef struct id_map id_map;
+struct id_map {
+    uint32_t *numbers;
+    int *ids;           // -1 for a free slot
+    size_t mask;
+};
+
+static void id_map_init(id_map* map, size_t capacity) {
+    map->numbers = xcalloc(capacity, sizeof(uint32_t));
+    map->ids = xcalloc(capacity, sizeof(int));
+    memset(map->ids, -1, capacity * sizeof(int));
+    map->mask = capacity - 1;
+}
+
+static size_t id_map_slot(id_map* map, uint32_t number) {
+    size_t slot = (number * 2654435761u) & map->mask;
+    while (map->ids[slot] != -1 && map->numbers[slot] != number) {
+        slot = (slot + 1) & map->mask;
+    }
+    return slot;
+}
+
+// Returns the id of page 'number', giving it the next one if it has none yet
+static int id_map_get(id_map* map, uint32_t number) {
+    size_t slot = id_map_slot(map, number);
+    if (map->ids[slot] != -1) {
+        return map->ids[slot];
+    }
+    int id = N_IDS++;
+    map->numbers[slot] = number;
+    map->ids[slot] = id;
+
+    if ((size_t)N_IDS * 2 > map->mask) {
+        id_map old = *map;
+        size_t i;
+        id_map_init(map, (old.mask + 1) * 2);
+        for (i = 0; i <= old.mask; i++) {
+            if (old.ids[i] != -1) {
+                size_t moved = id_map_slot(map, old.numbers[i]);
+                map->numbers[moved] = old.numbers[i];
+                map->ids[moved] = old.ids[i];
+            }
+        }
+        free(old.numbers);
+        free(old.ids);
+    }
+    return id;
+}
+
+static void load_trace(const char* path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("cannot open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    mm_trace_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, MM_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        printf("%s is not a fault trace\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    fseek(f, 0, SEEK_END);
+    long n_records = (ftell(f) - (long)sizeof(header)) / (long)sizeof(mm_trace_record);
+    fseek(f, sizeof(header), SEEK_SET);
+
+    mm_trace_record *records = xcalloc(n_records > 0 ? n_records : 1, sizeof(mm_trace_record));
+    n_records = fread(records, sizeof(mm_trace_record), n_records, f);
+    fclose(f);
+
+    EVENT_ID = xcalloc(n_records + 1, sizeof(int));
+    EVENT_WRITE = xcalloc(n_records + 1, 1);
+    NEXT_USE = xcalloc(n_records + 1, sizeof(int));
+
+    // Map page numbers to dense ids so the simulators only size their tables by distinct pages
+    id_map id_of_page;
+    id_map_init(&id_of_page, 1024);
+
+    long i;
+    N_EVENTS = 0;
+    N_IDS = 0;
+    for (i = 0; i < n_records; i++) {
+        uint32_t page = records[i].page;
+        if (page == MM_TRACE_TIME_EXTEND) {
+            continue;
+        }
+        uint32_t number = page & ~MM_TRACE_WRITE;
+        if (number >= header.n_pages) {
+            continue;
+        }
+        EVENT_ID[N_EVENTS] = id_map_get(&id_of_page, number);
+        EVENT_WRITE[N_EVENTS] = (page & MM_TRACE_WRITE) != 0;
+        N_EVENTS++;
+    }
+    free(records);
+    free(id_of_page.numbers);
+    free(id_of_page.ids);
+
+    // Next use of the same page, N_EVENTS meaning never
+    int *last = xcalloc(N_IDS > 0 ? N_IDS : 1, sizeof(int));
+    for (i = 0; i < N_IDS; i++) {
+        last[i] = N_EVENTS;
+    }
+    for (i = N_EVENTS - 1; i >= 0; i--) {
+        NEXT_USE[i] = last[EVENT_ID[i]];
+        last[EVENT_ID[i]] = i;
+    }
+    free(last);
+}
+
+static sim *sim_create(int policy, int frames) {
+    sim *s = xcalloc(1, sizeof(sim));
+    s->policy = policy;
+    s->frames = frames;
+    s->slot_of = xcalloc(N_IDS, sizeof(int));
+    memset(s->slot_of, -1, N_IDS * sizeof(int));
+    s->frame_id = xcalloc(frames, sizeof(int));
+    memset(s->frame_id, -1, frames * sizeof(int));
+    s->dirty = xcalloc(frames, 1);
+    s->referenced = xcalloc(frames, 1);
+
+    if (policy == SIM_CLOCK) {
+        // clock_init starts the ring with blank referenced frames
+        memset(s->referenced, 1, frames);
+        s->used = frames;
+    } else if (policy == SIM_OPT) {
+        s->heap = xcalloc(frames, sizeof(int));
+        s->heap_pos = xcalloc(frames, sizeof(int));
+        s->key = xcalloc(frames, sizeof(int));
+    }
+    return s;
+}
+
+static void sim_free(sim* s) {
+    free(s->slot_of);
+    free(s->frame_id);
+    free(s->dirty);
+    free(s->referenced);
+    free(s->heap);
+    free(s->heap_pos);
+    free(s->key);
+    free(s);
+}
+
+// Loads page 'id' into frame 'slot', evicting whatever was there
+static void sim_load(sim* s, int slot, int id, int write) {
+    int victim = s->frame_id[slot];
+    if (victim != -1) {
+        s->slot_of[victim] = -1;
+        if (s->dirty[slot]) {
+            s->write_backs++;
+        }
+    }
+    s->frame_id[slot] = id;
+    s->slot_of[id] = slot;
+    s->dirty[slot] = write;
+    s->faults++;
+}
+
+static void run_fifo(sim* s, int start, int end) {
+    int t;
+    for (t = start; t < end; t++) {
+        int id = EVENT_ID[t];
+        int slot = s->slot_of[id];
+        if (slot != -1) {
+            s->dirty[slot] |= EVENT_WRITE[t];
+            continue;
+        }
+        if (s->used < s->frames) {
+            slot = s->used++;
+        } else {
+            slot = s->hand;
+            s->hand = slot + 1 == s->frames ? 0 : slot + 1;
+        }
+        sim_load(s, slot, id, EVENT_WRITE[t]);
+    }
+}
+
+static void run_clock(sim* s, int start, int end) {
+    int t;
+    for (t = start; t < end; t++) {
+        int id = EVENT_ID[t];
+        int slot = s->slot_of[id];
+        if (slot != -1) {
+            if (EVENT_WRITE[t] && !s->dirty[slot]) {
+                s->dirty[slot] = 1;
+                s->referenced[slot] = 1;
+            }
+            continue;
+        }
+        while (s->referenced[s->hand]) {
+            s->referenced[s->hand] = 0;
+            s->hand = s->hand + 1 == s->frames ? 0 : s->hand + 1;
+        }
+        slot = s->hand;
+        sim_load(s, slot, id, EVENT_WRITE[t]);
+        s->referenced[slot] = 1;
+        s->hand = slot + 1 == s->frames ? 0 : slot + 1;
+    }
+}
+
+static void heap_swap(sim* s, int a, int b) {
+    int slot_a = s->heap[a];
+    int slot_b = s->heap[b];
+    s->heap[a] = slot_b;
+    s->heap[b] = slot_a;
+    s->heap_pos[slot_b] = a;
+    s->heap_pos[slot_a] = b;
+}
+
+static void heap_up(sim* s, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (s->key[s->heap[parent]] >= s->key[s->heap[i]]) {
+            break;
+        }
+        heap_swap(s, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(sim* s, int i) {
+    while (1) {
+        int largest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < s->used && s->key[s->heap[left]] > s->key[s->heap[largest]]) {
+            largest = left;
+        }
+        if (right < s->used && s->key[s->heap[right]] > s->key[s->heap[largest]]) {
+            largest = right;
+        }
+        if (largest == i) {
+            return;
+        }
+        heap_swap(s, i, largest);
+        i = largest;
+    }
+}
+
+static void run_opt(sim* s, int start, int end) {
+    int t;
+    for (t = start; t < end; t++) {
+        int id = EVENT_ID[t];
+        int slot = s->slot_of[id];
+        if (slot != -1) {
+            // The next use can only move further away
+            s->dirty[slot] |= EVENT_WRITE[t];
+            s->key[slot] = NEXT_USE[t];
+            heap_up(s, s->heap_pos[slot]);
+            continue;
+        }
+        if (s->used < s->frames) {
+            slot = s->used;
+            s->heap[s->used] = slot;
+            s->heap_pos[slot] = s->used;
+            s->used++;
+            s->key[slot] = NEXT_USE[t];
+            heap_up(s, s->heap_pos[slot]);
+        } else {
+            slot = s->heap[0];
+            s->key[slot] = NEXT_USE[t];
+            heap_down(s, 0);
+        }
+        sim_load(s, slot, id, EVENT_WRITE[t]);
+    }
+}
+
+static void print_table(const char* title, sim** sims, int n_frame_counts, int which) {
+    printf("\n%s\n%10s", title, "frames");
+    int p, i;
+    for (p = 0; p < N_SIM_POLICIES; p++) {
+        printf(" %12s", SIM_NAMES[p]);
+    }
+    printf("\n");
+    for (i = 0; i < n_frame_counts; i++) {
+        printf("%10d", sims[i * N_SIM_POLICIES]->frames);
+        for (p = 0; p < N_SIM_POLICIES; p++) {
+            sim *s = sims[i * N_SIM_POLICIES + p];
+            printf(" %12lu", which == 0 ? s->faults : s->write_backs);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s trace_file [frames ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double load_start = now_sec();
+    load_trace(argv[1]);
+    double load_time = now_sec() - load_start;
+
+    int frame_counts[64];
+    int n_frame_counts = 0;
+    int i, p;
+    if (argc > 2) {
+        for (i = 2; i < argc && n_frame_counts < 64; i++) {
+            if (atoi(argv[i]) > 0) {
+                frame_counts[n_frame_counts++] = atoi(argv[i]);
+            }
+        }
+    } else {
+        int frames = 1;
+        while (n_frame_counts < 64) {
+            frame_counts[n_frame_counts++] = frames;
+            if (frames >= N_IDS) {
+                break;
+            }
+            frames *= 2;
+        }
+    }
+
+    int n_sims = n_frame_counts * N_SIM_POLICIES;
+    sim **sims = xcalloc(n_sims, sizeof(sim*));
+    for (i = 0; i < n_frame_counts; i++) {
+        for (p = 0; p < N_SIM_POLICIES; p++) {
+            sims[i * N_SIM_POLICIES + p] = sim_create(p, frame_counts[i]);
+        }
+    }
+
+    double start = now_sec();
+    int block;
+    for (block = 0; block < N_EVENTS; block += BLOCK_EVENTS) {
+        int end = block + BLOCK_EVENTS < N_EVENTS ? block + BLOCK_EVENTS : N_EVENTS;
+        for (i = 0; i < n_sims; i++) {
+            if (sims[i]->policy == SIM_FIFO) {
+                run_fifo(sims[i], block, end);
+            } else if (sims[i]->policy == SIM_CLOCK) {
+                run_clock(sims[i], block, end);
+            } else {
+                run_opt(sims[i], block, end);
+            }
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    printf("%d events, %d distinct pages, loaded in %.3f s\n", N_EVENTS, N_IDS, load_time);
+    printf("%d simulations in %.3f s (%.1f million trace events/s for the sweep, %.1f million simulated events/s)\n",
+           n_sims, elapsed, elapsed > 0 ? N_EVENTS / elapsed / 1e6 : 0.0,
+           elapsed > 0 ? (double)N_EVENTS * n_sims / elapsed / 1e6 : 0.0);
+
+    print_table("page faults", sims, n_frame_counts, 0);
+    print_table("write backs", sims, n_frame_counts, 1);
+
+    for (i = 0; i < n_sims; i++) {
+        sim_free(sims[i]);
+    }
+    free(sims);
+    return 0;
+}
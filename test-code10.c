@@ -0,0 +1,87 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Evicted pages are released and restored from the swap file ('reclaim'), with both backends.
+// Logs faults, write backs, pages released and pages restored after every pass, then whether
+// no more pages than frames were in memory and whether every page kept its value.
+void mm_log(FILE *, int);
+int resident_pages(void *, int, int);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 8;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int backend;
+	int i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(backend = MM_BACKEND_SIGSEGV; backend <= MM_BACKEND_USERFAULTFD; backend++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.backend = backend;
+		options.reclaim = 1;
+		mm_init_with_options((void*)vm_ptr, vm_size, 2, PAGE_SIZE, MM_POLICY_FIFO, &options);
+		mm_log(f1, PAGE_SIZE);
+
+		/* virtual memory access starts */
+
+		for(i = 0; i < n_pages; i++)
+			vm_ptr[i*page_ints] = i+1;		// Write every page
+		mm_log(f1, PAGE_SIZE);
+
+		int ok = 1;
+		for(i = 0; i < n_pages; i++)
+			ok = ok && vm_ptr[i*page_ints] == i+1;	// Read every page back
+		mm_log(f1, PAGE_SIZE);
+
+		/* virtual memory access ends */
+
+		int capped = resident_pages((void*)vm_ptr, vm_size, PAGE_SIZE) <= 2;
+		mm_destroy();
+
+		for(i = 0; i < n_pages; i++)
+			ok = ok && vm_ptr[i*page_ints] == i+1;
+		fprintf(f1, "%d %d\n", capped, ok);
+		printf("%d %d\n", capped, ok);
+
+		munmap(vm_ptr, vm_size);
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+int resident_pages(void *vm, int vm_size, int page_size)
+{
+	unsigned char vec[64];
+	int i, n = 0;
+	mincore(vm, vm_size, vec);
+	for(i = 0; i < vm_size/page_size; i++)
+		n += vec[i] & 1;
+	return n;
+}
+
+void mm_log(FILE *f1, int page_size)
+{
+	fprintf(f1, "%ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_report_nbytes_released()/page_size, mm_report_nbytes_restored()/page_size);
+	printf("%ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_report_nbytes_released()/page_size, mm_report_nbytes_restored()/page_size);
+}
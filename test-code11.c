@@ -0,0 +1,79 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Readahead on a sequential read scan, a sequential write scan and a strided scan, followed by
+// random reads that must not trigger any prefetching.
+// Logs faults, write backs, prefetched pages and faults avoided after every scan.
+void mm_log(FILE *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 64;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int temp;
+	int i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	vm_ptr=memalign(PAGE_SIZE, vm_size);
+	if(vm_ptr==NULL)
+	{
+		printf("FAILURE in virtual memory allocation\n");
+		return 0;
+	}
+
+	mm_options options = {0};
+	options.readahead = 8;
+	mm_init_with_options((void*)vm_ptr, vm_size, 16, PAGE_SIZE, MM_POLICY_FIFO, &options);
+	mm_log(f1);
+
+	/* virtual memory access starts */
+
+	for(i = 0; i < 32; i++)
+		temp = vm_ptr[i*page_ints];		// Read pages 1 to 32 in order
+	mm_log(f1);
+
+	for(i = 32; i < 64; i++)
+		vm_ptr[i*page_ints] = i;		// Write pages 33 to 64 in order
+	mm_log(f1);
+
+	for(i = 0; i < 64; i += 3)
+		temp = vm_ptr[i*page_ints];		// Read every third page
+	mm_log(f1);
+
+	int pages[] = {40, 7, 22, 51, 3, 60, 18};
+	for(i = 0; i < 7; i++)
+		temp = vm_ptr[pages[i]*page_ints];	// Read pages in no particular order
+	mm_log(f1);
+
+	/* virtual memory access ends */
+
+	mm_destroy();
+
+	int ok = 1;
+	for(i = 32; i < 64; i++)
+		ok = ok && vm_ptr[i*page_ints] == i;
+	fprintf(f1, "%d\n", ok);
+	printf("%d\n", ok);
+
+	free(vm_ptr);
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1)
+{
+	fprintf(f1, "%ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_report_nprefetches(), mm_report_nfaults_avoided());
+	printf("%ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_report_nprefetches(), mm_report_nfaults_avoided());
+}
@@ -0,0 +1,94 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Statistics snapshot from mm_get_stats, with fifo and clock.
+// Logs page faults, read faults, write faults, protection faults, write upgrades, clean and dirty
+// evictions after every access, then whether the latency histograms hold one entry per fault and
+// whether the clock hand moved.
+void mm_log(FILE *);
+unsigned long histogram_total(const uint64_t *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int vm_size = 16*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int policy;
+	int temp;
+	FILE* f1 = fopen("results.txt", "w");
+
+	vm_ptr=memalign(PAGE_SIZE, vm_size);
+	if(vm_ptr==NULL)
+	{
+		printf("FAILURE in virtual memory allocation\n");
+		return 0;
+	}
+
+	for(policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK; policy++)
+	{
+		mm_init((void*)vm_ptr, vm_size, 3, PAGE_SIZE, policy);
+		mm_log(f1);
+
+		/* virtual memory access starts */
+
+		temp = vm_ptr[0];			// Read virtual page 1
+		mm_log(f1);
+		vm_ptr[0] = 1;				// Write virtual page 1
+		mm_log(f1);
+		vm_ptr[page_ints] = 2;			// Write virtual page 2
+		mm_log(f1);
+		temp = vm_ptr[2*page_ints];		// Read virtual page 3
+		mm_log(f1);
+		temp = vm_ptr[3*page_ints];		// Read virtual page 4
+		mm_log(f1);
+		temp = vm_ptr[4*page_ints];		// Read virtual page 5
+		mm_log(f1);
+		vm_ptr[5*page_ints] = 6;		// Write virtual page 6
+		mm_log(f1);
+
+		/* virtual memory access ends */
+
+		mm_stats stats;
+		mm_get_stats(&stats);
+		int ok = histogram_total(stats.fault_latency) == stats.page_faults
+			&& histogram_total(stats.protection_latency) == stats.protection_faults
+			&& stats.ticks_per_ns > 0;
+		fprintf(f1, "%d %d\n", ok, stats.hand_steps > 0);
+		printf("%d %d\n", ok, stats.hand_steps > 0);
+
+		mm_destroy();
+	}
+
+	free(vm_ptr);
+	fclose(f1);
+	return 0;
+}
+
+unsigned long histogram_total(const uint64_t *histogram)
+{
+	unsigned long total = 0;
+	int i;
+	for(i = 0; i < MM_LATENCY_BUCKETS; i++)
+		total += histogram[i];
+	return total;
+}
+
+void mm_log(FILE *f1)
+{
+	mm_stats stats;
+	mm_get_stats(&stats);
+	fprintf(f1, "%lu %lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.read_faults,
+		(unsigned long)stats.write_faults, (unsigned long)stats.protection_faults, (unsigned long)stats.write_upgrades,
+		(unsigned long)stats.evictions_clean, (unsigned long)stats.evictions_dirty);
+	printf("%lu %lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.read_faults,
+		(unsigned long)stats.write_faults, (unsigned long)stats.protection_faults, (unsigned long)stats.write_upgrades,
+		(unsigned long)stats.evictions_clean, (unsigned long)stats.evictions_dirty);
+}
@@ -0,0 +1,92 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Background reclaimer, with fifo and clock and with both backends.
+// Writes 64 pages through 8 frames, slowly enough for the reclaimer to keep up, and logs the page faults, then whether the reclaimer did evictions,
+// whether every modified page that left its frame was written back, whether no more pages than frames were
+// resident and whether every page kept its value.
+int resident_pages(void *, int, int);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 64;
+	int n_frames = 8;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int policy, backend;
+	int i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK; policy++)
+	{
+		for(backend = MM_BACKEND_SIGSEGV; backend <= MM_BACKEND_USERFAULTFD; backend++)
+		{
+			vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if(vm_ptr==MAP_FAILED)
+			{
+				printf("FAILURE in virtual memory allocation\n");
+				return 0;
+			}
+
+			mm_options options = {0};
+			options.backend = backend;
+			options.reclaim = 1;
+			options.reclaimer = 1;
+			options.free_low = 2;
+			options.free_high = 4;
+			mm_init_with_options((void*)vm_ptr, vm_size, n_frames, PAGE_SIZE, policy, &options);
+
+			/* virtual memory access starts */
+
+			for(i = 0; i < n_pages; i++)
+			{
+				vm_ptr[i*page_ints] = i;	// Write pages 1 to 64 in order
+				usleep(1000);			// Give the reclaimer time to run
+			}
+
+			/* virtual memory access ends */
+
+			mm_stats stats;
+			mm_get_stats(&stats);
+			int fits = resident_pages(vm_ptr, n_pages, PAGE_SIZE) <= n_frames;
+			fprintf(f1, "%lu\n", (unsigned long)stats.page_faults);
+			fprintf(f1, "%d %d %d\n", stats.reclaimed > 0, stats.evictions_clean == 0, fits);
+			printf("%lu\n", (unsigned long)stats.page_faults);
+			printf("%d %d %d\n", stats.reclaimed > 0, stats.evictions_clean == 0, fits);
+
+			mm_destroy();
+
+			int ok = 1;
+			for(i = 0; i < n_pages; i++)
+				ok = ok && vm_ptr[i*page_ints] == i;
+			fprintf(f1, "%d\n", ok);
+			printf("%d\n", ok);
+
+			munmap(vm_ptr, vm_size);
+		}
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+int resident_pages(void *vm, int n_pages, int page_size)
+{
+	unsigned char resident[n_pages];
+	int count = 0;
+	int i;
+	if(mincore(vm, n_pages*page_size, resident) != 0)
+		return -1;
+	for(i = 0; i < n_pages; i++)
+		count += resident[i] & 1;
+	return count;
+}
@@ -0,0 +1,125 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Compressed tier ('compress_budget') with 'reclaim'. Pages are filled with zeros, a repeated word, text or
+// random bytes, written once and then read twice through 4 frames with fifo, and once more with a pool too
+// small for anything but markers. Then 8 pages of 256 KiB, 64 KiB of random bytes and zeros elsewhere, go through
+// the same steps, so they compress to chunks larger than 64 KiB and their zeros are more than 64 KiB in.
+// Logs faults, write backs, pages in the pool, same-filled pages in it and faults served from it after every
+// pass, then whether the pool compressed the text pages and whether every page kept its contents.
+int page_word(int, int, int);
+void fill(int *, int, int);
+int check(int *, int, int);
+void mm_log(FILE *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int page_sizes[] = {PAGE_SIZE, PAGE_SIZE, 256*1024};
+	int pages[] = {16, 16, 8};
+	size_t budgets[] = {1024*1024, 1024, 2*1024*1024};
+	int b, i, pass;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(b = 0; b < 3; b++)
+	{
+		PAGE_SIZE = page_sizes[b];
+		int n_pages = pages[b];
+		int vm_size = n_pages*PAGE_SIZE;
+		int page_ints = PAGE_SIZE/sizeof(int);
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.reclaim = 1;
+		options.compress_budget = budgets[b];
+		mm_init_with_options((void*)vm_ptr, vm_size, 4, PAGE_SIZE, MM_POLICY_FIFO, &options);
+
+		/* virtual memory access starts */
+
+		for(i = 0; i < n_pages; i++)
+			fill(vm_ptr + i*page_ints, page_ints, i);	// Write every page
+		mm_log(f1);
+
+		int ok = 1;
+		for(pass = 0; pass < 2; pass++)
+		{
+			for(i = 0; i < n_pages; i++)
+				ok = ok && check(vm_ptr + i*page_ints, page_ints, i);	// Read every page
+			mm_log(f1);
+		}
+
+		/* virtual memory access ends */
+
+		mm_stats stats;
+		mm_get_stats(&stats);
+		int compressed = stats.compressed_bytes > 0 && stats.compressed_bytes < (stats.compressed_pages - stats.compressed_same_filled) * PAGE_SIZE / 2;
+		mm_destroy();
+
+		for(i = 0; i < n_pages; i++)
+			ok = ok && check(vm_ptr + i*page_ints, page_ints, i);
+		fprintf(f1, "%d %d\n", compressed, ok);
+		printf("%d %d\n", compressed, ok);
+
+		munmap(vm_ptr, vm_size);
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+// Page i holds zeros, the word i, text or random bytes, depending on i % 4. Pages of n > 16384 ints hold random
+// bytes in their last quarter if i is even and in their first quarter if it is odd, and zeros elsewhere.
+int page_word(int i, int k, int n)
+{
+	static const char text[] = "the quick brown fox jumps over the lazy dog ";
+	int word;
+	if(n > 16384)
+		return (i % 2 == 0 ? k >= n / 4 * 3 : k < n / 4) ? page_word(3, k, 0) ^ i : 0;
+	switch(i % 4)
+	{
+		case 0: return 0;
+		case 1: return i;
+		case 2: memcpy(&word, text + (k * sizeof(int)) % (sizeof(text) - sizeof(int)), sizeof(int)); return word + i;
+		default: return (int)((unsigned)(k + 1) * 2654435761u ^ (unsigned)i * 40503u) * 1103515245 + 12345;
+	}
+}
+
+void fill(int *page, int n, int i)
+{
+	int k;
+	for(k = 0; k < n; k++)
+		page[k] = page_word(i, k, n);
+}
+
+int check(int *page, int n, int i)
+{
+	int k;
+	for(k = 0; k < n; k++)
+		if(page[k] != page_word(i, k, n))
+			return 0;
+	return 1;
+}
+
+void mm_log(FILE *f1)
+{
+	mm_stats stats;
+	mm_get_stats(&stats);
+	fprintf(f1, "%lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs,
+		(unsigned long)stats.compressed_pages, (unsigned long)stats.compressed_same_filled, (unsigned long)stats.compressed_faults);
+	printf("%lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs,
+		(unsigned long)stats.compressed_pages, (unsigned long)stats.compressed_same_filled, (unsigned long)stats.compressed_faults);
+}
@@ -0,0 +1,80 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// A 1 TiB region reserved with MAP_NORESERVE, used at a few pages far apart, with fifo and 2 frames,
+// without and with 'reclaim'.
+// Logs faults and write backs after every pass, then whether the page table stayed small and whether
+// every page kept its value.
+void mm_log(FILE *);
+
+int main ()
+{
+	char* vm_ptr;
+	long PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	size_t vm_size = (size_t)1 << 40;
+	size_t offsets[] = {0, (size_t)1 << 30, (size_t)3 << 35, ((size_t)1 << 40) - PAGE_SIZE, (size_t)7 << 36};
+	int n_offsets = 5;
+	int reclaim;
+	int i, pass;
+	int temp;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(reclaim = 0; reclaim < 2; reclaim++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.reclaim = reclaim;
+		mm_init_with_options((void*)vm_ptr, vm_size, 2, PAGE_SIZE, MM_POLICY_FIFO, &options);
+		mm_log(f1);
+
+		/* virtual memory access starts */
+
+		for(i = 0; i < n_offsets; i++)
+			*(int*)(vm_ptr + offsets[i]) = i + 1;		// Write pages far apart
+		mm_log(f1);
+
+		for(pass = 0; pass < 2; pass++)
+		{
+			for(i = 0; i < n_offsets; i++)
+				temp = *(int*)(vm_ptr + offsets[i]);	// Read them again
+			mm_log(f1);
+		}
+
+		/* virtual memory access ends */
+
+		mm_stats stats;
+		mm_get_stats(&stats);
+		int small = stats.page_index_bytes < 1024*1024;
+		mm_destroy();
+
+		int ok = 1;
+		for(i = 0; i < n_offsets; i++)
+			ok = ok && *(int*)(vm_ptr + offsets[i]) == i + 1;
+		fprintf(f1, "%d %d\n", small, ok);
+		printf("%d %d\n", small, ok);
+
+		munmap(vm_ptr, vm_size);
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1)
+{
+	fprintf(f1, "%ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs());
+	printf("%ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs());
+}
@@ -0,0 +1,73 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Miss ratio curve estimated while a loop over 32 of 64 pages runs 20 times, with lru and a single frame,
+// once tracking every page and once with room for 16 sampled pages, then while a loop over 24 of the pages
+// runs 20 times with 8 frames, tracking every page.
+// Logs faults, the predicted fault ratio at 1, 16, 24, 32 and 64 frames and the frames predicted
+// for a fault ratio of 10%, then whether the estimate is off for a region without 'mrc_samples'.
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int vm_size = 64*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int samples[] = {1024, 16, 1024};
+	int run_frames[] = {1, 1, 8};
+	int loop_pages[] = {32, 32, 24};
+	int frames[] = {1, 16, 24, 32, 64};
+	int run, pass, i;
+	int temp;
+	FILE* f1 = fopen("results.txt", "w");
+
+	vm_ptr=memalign(PAGE_SIZE, vm_size);
+	if(vm_ptr==NULL)
+	{
+		printf("FAILURE in virtual memory allocation\n");
+		return 0;
+	}
+
+	for(run = 0; run < 3; run++)
+	{
+		mm_options options = {0};
+		options.mrc_samples = samples[run];
+		mm_init_with_options((void*)vm_ptr, vm_size, run_frames[run], PAGE_SIZE, MM_POLICY_LRU, &options);
+
+		/* virtual memory access starts */
+
+		for(pass = 0; pass < 20; pass++)
+			for(i = 0; i < loop_pages[run]; i++)
+				temp = vm_ptr[(2*i)*page_ints];		// Read every other page
+
+		/* virtual memory access ends */
+
+		fprintf(f1, "%lu\n", mm_report_npage_faults());
+		printf("%lu\n", mm_report_npage_faults());
+		for(i = 0; i < 5; i++)
+		{
+			fprintf(f1, "%.2f\n", mm_predict_fault_ratio(frames[i]));
+			printf("%.2f\n", mm_predict_fault_ratio(frames[i]));
+		}
+		fprintf(f1, "%d\n", mm_frames_for_fault_ratio(0.1));
+		printf("%d\n", mm_frames_for_fault_ratio(0.1));
+
+		mm_destroy();
+	}
+
+	mm_init((void*)vm_ptr, vm_size, 1, PAGE_SIZE, MM_POLICY_LRU);
+	temp = vm_ptr[0];
+	fprintf(f1, "%d %d\n", mm_predict_fault_ratio(1) < 0, mm_frames_for_fault_ratio(0.1));
+	printf("%d %d\n", mm_predict_fault_ratio(1) < 0, mm_frames_for_fault_ratio(0.1));
+	mm_destroy();
+
+	free(vm_ptr);
+	fclose(f1);
+	return 0;
+}
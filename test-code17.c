@@ -0,0 +1,76 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Frame budget changed with mm_set_frames while the region is in use, for every policy, with 'reclaim'.
+// 4 frames for 8 written pages, then 12 frames for 8 more, then 2 frames, then every page is read back.
+// Logs faults and write backs after every step, then whether every page kept its value
+// and whether an empty budget is refused.
+void mm_log(FILE *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int vm_size = 16*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int policy;
+	int i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK_PRO; policy++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.reclaim = 1;
+		mm_init_with_options((void*)vm_ptr, vm_size, 4, PAGE_SIZE, policy, &options);
+
+		/* virtual memory access starts */
+
+		for(i = 0; i < 8; i++)
+			vm_ptr[i*page_ints] = i + 1;		// Write pages 1 to 8 with 4 frames
+		mm_log(f1);
+
+		mm_set_frames(12);
+		for(i = 8; i < 16; i++)
+			vm_ptr[i*page_ints] = i + 1;		// Write pages 9 to 16 with 12 frames
+		mm_log(f1);
+
+		mm_set_frames(2);				// Shrink below the resident pages
+		mm_log(f1);
+
+		int ok = 1;
+		for(i = 0; i < 16; i++)
+			ok = ok && vm_ptr[i*page_ints] == i + 1;	// Read every page back with 2 frames
+		mm_log(f1);
+
+		/* virtual memory access ends */
+
+		fprintf(f1, "%d %d\n", ok, mm_set_frames(0));
+		printf("%d %d\n", ok, mm_set_frames(0));
+
+		mm_destroy();
+		munmap(vm_ptr, vm_size);
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1)
+{
+	fprintf(f1, "%lu %lu\n", mm_report_npage_faults(), mm_report_nwrite_backs());
+	printf("%lu %lu\n", mm_report_npage_faults(), mm_report_nwrite_backs());
+}
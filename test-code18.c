@@ -0,0 +1,99 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Application hints from mm_advise, for every policy, with 8 frames for 32 pages and 'reclaim'.
+// WILLNEED on 6 pages, PIN on 2 of them followed by a scan, SEQUENTIAL on 8 pages,
+// DONTNEED on the pinned pages, then RANDOM on the sequential pages.
+// Logs faults, write backs, advised prefetches, advised faults avoided, pinned and discarded pages
+// after every step, then whether the pinned data survived the scan, whether discarded data reads
+// as zeros and whether bad ranges and hints are refused.
+void mm_log(FILE *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int vm_size = 32*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int policy;
+	int i;
+	int temp;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK_PRO; policy++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.reclaim = 1;
+		mm_init_with_options((void*)vm_ptr, vm_size, 8, PAGE_SIZE, policy, &options);
+
+		/* virtual memory access starts */
+
+		mm_advise(vm_ptr, 6*PAGE_SIZE, MM_ADVICE_WILLNEED);	// Prefetch pages 1 to 6
+		for(i = 0; i < 6; i++)
+			temp = vm_ptr[i*page_ints];			// Read them without faults
+		vm_ptr[0] = 7;						// Write page 1
+		mm_log(f1);
+
+		mm_advise(vm_ptr, 2*PAGE_SIZE, MM_ADVICE_PIN);		// Pin pages 1 and 2
+		for(i = 8; i < 24; i++)
+			temp = vm_ptr[i*page_ints];			// Scan pages 9 to 24
+		int kept = vm_ptr[0] == 7;				// Read page 1 without a fault
+		temp = vm_ptr[page_ints];				// Read page 2 without a fault
+		mm_log(f1);
+
+		mm_advise(&vm_ptr[24*page_ints], 8*PAGE_SIZE, MM_ADVICE_SEQUENTIAL);
+		for(i = 24; i < 32; i++)
+			temp = vm_ptr[i*page_ints];			// Read pages 25 to 32
+		mm_log(f1);
+
+		mm_advise(vm_ptr, 2*PAGE_SIZE, MM_ADVICE_DONTNEED);	// Drop pages 1 and 2
+		int zero = vm_ptr[0] == 0;				// Read page 1 again
+		mm_log(f1);
+
+		mm_advise(&vm_ptr[24*page_ints], 8*PAGE_SIZE, MM_ADVICE_DONTNEED);
+		mm_advise(&vm_ptr[24*page_ints], 8*PAGE_SIZE, MM_ADVICE_RANDOM);
+		for(i = 24; i < 32; i++)
+			temp = vm_ptr[i*page_ints];			// Read pages 25 to 32 again
+		mm_log(f1);
+
+		/* virtual memory access ends */
+
+		int refused = mm_advise(&vm_ptr[32*page_ints], PAGE_SIZE, MM_ADVICE_WILLNEED) == -1
+			&& mm_advise(vm_ptr, 0, MM_ADVICE_WILLNEED) == -1
+			&& mm_advise(vm_ptr, PAGE_SIZE, 42) == -1;
+		fprintf(f1, "%d %d %d\n", kept, zero, refused);
+		printf("%d %d %d\n", kept, zero, refused);
+
+		mm_destroy();
+		munmap(vm_ptr, vm_size);
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1)
+{
+	mm_stats stats;
+	mm_get_stats(&stats);
+	fprintf(f1, "%lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs,
+		(unsigned long)stats.advised_prefetches, (unsigned long)stats.advised_faults_avoided,
+		(unsigned long)stats.pinned_pages, (unsigned long)stats.discarded_pages);
+	printf("%lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs,
+		(unsigned long)stats.advised_prefetches, (unsigned long)stats.advised_faults_avoided,
+		(unsigned long)stats.pinned_pages, (unsigned long)stats.discarded_pages);
+}
@@ -0,0 +1,104 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// File backed regions ('file_path'), without and with the compressed tier. The file starts with 12 of the
+// 16 pages, the rest of the region reads as zeros. Every page is read, written and read again with 4 frames,
+// logging faults, write backs, pages released and pages read back after every pass. After mm_destroy the
+// file has to hold every written page, and a new region over the same file has to read them back.
+void mm_log(FILE *, int);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 16;
+	int file_pages = 12;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	char path[] = "/tmp/mm_test19_XXXXXX";
+	int round;
+	int i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	int fd = mkstemp(path);
+	int* page = calloc(1, PAGE_SIZE);
+	for(i = 0; i < file_pages; i++)
+	{
+		page[0] = 100+i;
+		pwrite(fd, page, PAGE_SIZE, (off_t)i*PAGE_SIZE);
+	}
+
+	for(round = 0; round < 2; round++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.file_path = path;
+		options.compress_budget = round == 1 ? 64*1024 : 0;
+		mm_init_with_options((void*)vm_ptr, vm_size, 4, PAGE_SIZE, MM_POLICY_FIFO, &options);
+
+		/* virtual memory access starts */
+
+		int ok = 1;
+		for(i = 0; i < n_pages; i++)
+			ok = ok && vm_ptr[i*page_ints] == (round == 0 ? (i < file_pages ? 100+i : 0) : 1000+i);
+		mm_log(f1, PAGE_SIZE);
+
+		for(i = 0; i < n_pages; i++)
+			vm_ptr[i*page_ints] = 2000+i;		// Write every page
+		mm_log(f1, PAGE_SIZE);
+
+		for(i = 0; i < n_pages; i++)
+			ok = ok && vm_ptr[i*page_ints] == 2000+i;
+		for(i = 0; i < n_pages; i += 2)
+			vm_ptr[i*page_ints] = 1000+i;		// Write every other page again
+		for(i = 1; i < n_pages; i += 2)
+			vm_ptr[i*page_ints] = 1000+i;
+		mm_log(f1, PAGE_SIZE);
+
+		/* virtual memory access ends */
+
+		mm_destroy();
+
+		struct stat st;
+		fstat(fd, &st);
+		int saved = st.st_size == vm_size;
+		for(i = 0; i < n_pages; i++)
+		{
+			pread(fd, page, PAGE_SIZE, (off_t)i*PAGE_SIZE);
+			saved = saved && page[0] == 1000+i;
+		}
+		fprintf(f1, "%d %d\n", ok, saved);
+		printf("%d %d\n", ok, saved);
+
+		munmap(vm_ptr, vm_size);
+	}
+
+	close(fd);
+	unlink(path);
+	free(page);
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1, int page_size)
+{
+	fprintf(f1, "%ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_report_nbytes_released()/page_size, mm_report_nbytes_restored()/page_size);
+	printf("%ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_report_nbytes_released()/page_size, mm_report_nbytes_restored()/page_size);
+}
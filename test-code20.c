@@ -0,0 +1,91 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// The bitmap clock has to pick the same victims as the list clock. Both run the same pseudo random reads
+// and writes over 256 pages with 24 frames, four times: plain, with readahead, with the frame budget
+// changing, and with mm_advise hints that pin pages and drop them, which leave free frames in the ring.
+// Logs faults, write backs and hand steps for each policy, the two lines of each run have to match.
+void mm_log(FILE *);
+
+unsigned long rng;
+
+unsigned int next_random()
+{
+	rng = rng * 6364136223846793005ul + 1442695040888963407ul;
+	return rng >> 33;
+}
+
+int main ()
+{
+	char* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 256;
+	int vm_size = n_pages*PAGE_SIZE;
+	int policies[] = {MM_POLICY_CLOCK, MM_POLICY_CLOCK_BITMAP};
+	int run, policy;
+	int i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(run = 0; run < 4; run++)
+	{
+		for(policy = 0; policy < 2; policy++)
+		{
+			vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if(vm_ptr==MAP_FAILED)
+			{
+				printf("FAILURE in virtual memory allocation\n");
+				return 0;
+			}
+
+			mm_options options = {0};
+			options.readahead = run == 1 ? 8 : 0;
+			mm_init_with_options((void*)vm_ptr, vm_size, 24, PAGE_SIZE, policies[policy], &options);
+
+			/* virtual memory access starts */
+
+			rng = run + 1;
+			for(i = 0; i < 4000; i++)
+			{
+				unsigned int r = next_random();
+				int page = r % 5 == 0 ? i % n_pages : next_random() % (n_pages / 4);
+				if(r & 8)
+					vm_ptr[page*PAGE_SIZE]++;
+				else
+					(void)*(volatile char*)&vm_ptr[page*PAGE_SIZE];
+
+				if(run == 2 && i % 500 == 499)
+					mm_set_frames(8 + next_random() % 40);
+				if(run == 3 && i % 250 == 125)
+				{
+					int first = next_random() % (n_pages - 8);
+					int advice = next_random() % 2 == 0 ? MM_ADVICE_PIN : MM_ADVICE_DONTNEED;
+					mm_advise(vm_ptr + first*PAGE_SIZE, (1 + next_random() % 8) * PAGE_SIZE, advice);
+				}
+			}
+
+			/* virtual memory access ends */
+
+			mm_log(f1);
+			mm_destroy();
+			munmap(vm_ptr, vm_size);
+		}
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1)
+{
+	mm_stats stats;
+	mm_get_stats(&stats);
+	fprintf(f1, "%lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs, (unsigned long)stats.hand_steps);
+	printf("%lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs, (unsigned long)stats.hand_steps);
+}
@@ -0,0 +1,99 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Admission filter, for every policy, with 'reclaim'. 32 frames, a loop over 48 pages (each page is read,
+// then written) run 8 times, one scan over 192 other pages, and the loop 4 more times. Each pass writes the
+// pass number into its pages, and every page is checked against what was last written to it.
+// Runs every policy without and with 'admission'. Logs faults during the first loops, the scan and the
+// last loops, the admitted and rejected pages, whether every page kept its value, and whether the
+// filter cut the faults of the loops.
+void mm_log(FILE *, unsigned long, unsigned long, unsigned long, mm_stats *, int);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 256;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int policy, admission;
+	int i, pass;
+	unsigned long loop_faults[2];
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(policy = MM_POLICY_FIFO; policy <= MM_POLICY_CLOCK_BITMAP; policy++)
+	{
+		for(admission = 0; admission < 2; admission++)
+		{
+			vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if(vm_ptr==MAP_FAILED)
+			{
+				printf("FAILURE in virtual memory allocation\n");
+				return 0;
+			}
+
+			mm_options options = {0};
+			options.reclaim = 1;
+			options.admission = admission;
+			mm_init_with_options((void*)vm_ptr, vm_size, 32, PAGE_SIZE, policy, &options);
+
+			/* virtual memory access starts */
+
+			int ok = 1;
+			for(pass = 1; pass <= 8; pass++)
+			{
+				for(i = 0; i < 48; i++)
+				{
+					ok = ok && vm_ptr[i*page_ints] == pass - 1;
+					vm_ptr[i*page_ints] = pass;
+				}
+			}
+			unsigned long first = mm_report_npage_faults();
+
+			for(i = 48; i < 240; i++)
+				vm_ptr[i*page_ints] = i;		// The scan
+			unsigned long scan = mm_report_npage_faults() - first;
+
+			for(pass = 9; pass <= 12; pass++)
+			{
+				for(i = 0; i < 48; i++)
+				{
+					ok = ok && vm_ptr[i*page_ints] == pass - 1;
+					vm_ptr[i*page_ints] = pass;
+				}
+			}
+			unsigned long last = mm_report_npage_faults() - first - scan;
+
+			for(i = 48; i < 240; i++)
+				ok = ok && vm_ptr[i*page_ints] == i;
+
+			/* virtual memory access ends */
+
+			mm_stats stats;
+			mm_get_stats(&stats);
+			mm_log(f1, first, scan, last, &stats, ok);
+			loop_faults[admission] = first + last;
+
+			mm_destroy();
+			munmap(vm_ptr, vm_size);
+		}
+		fprintf(f1, "%d\n", loop_faults[1] < loop_faults[0]);
+		printf("%d\n", loop_faults[1] < loop_faults[0]);
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1, unsigned long first, unsigned long scan, unsigned long last, mm_stats *stats, int ok)
+{
+	fprintf(f1, "%lu %lu %lu %lu %lu %d\n", first, scan, last, (unsigned long)stats->admitted_pages, (unsigned long)stats->rejected_pages, ok);
+	printf("%lu %lu %lu %lu %lu %d\n", first, scan, last, (unsigned long)stats->admitted_pages, (unsigned long)stats->rejected_pages, ok);
+}
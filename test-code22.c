@@ -0,0 +1,114 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// Shared region of 64 pages with 16 frames, used by three processes one after the other.
+// The parent writes pages 0-7. A child opens the region by name, reads pages 0-7 (other process made them
+// resident, no page faults) and writes pages 8-15, which the parent then reads. A second child keeps the
+// parent's handle, fails to open the region with another size, and writes pages 16-31, evicting 0-15.
+// The parent reads page 0 (still mapped, no fault), faults page 40 and loses its rights to pages 0-15,
+// checks them (they fault again) and shrinks the budget to 4 frames.
+// Every step logs the page faults, protection faults and shared hits of the process, its revoked pages,
+// the page faults and write backs of all processes, and whether the data read was what was written.
+#define NAME "/mm473_test22"
+
+FILE* f1;
+void mm_log(const char *, mm_context *, int);
+
+int main ()
+{
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 64;
+	size_t vm_size = (size_t)n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int i, ok;
+	int* vm_ptr;
+	f1 = fopen("results.txt", "w");
+
+	mm_shared_unlink(NAME);
+	mm_context *ctx = mm_shared_open(NAME, vm_size, 16, PAGE_SIZE, (void**)&vm_ptr);
+	if(ctx == NULL)
+	{
+		printf("FAILURE in shared region creation\n");
+		return 0;
+	}
+
+	/* virtual memory access starts */
+
+	for(i = 0; i < 8; i++)
+		vm_ptr[i*page_ints] = i + 1;
+	mm_log("parent", ctx, 1);
+
+	fflush(NULL);
+	if(fork() == 0)
+	{
+		int *other;
+		mm_context *opened = mm_shared_open(NAME, vm_size, 1, PAGE_SIZE, (void**)&other);
+		ok = opened != NULL;
+		for(i = 0; ok && i < 8; i++)
+			ok = other[i*page_ints] == i + 1;
+		for(i = 8; ok && i < 16; i++)
+			other[i*page_ints] = i + 1;
+		mm_log("child", opened, ok);
+		mm_destroy_context(opened);
+		fclose(f1);
+		exit(0);
+	}
+	wait(NULL);
+
+	ok = 1;
+	for(i = 8; i < 16; i++)
+		ok = ok && vm_ptr[i*page_ints] == i + 1;
+	mm_log("parent", ctx, ok);
+
+	fflush(NULL);
+	if(fork() == 0)
+	{
+		int *other;
+		ok = mm_shared_open(NAME, vm_size * 2, 16, PAGE_SIZE, (void**)&other) == NULL;
+		for(i = 16; i < 32; i++)
+			vm_ptr[i*page_ints] = i + 1;
+		mm_log("child", ctx, ok);
+		fclose(f1);
+		exit(0);
+	}
+	wait(NULL);
+
+	ok = vm_ptr[0] == 1;
+	mm_log("parent", ctx, ok);
+	ok = vm_ptr[40*page_ints] == 0;
+	mm_log("parent", ctx, ok);
+	for(i = 0; i < 32; i++)
+		ok = ok && vm_ptr[i*page_ints] == i + 1;
+	mm_log("parent", ctx, ok);
+	ok = mm_context_set_frames(ctx, 4) == 0;
+	for(i = 0; i < 32; i++)
+		ok = ok && vm_ptr[i*page_ints] == i + 1;
+	mm_log("parent", ctx, ok);
+
+	/* virtual memory access ends */
+
+	mm_destroy_context(ctx);
+	mm_shared_unlink(NAME);
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(const char *who, mm_context *ctx, int ok)
+{
+	mm_stats stats;
+	mm_context_get_stats(ctx, &stats);
+	fprintf(f1, "%s %lu %lu %lu %lu %lu %lu %d\n", who, (unsigned long)stats.page_faults, (unsigned long)stats.protection_faults,
+		(unsigned long)stats.shared_hits, (unsigned long)stats.revoked_pages, (unsigned long)stats.shared_page_faults,
+		(unsigned long)stats.shared_write_backs, ok);
+	printf("%s %lu %lu %lu %lu %lu %lu %d\n", who, (unsigned long)stats.page_faults, (unsigned long)stats.protection_faults,
+		(unsigned long)stats.shared_hits, (unsigned long)stats.revoked_pages, (unsigned long)stats.shared_page_faults,
+		(unsigned long)stats.shared_write_backs, ok);
+}
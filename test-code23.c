@@ -0,0 +1,119 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Deduplication ('dedup_budget') with 'reclaim'. Of 64 pages, three quarters hold one of three contents and
+// the rest contents of their own. Pages are written once, read twice through 8 frames with clock, then every
+// 8th page gets a word changed and all are read again. Runs with room for 64 copies and for 2.
+// Logs faults, write backs, pages in shared copies, copies, frames saved and write backs saved after every pass,
+// then whether the copies took less memory than the pages and whether every page kept its contents.
+void fill(int *, int, int);
+int check(int *, int, int, int);
+void mm_log(FILE *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 64;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int budgets[] = {64, 2};
+	int b, i, pass;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(b = 0; b < 2; b++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.reclaim = 1;
+		options.dedup_budget = (size_t)budgets[b] * PAGE_SIZE;
+		mm_init_with_options((void*)vm_ptr, vm_size, 8, PAGE_SIZE, MM_POLICY_CLOCK, &options);
+
+		/* virtual memory access starts */
+
+		for(i = 0; i < n_pages; i++)
+			fill(vm_ptr + i*page_ints, page_ints, i);	// Write pages 1 to 64
+		mm_log(f1);
+
+		int ok = 1;
+		for(pass = 0; pass < 2; pass++)
+		{
+			for(i = 0; i < n_pages; i++)
+				ok = ok && check(vm_ptr + i*page_ints, page_ints, i, 0);	// Read pages 1 to 64
+			mm_log(f1);
+		}
+
+		for(i = 0; i < n_pages; i += 8)
+			vm_ptr[i*page_ints + 1] = -1;	// Change pages 1, 9, ..., 57
+		for(i = 0; i < n_pages; i++)
+			ok = ok && check(vm_ptr + i*page_ints, page_ints, i, i % 8 == 0);
+		mm_log(f1);
+
+		/* virtual memory access ends */
+
+		mm_stats stats;
+		mm_get_stats(&stats);
+		int saved = stats.dedup_copies > 0 && stats.dedup_bytes_saved > 0;
+		mm_destroy();
+
+		for(i = 0; i < n_pages; i++)
+			ok = ok && check(vm_ptr + i*page_ints, page_ints, i, i % 8 == 0);
+		fprintf(f1, "%d %d\n", saved, ok);
+		printf("%d %d\n", saved, ok);
+
+		munmap(vm_ptr, vm_size);
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+// Page i holds the word i % 4 + 1 everywhere, or its own words if i % 4 is 3
+int page_word(int i, int k)
+{
+	if(i % 4 == 3)
+		return i * 40503 + k;
+	return i % 4 + 1;
+}
+
+void fill(int *page, int n, int i)
+{
+	int k;
+	for(k = 0; k < n; k++)
+		page[k] = page_word(i, k);
+}
+
+int check(int *page, int n, int i, int changed)
+{
+	int k;
+	for(k = 0; k < n; k++)
+		if(page[k] != (changed && k == 1 ? -1 : page_word(i, k)))
+			return 0;
+	return 1;
+}
+
+void mm_log(FILE *f1)
+{
+	mm_stats stats;
+	mm_get_stats(&stats);
+	fprintf(f1, "%lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs,
+		(unsigned long)stats.dedup_pages, (unsigned long)stats.dedup_copies, (unsigned long)stats.dedup_frames_saved,
+		(unsigned long)stats.dedup_write_backs_saved);
+	printf("%lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.write_backs,
+		(unsigned long)stats.dedup_pages, (unsigned long)stats.dedup_copies, (unsigned long)stats.dedup_frames_saved,
+		(unsigned long)stats.dedup_write_backs_saved);
+}
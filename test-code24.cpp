@@ -0,0 +1,78 @@
+#include "473_mm.hpp"
+#include <stdio.h>
+#include <stdexcept>
+#include <utility>
+
+// C++ front end. A fifo region and a clock region of 16 pages with 4 frames each. Pages 1 to 16 of both are
+// written and then read, the fifo region is moved to a new owner, grows to 8 frames and is read twice more.
+// A region with no frames is refused, and a region created after the others went out of scope starts from zero.
+// Logs page faults, protection faults, write backs and evictions after every step through the typed stats,
+// and whether the data read was what was written.
+FILE* f1;
+
+template <class Region>
+void mm_log(const Region& region, int ok)
+{
+	mm::Stats stats = region.stats();
+	fprintf(f1, "%lu %lu %lu %lu %d\n", (unsigned long)stats.page_faults(), (unsigned long)stats.protection_faults(),
+		(unsigned long)stats.write_backs(), (unsigned long)stats.evictions(), ok);
+	printf("%lu %lu %lu %lu %d\n", (unsigned long)stats.page_faults(), (unsigned long)stats.protection_faults(),
+		(unsigned long)stats.write_backs(), (unsigned long)stats.evictions(), ok);
+}
+
+template <class Region>
+int write_read(Region& region)
+{
+	size_t i;
+	int ok = 1;
+	for(i = 0; i < region.pages(); i++)
+		region.template page<int>(i)[1] = (int)i + 1;	// Write pages 1 to 16
+	for(i = 0; i < region.pages(); i++)
+		ok = ok && region.template page<int>(i)[1] == (int)i + 1;	// Read pages 1 to 16
+	return ok;
+}
+
+int main ()
+{
+	f1 = fopen("results.txt", "w");
+	int ok;
+	size_t i;
+	{
+		mm::ManagedRegion<mm::Fifo> fifo(16, 4);
+		mm::ManagedRegion<mm::Clock> clock(16, 4);
+
+		/* virtual memory access starts */
+
+		mm_log(fifo, write_read(fifo));
+		mm_log(clock, write_read(clock));
+
+		mm::ManagedRegion<mm::Fifo> moved(std::move(fifo));
+		ok = fifo.context() == NULL && moved.page_number(moved.page(5) + 100) == 5 && moved.contains(moved.page(15))
+			&& !moved.contains(moved.page(16));
+		mm_log(moved, ok);
+
+		ok = moved.set_frames(8);
+		for(int pass = 0; pass < 2; pass++)
+			for(i = 0; i < moved.pages(); i++)
+				ok = ok && moved.page<int>(i)[1] == (int)i + 1;
+		mm_log(moved, ok);
+
+		/* virtual memory access ends */
+	}
+
+	try
+	{
+		mm::ManagedRegion<mm::Lru> refused(16, 0);
+		ok = 0;
+	}
+	catch(const std::invalid_argument&)
+	{
+		ok = 1;
+	}
+	mm::ManagedRegion<mm::ClockBitmap> later(16, 4);
+	ok = ok && write_read(later);
+	mm_log(later, ok);
+
+	fclose(f1);
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// Extents ('extent_pages'). A file backed region of 256 pages with 4 frames, managed in single pages, in
+// extents of 16 pages, in extents of 16 pages with 'dirty_subpages', and in extents of 32 pages with a
+// compressed tier ('compress_budget'). Every page is written, read, then one page in 5 is changed and every
+// page read again with fifo. With the compressed tier the second half of every extent is also filled with
+// random bytes, so extents compress to more than 64 KiB.
+// Logs faults, protection faults, write backs, the pages partial write backs wrote and skipped and the pages in
+// the compressed tier after every pass, then whether every page kept its contents and whether the file holds
+// them after mm_destroy.
+void mm_log(FILE *);
+int expected(int, int);
+void noise(int *, int, int);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 256;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int extents[] = {1, 16, 16, 32};
+	int dirty[] = {0, 0, 1, 0};
+	size_t budgets[] = {0, 0, 0, 4*1024*1024};
+	char path[] = "/tmp/mm_test25_XXXXXX";
+	int round, i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(round = 0; round < 4; round++)
+	{
+		int fd = mkstemp(path);
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.file_path = path;
+		options.extent_pages = extents[round];
+		options.dirty_subpages = dirty[round];
+		options.compress_budget = budgets[round];
+		mm_init_with_options((void*)vm_ptr, vm_size, 4, PAGE_SIZE, MM_POLICY_FIFO, &options);
+
+		/* virtual memory access starts */
+
+		int ok = 1;
+		for(i = 0; i < n_pages; i++)
+		{
+			vm_ptr[i*page_ints + 1] = expected(i, 0);	// Write pages 1 to 256
+			if(budgets[round] > 0 && i % extents[round] >= extents[round] / 2)
+				noise(vm_ptr + i*page_ints, page_ints, i);
+		}
+		mm_log(f1);
+		for(i = 0; i < n_pages; i++)
+			ok = ok && vm_ptr[i*page_ints + 1] == expected(i, 0);	// Read pages 1 to 256
+		mm_log(f1);
+		for(i = 0; i < n_pages; i += 5)
+			vm_ptr[i*page_ints + 1] = expected(i, 1);	// Change pages 1, 6, ..., 256
+		for(i = 0; i < n_pages; i++)
+			ok = ok && vm_ptr[i*page_ints + 1] == expected(i, 1);
+		mm_log(f1);
+
+		/* virtual memory access ends */
+
+		mm_destroy();
+		munmap(vm_ptr, vm_size);
+
+		int *file = mmap(NULL, vm_size, PROT_READ, MAP_SHARED, fd, 0);
+		int saved = file != MAP_FAILED;
+		for(i = 0; saved && i < n_pages; i++)
+			saved = file[i*page_ints + 1] == expected(i, 1);
+		if(file != MAP_FAILED)
+			munmap(file, vm_size);
+		fprintf(f1, "%d %d\n", ok, saved);
+		printf("%d %d\n", ok, saved);
+
+		close(fd);
+		unlink(path);
+		sprintf(path, "/tmp/mm_test25_XXXXXX");
+	}
+
+	fclose(f1);
+	return 0;
+}
+
+// Fills the ints of page i past the one checked with random bytes
+void noise(int *page, int n, int i)
+{
+	int k;
+	for(k = 2; k < n; k++)
+		page[k] = (int)((unsigned)(k + 1) * 2654435761u ^ (unsigned)i * 40503u) * 1103515245 + 12345;
+}
+
+// Contents of page i, after the pages were changed or not
+int expected(int i, int changed)
+{
+	return changed && i % 5 == 0 ? -i : i + 1;
+}
+
+void mm_log(FILE *f1)
+{
+	mm_stats stats;
+	mm_get_stats(&stats);
+	fprintf(f1, "%lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.protection_faults,
+		(unsigned long)stats.write_backs, (unsigned long)stats.subpages_written, (unsigned long)stats.subpages_skipped,
+		(unsigned long)stats.compressed_pages);
+	printf("%lu %lu %lu %lu %lu %lu\n", (unsigned long)stats.page_faults, (unsigned long)stats.protection_faults,
+		(unsigned long)stats.write_backs, (unsigned long)stats.subpages_written, (unsigned long)stats.subpages_skipped,
+		(unsigned long)stats.compressed_pages);
+}
@@ -0,0 +1,139 @@
+#include "473_mm.h"
+#include "473_mm_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Fault trace ('trace_path') and mm_replay. The same accesses to 8 pages are made with fifo through 1 frame
+// while recording a trace, and through 3 frames without one: every page is written, every other page read,
+// pages 8 to 1 read, then pages 1, 4 and 7 written and pages 1 to 8 read.
+// Logs the live faults and write backs of both runs, the trace's header, its number of records and every
+// record's page number and write bit, then whether the fifo columns of mm_replay for 1 and 3 frames are the
+// live counts.
+void access_pages(int *, int);
+int replay(const char *, int, unsigned long *, unsigned long *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = 8;
+	int vm_size = n_pages*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int frames[] = {1, 3};
+	unsigned long faults[2], write_backs[2];
+	char path[] = "/tmp/mm_test26_XXXXXX";
+	int run;
+	FILE* f1 = fopen("results.txt", "w");
+
+	close(mkstemp(path));
+	for(run = 0; run < 2; run++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.trace_path = run == 0 ? path : NULL;
+		mm_init_with_options((void*)vm_ptr, vm_size, frames[run], PAGE_SIZE, MM_POLICY_FIFO, &options);
+
+		/* virtual memory access starts */
+
+		access_pages(vm_ptr, page_ints);
+
+		/* virtual memory access ends */
+
+		faults[run] = mm_report_npage_faults();
+		write_backs[run] = mm_report_nwrite_backs();
+		fprintf(f1, "%lu %lu\n", faults[run], write_backs[run]);
+		printf("%lu %lu\n", faults[run], write_backs[run]);
+		mm_destroy();
+		munmap(vm_ptr, vm_size);
+	}
+
+	FILE* trace = fopen(path, "rb");
+	mm_trace_header header;
+	mm_trace_record record;
+	int n_records = 0;
+	if(trace == NULL || fread(&header, sizeof(header), 1, trace) != 1)
+	{
+		printf("FAILURE reading the trace\n");
+		return 0;
+	}
+	fprintf(f1, "%d %u %u\n", memcmp(header.magic, MM_TRACE_MAGIC, sizeof(header.magic)) == 0,
+		header.page_size == (uint32_t)PAGE_SIZE, header.n_pages);
+	while(fread(&record, sizeof(record), 1, trace) == 1)
+	{
+		if(record.page == MM_TRACE_TIME_EXTEND)
+			continue;
+		fprintf(f1, "%u %d\n", record.page & ~MM_TRACE_WRITE, (record.page & MM_TRACE_WRITE) != 0);
+		n_records++;
+	}
+	fclose(trace);
+	fprintf(f1, "%d\n", n_records);
+	printf("%d\n", n_records);
+
+	// The trace was recorded through 1 frame, so the simulation replays both runs exactly
+	for(run = 0; run < 2; run++)
+	{
+		unsigned long sim_faults, sim_write_backs;
+		int found = replay(path, frames[run], &sim_faults, &sim_write_backs);
+		fprintf(f1, "%d %d\n", found && sim_faults == faults[run], found && sim_write_backs == write_backs[run]);
+		printf("%d %d\n", found && sim_faults == faults[run], found && sim_write_backs == write_backs[run]);
+	}
+
+	unlink(path);
+	fclose(f1);
+	return 0;
+}
+
+void access_pages(int *vm_ptr, int page_ints)
+{
+	int i, temp = 0;
+	for(i = 0; i < 8; i++)
+		vm_ptr[i*page_ints] = i + 1;	// Write pages 1 to 8
+	for(i = 0; i < 8; i += 2)
+		temp += vm_ptr[i*page_ints + 1];	// Read pages 1, 3, 5, 7
+	for(i = 7; i >= 0; i--)
+		temp += vm_ptr[i*page_ints + 2];	// Read pages 8 to 1
+	for(i = 0; i < 8; i += 3)
+		vm_ptr[i*page_ints + 3] = temp;	// Write pages 1, 4, 7
+	for(i = 0; i < 8; i++)
+		temp += vm_ptr[i*page_ints + 4];	// Read pages 1 to 8
+}
+
+// Runs mm_replay on the trace for 'frames' frames and reads the fifo column of both of its tables.
+// Returns 0 if they were not found.
+int replay(const char *path, int frames, unsigned long *faults, unsigned long *write_backs)
+{
+	char command[128], line[256];
+	unsigned long fifo, clock, opt;
+	int table = -1, n, found = 0;
+	snprintf(command, sizeof(command), "./mm_replay %s %d", path, frames);
+	FILE* out = popen(command, "r");
+	if(out == NULL)
+		return 0;
+	while(fgets(line, sizeof(line), out) != NULL)
+	{
+		if(strncmp(line, "page faults", 11) == 0)
+			table = 0;
+		else if(strncmp(line, "write backs", 11) == 0)
+			table = 1;
+		else if(table >= 0 && sscanf(line, "%d %lu %lu %lu", &n, &fifo, &clock, &opt) == 4 && n == frames)
+		{
+			*(table == 0 ? faults : write_backs) = fifo;
+			found++;
+		}
+	}
+	pclose(out);
+	return found == 2;
+}
@@ -0,0 +1,126 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Concurrent faults. 4 threads share a region of 64 pages with 'reclaim' and 8 frames, with fifo, clock and lru.
+// Each thread owns 8 pages and all of them use the other 32, each in its own ints. For 20 passes a thread writes
+// its ints of its own pages and of the shared pages and reads them back, in an order that differs per thread.
+// Logs, for every policy, whether every thread read back what it wrote and the region holds the last values,
+// whether the read and write faults add up to the page faults, whether the evictions are the page faults minus
+// the frames in use, whether the write backs are the dirty evictions and whether every page faulted.
+#define N_THREADS 4
+#define OWN_PAGES 8
+#define SHARED_PAGES 32
+#define PASSES 20
+
+typedef struct worker worker;
+struct worker {
+	int *vm;
+	int page_ints;
+	int id;
+	int ok;
+};
+
+int value(int id, int page, int pass)
+{
+	return (pass + 1) * 1000 + page * N_THREADS + id;
+}
+
+// The ints of thread 'id' in page 'page'
+int *slot(worker *w, int page)
+{
+	return w->vm + page*w->page_ints + w->id*2;
+}
+
+void *work(void *arg)
+{
+	worker *w = arg;
+	int n = OWN_PAGES + SHARED_PAGES;
+	int steps[N_THREADS] = {1, 3, 7, 9};	// Prime to the number of pages, so every pass visits each once
+	int pass, i;
+	w->ok = 1;
+	for(pass = 0; pass < PASSES; pass++)
+	{
+		for(i = 0; i < n; i++)
+		{
+			int k = (i * steps[w->id] + pass) % n;
+			int page = k < OWN_PAGES ? w->id*OWN_PAGES + k : N_THREADS*OWN_PAGES + k - OWN_PAGES;
+			if(pass > 0 && *slot(w, page) != value(w->id, page, pass - 1))
+				w->ok = 0;
+			*slot(w, page) = value(w->id, page, pass);
+		}
+	}
+	return NULL;
+}
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int n_pages = N_THREADS*OWN_PAGES + SHARED_PAGES;
+	int vm_size = n_pages*PAGE_SIZE;
+	int n_frames = 8;
+	int policies[] = {MM_POLICY_FIFO, MM_POLICY_CLOCK, MM_POLICY_LRU};
+	pthread_t threads[N_THREADS];
+	worker workers[N_THREADS];
+	int p, t, i;
+	FILE* f1 = fopen("results.txt", "w");
+
+	for(p = 0; p < 3; p++)
+	{
+		vm_ptr = mmap(NULL, vm_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm_ptr==MAP_FAILED)
+		{
+			printf("FAILURE in virtual memory allocation\n");
+			return 0;
+		}
+
+		mm_options options = {0};
+		options.reclaim = 1;
+		mm_init_with_options((void*)vm_ptr, vm_size, n_frames, PAGE_SIZE, policies[p], &options);
+
+		/* virtual memory access starts */
+
+		for(t = 0; t < N_THREADS; t++)
+		{
+			workers[t].vm = vm_ptr;
+			workers[t].page_ints = PAGE_SIZE/sizeof(int);
+			workers[t].id = t;
+			pthread_create(&threads[t], NULL, work, &workers[t]);
+		}
+		int ok = 1;
+		for(t = 0; t < N_THREADS; t++)
+		{
+			pthread_join(threads[t], NULL);
+			ok = ok && workers[t].ok;
+		}
+		for(t = 0; t < N_THREADS; t++)
+			for(i = 0; i < n_pages; i++)
+				if((i < N_THREADS*OWN_PAGES ? i / OWN_PAGES == t : 1) && *slot(&workers[t], i) != value(t, i, PASSES - 1))
+					ok = 0;
+
+		/* virtual memory access ends */
+
+		mm_stats stats;
+		mm_get_stats(&stats);
+		int split = stats.read_faults + stats.write_faults == stats.page_faults;
+		int evicted = stats.evictions_clean + stats.evictions_dirty == stats.page_faults - n_frames;
+		int written = stats.write_backs == stats.evictions_dirty;
+		int faulted = stats.page_faults >= (uint64_t)n_pages;
+		fprintf(f1, "%d %d %d %d %d\n", ok, split, evicted, written, faulted);
+		printf("%d %d %d %d %d\n", ok, split, evicted, written, faulted);
+
+		mm_destroy();
+		munmap(vm_ptr, vm_size);
+	}
+
+	fclose(f1);
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Runs the same access sequence under the lru, 2q, arc and clock-pro policies
+void mm_log(FILE *);
+
+int main ()
+{
+	int* vm_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int vm_size = 16*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int temp;
+	int policy;
+	FILE* f1 = fopen("results.txt", "w");
+
+	vm_ptr=memalign(PAGE_SIZE, vm_size);
+	if(vm_ptr==NULL)
+	{
+		printf("FAILURE in virtual memory allocation\n");	
+		return 0;
+	}
+
+	for(policy = MM_POLICY_LRU; policy <= MM_POLICY_CLOCK_PRO; policy++)
+	{
+		mm_init((void*)vm_ptr, vm_size, 3, PAGE_SIZE, policy);
+		mm_log(f1);
+
+		/* virtual memory access starts */
+
+		vm_ptr[0] = 1;				// Write virtual page 1
+		mm_log(f1);
+		temp = vm_ptr[1*page_ints];		// Read virtual page 2
+		mm_log(f1);
+		temp = vm_ptr[2*page_ints];		// Read virtual page 3
+		mm_log(f1);
+		temp = vm_ptr[3*page_ints];		// Read virtual page 4
+		mm_log(f1);
+		vm_ptr[1*page_ints] = 2;		// Write virtual page 2
+		mm_log(f1);
+		temp = vm_ptr[0];			// Read virtual page 1
+		mm_log(f1);
+		temp = vm_ptr[4*page_ints];		// Read virtual page 5
+		mm_log(f1);
+		temp = vm_ptr[3*page_ints];		// Read virtual page 4
+		mm_log(f1);
+		vm_ptr[0] = 3;				// Write virtual page 1
+		mm_log(f1);
+		temp = vm_ptr[5*page_ints];		// Read virtual page 6
+		mm_log(f1);
+		temp = vm_ptr[1*page_ints];		// Read virtual page 2
+		mm_log(f1);
+		temp = vm_ptr[2*page_ints];		// Read virtual page 3
+		mm_log(f1);
+
+		/* virtual memory access ends */
+
+		mm_destroy();
+	}
+
+	free(vm_ptr);
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1)
+{
+	fprintf(f1, "%ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs());	
+	printf("%ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs());	
+}
@@ -0,0 +1,91 @@
+#include "473_mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <malloc.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// Three regions managed side by side: the default one from mm_init (fifo, 2 frames),
+// a hot one (clock, 4 frames) and a cold one (lru, 1 frame). Each logged line holds the
+// faults and write backs of the default, hot and cold region.
+void mm_log(FILE *, mm_context *, mm_context *);
+
+int main ()
+{
+	int* vm_ptr;
+	int* hot_ptr;
+	int* cold_ptr;
+	int PAGE_SIZE = sysconf(_SC_PAGE_SIZE);
+	int vm_size = 8*PAGE_SIZE;
+	int page_ints = PAGE_SIZE/sizeof(int);
+	int temp;
+	FILE* f1 = fopen("results.txt", "w");
+
+	vm_ptr=memalign(PAGE_SIZE, vm_size);
+	hot_ptr=memalign(PAGE_SIZE, vm_size);
+	cold_ptr=memalign(PAGE_SIZE, vm_size);
+	if(vm_ptr==NULL || hot_ptr==NULL || cold_ptr==NULL)
+	{
+		printf("FAILURE in virtual memory allocation\n");
+		return 0;
+	}
+
+	mm_init((void*)vm_ptr, vm_size, 2, PAGE_SIZE, MM_POLICY_FIFO);
+	mm_context *hot = mm_create((void*)hot_ptr, vm_size, 4, PAGE_SIZE, MM_POLICY_CLOCK, NULL);
+	mm_context *cold = mm_create((void*)cold_ptr, vm_size, 1, PAGE_SIZE, MM_POLICY_LRU, NULL);
+	mm_log(f1, hot, cold);
+
+	/* virtual memory access starts */
+
+	vm_ptr[0] = 1;				// Write default page 1
+	mm_log(f1, hot, cold);
+	hot_ptr[0] = 2;				// Write hot page 1
+	mm_log(f1, hot, cold);
+	cold_ptr[0] = 3;			// Write cold page 1
+	mm_log(f1, hot, cold);
+	temp = vm_ptr[1*page_ints];		// Read default page 2
+	mm_log(f1, hot, cold);
+	temp = hot_ptr[1*page_ints];		// Read hot page 2
+	mm_log(f1, hot, cold);
+	temp = cold_ptr[1*page_ints];		// Read cold page 2
+	mm_log(f1, hot, cold);
+	temp = vm_ptr[2*page_ints];		// Read default page 3
+	mm_log(f1, hot, cold);
+	hot_ptr[2*page_ints] = 4;		// Write hot page 3
+	mm_log(f1, hot, cold);
+	cold_ptr[0] = 5;			// Write cold page 1
+	mm_log(f1, hot, cold);
+	temp = vm_ptr[0];			// Read default page 1
+	mm_log(f1, hot, cold);
+	temp = hot_ptr[0];			// Read hot page 1
+	mm_log(f1, hot, cold);
+
+	/* virtual memory access ends */
+
+	mm_destroy_context(cold);
+	mm_destroy_context(hot);
+	mm_destroy();
+
+	// Every region keeps its contents after being torn down
+	fprintf(f1, "%d %d %d\n", vm_ptr[0], hot_ptr[2*page_ints], cold_ptr[0]);
+	printf("%d %d %d\n", vm_ptr[0], hot_ptr[2*page_ints], cold_ptr[0]);
+
+	free(vm_ptr);
+	free(hot_ptr);
+	free(cold_ptr);
+	fclose(f1);
+	return 0;
+}
+
+void mm_log(FILE *f1, mm_context *hot, mm_context *cold)
+{
+	fprintf(f1, "%ld %ld %ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_context_npage_faults(hot), mm_context_nwrite_backs(hot),
+		mm_context_npage_faults(cold), mm_context_nwrite_backs(cold));
+	printf("%ld %ld %ld %ld %ld %ld\n", mm_report_npage_faults(), mm_report_nwrite_backs(),
+		mm_context_npage_faults(hot), mm_context_nwrite_backs(hot),
+		mm_context_npage_faults(cold), mm_context_nwrite_backs(cold));
+}
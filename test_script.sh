@@ -24,6 +24,10 @@ function testFIFO {
     ./test_5 > /dev/null 2>&1
     echo -e "\t[TEST #5] -> Check manually...diff doesn't work for some reason for 5"
     verify output_5
+
+    ./test_7 > /dev/null 2>&1
+    echo -e "\t[TEST #7] userfaultfd backend"
+    verify output_7
 }
 
 function testClock {
@@ -42,12 +46,193 @@ function testClock {
     verify output_6
 }
 
+function testPolicies {
+    echo "[TESTING LRU, 2Q, ARC, CLOCK-PRO]"
+
+    ./test_8 > /dev/null 2>&1
+    echo -e "\t[TEST #8]"
+    verify output_8
+}
+
+function testRegions {
+    echo "[TESTING MULTIPLE REGIONS]"
+
+    ./test_9 > /dev/null 2>&1
+    echo -e "\t[TEST #9]"
+    verify output_9
+}
+
+function testReclaim {
+    echo "[TESTING RECLAIM]"
+
+    ./test_10 > /dev/null 2>&1
+    echo -e "\t[TEST #10]"
+    verify output_10
+}
+
+function testReadahead {
+    echo "[TESTING READAHEAD]"
+
+    ./test_11 > /dev/null 2>&1
+    echo -e "\t[TEST #11]"
+    verify output_11
+}
+
+function testStats {
+    echo "[TESTING STATISTICS]"
+
+    ./test_12 > /dev/null 2>&1
+    echo -e "\t[TEST #12]"
+    verify output_12
+}
+
+function testReclaimer {
+    echo "[TESTING BACKGROUND RECLAIMER]"
+
+    ./test_13 > /dev/null 2>&1
+    echo -e "\t[TEST #13]"
+    verify output_13
+}
+
+function testCompress {
+    echo "[TESTING COMPRESSED TIER]"
+
+    ./test_14 > /dev/null 2>&1
+    echo -e "\t[TEST #14]"
+    verify output_14
+}
+
+function testSparse {
+    echo "[TESTING SPARSE REGIONS]"
+
+    ./test_15 > /dev/null 2>&1
+    echo -e "\t[TEST #15]"
+    verify output_15
+}
+
+function testMRC {
+    echo "[TESTING MISS RATIO CURVE]"
+
+    ./test_16 > /dev/null 2>&1
+    echo -e "\t[TEST #16]"
+    verify output_16
+}
+
+function testResize {
+    echo "[TESTING FRAME BUDGET RESIZE]"
+
+    ./test_17 > /dev/null 2>&1
+    echo -e "\t[TEST #17]"
+    verify output_17
+}
+
+function testAdvise {
+    echo "[TESTING APPLICATION HINTS]"
+
+    ./test_18 > /dev/null 2>&1
+    echo -e "\t[TEST #18]"
+    verify output_18
+}
+
+function testFileBacked {
+    echo "[TESTING FILE BACKED REGIONS]"
+
+    ./test_19 > /dev/null 2>&1
+    echo -e "\t[TEST #19]"
+    verify output_19
+}
+
+function testBitmapClock {
+    echo "[TESTING BITMAP CLOCK]"
+
+    ./test_20 > /dev/null 2>&1
+    echo -e "\t[TEST #20]"
+    verify output_20
+}
+
+function testAdmission {
+    echo "[TESTING ADMISSION FILTER]"
+
+    ./test_21 > /dev/null 2>&1
+    echo -e "\t[TEST #21]"
+    verify output_21
+}
+
+function testShared {
+    echo "[TESTING SHARED REGIONS]"
+
+    ./test_22 > /dev/null 2>&1
+    echo -e "\t[TEST #22]"
+    verify output_22
+}
+
+function testDedup {
+    echo "[TESTING DEDUPLICATION]"
+
+    ./test_23 > /dev/null 2>&1
+    echo -e "\t[TEST #23]"
+    verify output_23
+}
+
+function testCxx {
+    echo "[TESTING C++ FRONT END]"
+
+    ./test_24 > /dev/null 2>&1
+    echo -e "\t[TEST #24]"
+    verify output_24
+}
+
+function testExtents {
+    echo "[TESTING EXTENTS]"
+
+    ./test_25 > /dev/null 2>&1
+    echo -e "\t[TEST #25]"
+    verify output_25
+}
+
+function testTrace {
+    echo "[TESTING TRACE]"
+
+    ./test_26 > /dev/null 2>&1
+    echo -e "\t[TEST #26]"
+    verify output_26
+}
+
+function testThreads {
+    echo "[TESTING THREADS]"
+
+    ./test_27 > /dev/null 2>&1
+    echo -e "\t[TEST #27]"
+    verify output_27
+}
+
 make compile_1
 make compile_2
 make compile_3
 make compile_4
 make compile_5
 make compile_6
+make compile_7
+make compile_8
+make compile_9
+make compile_10
+make compile_11
+make compile_12
+make compile_13
+make compile_14
+make compile_15
+make compile_16
+make compile_17
+make compile_18
+make compile_19
+make compile_20
+make compile_21
+make compile_22
+make compile_23
+make compile_24
+make compile_25
+make compile_26
+make compile_27
 
 if [ "$POLICY" = "1" ]
 then
@@ -55,7 +240,87 @@ then
 elif [ "$POLICY" = "2" ]
 then
     testClock
+elif [ "$POLICY" = "3" ]
+then
+    testPolicies
+elif [ "$POLICY" = "4" ]
+then
+    testRegions
+elif [ "$POLICY" = "5" ]
+then
+    testReclaim
+elif [ "$POLICY" = "6" ]
+then
+    testReadahead
+elif [ "$POLICY" = "7" ]
+then
+    testStats
+elif [ "$POLICY" = "8" ]
+then
+    testReclaimer
+elif [ "$POLICY" = "9" ]
+then
+    testCompress
+elif [ "$POLICY" = "10" ]
+then
+    testSparse
+elif [ "$POLICY" = "11" ]
+then
+    testMRC
+elif [ "$POLICY" = "12" ]
+then
+    testResize
+elif [ "$POLICY" = "13" ]
+then
+    testAdvise
+elif [ "$POLICY" = "14" ]
+then
+    testFileBacked
+elif [ "$POLICY" = "15" ]
+then
+    testBitmapClock
+elif [ "$POLICY" = "16" ]
+then
+    testAdmission
+elif [ "$POLICY" = "17" ]
+then
+    testShared
+elif [ "$POLICY" = "18" ]
+then
+    testDedup
+elif [ "$POLICY" = "19" ]
+then
+    testCxx
+elif [ "$POLICY" = "20" ]
+then
+    testExtents
+elif [ "$POLICY" = "21" ]
+then
+    testTrace
+elif [ "$POLICY" = "22" ]
+then
+    testThreads
 else
     testFIFO
     testClock
+    testPolicies
+    testRegions
+    testReclaim
+    testReadahead
+    testStats
+    testReclaimer
+    testCompress
+    testSparse
+    testMRC
+    testResize
+    testAdvise
+    testFileBacked
+    testBitmapClock
+    testAdmission
+    testShared
+    testDedup
+    testCxx
+    testExtents
+    testTrace
+    testThreads
 fi
\ No newline at end of file